@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+	// the rasterizer is discarded, only the captured instances matter
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 330 core
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in mat4 vModel[];
+in mat3 vNormal[];
+in vec3 vColour[];
+flat in int vLayer[];
+in float vVisible[];
+
+// captured by transform feedback, in InstanceData order
+out mat4 cullModel;
+out mat3 cullNormal;
+out vec3 cullColour;
+flat out int cullLayer;
+
+void main()
+{
+	if (vVisible[0] == 0.0)
+		return;
+	cullModel = vModel[0];
+	cullNormal = vNormal[0];
+	cullColour = vColour[0];
+	cullLayer = vLayer[0];
+	gl_Position = gl_in[0].gl_Position;
+	EmitVertex();
+	EndPrimitive();
+}
\ No newline at end of file
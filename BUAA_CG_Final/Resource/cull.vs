@@ -0,0 +1,30 @@
+#version 330 core
+// one instance per point, in the attributes of the instanced shaders (see instancing.h)
+layout (location = 3) in mat4 model;
+layout (location = 7) in mat3 normalMatrix;
+layout (location = 10) in vec3 colour;
+layout (location = 11) in int layer;
+
+out mat4 vModel;
+out mat3 vNormal;
+out vec3 vColour;
+flat out int vLayer;
+out float vVisible;
+
+uniform vec4 planes[6];
+uniform float radius; // of the mesh's bounding sphere in model space
+
+void main()
+{
+	vec3 center = model[3].xyz;
+	float scale = sqrt(max(dot(model[0].xyz, model[0].xyz), max(dot(model[1].xyz, model[1].xyz), dot(model[2].xyz, model[2].xyz))));
+	vVisible = 1.0;
+	for (int i = 0; i < 6; ++i)
+		if (dot(planes[i].xyz, center) + planes[i].w < -radius * scale * length(planes[i].xyz))
+			vVisible = 0.0;
+	vModel = model;
+	vNormal = normalMatrix;
+	vColour = colour;
+	vLayer = layer;
+	gl_Position = vec4(center, 1.0);
+}
\ No newline at end of file
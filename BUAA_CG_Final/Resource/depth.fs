@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+	// depth only, nothing to write
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+#ifdef INSTANCED
+layout (location = 3) in mat4 model;
+#else
+uniform mat4 model;
+#endif
+uniform mat4 lightSpace;
+
+void main()
+{
+	gl_Position = lightSpace * model * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 330 core
+out float depth;
+
+uniform sampler2D source; // the occluder depth, or the level before the one written
+uniform vec2 sourceSize;
+uniform int reduce; // 0 copies the occluder depth into level 0
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	if (reduce == 0) {
+		depth = texelFetch(source, texel, 0).r;
+		return;
+	}
+	// the farthest of the 2x2 texels beneath, the last row and column of an odd level take a third
+	ivec2 size = ivec2(sourceSize);
+	ivec2 target = max(size / 2, ivec2(1));
+	ivec2 first = texel * 2;
+	ivec2 last = min(first + 1, size - 1);
+	if (texel.x == target.x - 1)
+		last.x = size.x - 1;
+	if (texel.y == target.y - 1)
+		last.y = size.y - 1;
+	float farthest = 0.0;
+	for (int y = first.y; y <= last.y; ++y)
+		for (int x = first.x; x <= last.x; ++x)
+			farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+	depth = farthest;
+}
\ No newline at end of file
@@ -2,7 +2,11 @@
 
 out vec4 FragColor;
 
+#ifdef INSTANCED
+flat in vec3 colour;
+#else
 uniform vec3 colour;
+#endif
 
 void main()
 {
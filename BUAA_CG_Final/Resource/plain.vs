@@ -1,11 +1,23 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef INSTANCED
+layout (location = 3) in mat4 model;
+layout (location = 10) in vec3 instanceColour;
+
+flat out vec3 colour;
+
+uniform mat4 viewProjection;
+#else
+uniform mat4 mvp;
+#endif
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef INSTANCED
+	gl_Position = viewProjection * (model * vec4(aPos, 1.0));
+	colour = instanceColour;
+#else
+	gl_Position = mvp * vec4(aPos, 1.0);
+#endif
 }
\ No newline at end of file
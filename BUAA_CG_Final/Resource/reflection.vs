@@ -6,14 +6,25 @@ out vec3 Normal;
 out vec3 Position;
 out vec3 myPosition;
 
+#ifdef INSTANCED
+layout (location = 3) in mat4 model;
+layout (location = 7) in mat3 normalMatrix;
+
+uniform mat4 viewProjection;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;
+uniform mat4 mvp;
+#endif
 
 void main()
 {
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
     Position = vec3(model * vec4(aPos, 1.0));
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef INSTANCED
+    gl_Position = viewProjection * vec4(Position, 1.0);
+#else
+    gl_Position = mvp * vec4(aPos, 1.0);
+#endif
 	myPosition = aPos * 2;
 }
\ No newline at end of file
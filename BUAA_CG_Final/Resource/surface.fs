@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 ShadowCoord;
+in vec4 FragPosLightSpace;
+
+out vec4 FragColor;
+
+uniform vec3 colour;
+uniform bool useShadowMap;
+uniform sampler2D shadowTexture;
+uniform sampler2DShadow shadowMap;
+uniform int pcfRadius;
+
+// fraction of the (2 * pcfRadius + 1)^2 taps that are lit
+float shadowFactor(vec4 lightSpacePos)
+{
+	vec3 p = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+	if (p.z > 1.0)
+		return 1.0;
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+	float lit = 0.0;
+	for (int x = -pcfRadius; x <= pcfRadius; ++x)
+		for (int y = -pcfRadius; y <= pcfRadius; ++y)
+			lit += texture(shadowMap, vec3(p.xy + vec2(x, y) * texel, p.z));
+	return lit / float((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
+}
+
+void main()
+{
+	float lit = useShadowMap ? shadowFactor(FragPosLightSpace) : texture(shadowTexture, ShadowCoord).r;
+	FragColor = vec4(colour * lit, 1.0);
+}
\ No newline at end of file
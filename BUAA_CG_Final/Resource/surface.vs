@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec2 ShadowCoord;
+out vec4 FragPosLightSpace;
+
+uniform mat4 model;
+uniform mat4 mvp;
+uniform mat4 lightSpace;
+
+void main()
+{
+	vec4 worldPos = model * vec4(aPos, 1.0);
+	gl_Position = mvp * vec4(aPos, 1.0);
+	ShadowCoord = aPos.xz * 0.5 + 0.5;
+	FragPosLightSpace = lightSpace * worldPos;
+}
\ No newline at end of file
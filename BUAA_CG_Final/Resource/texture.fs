@@ -4,22 +4,95 @@ in vec2 TexCoord;
 
 in vec3 Normal;  
 in vec3 FragPos;  
+in vec4 FragPosLightSpace;
 out vec4 FragColor;
 
 uniform vec3 lightPos; 
 uniform vec3 viewPos; 
 uniform vec3 lightColor;
+#ifdef INSTANCED
+flat in vec3 colour;
+flat in int layer;
+#else
 uniform vec3 colour;
-uniform sampler2D texture;
+uniform int layer;
+#endif
+uniform sampler2D ourTexture;
+uniform bool useSH;
+uniform vec3 shCoeffs[9];
+uniform bool useShadowMap;
+uniform sampler2DShadow shadowMap;
+uniform int pcfRadius;
+uniform bool useVirtualTexture;
+uniform sampler2D vtIndirection;
+uniform int vtPages;
+uniform int vtMaxLevel;
+uniform int vtSlots;
+uniform int vtPage;
+uniform int vtBorder;
+uniform int texturePacking;
+uniform sampler2DArray ourTextures;
+uniform sampler2D atlasRects;
+
+// fraction of the (2 * pcfRadius + 1)^2 taps that are lit
+float shadowFactor(vec4 lightSpacePos)
+{
+    vec3 p = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    if (p.z > 1.0)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = 0.0;
+    for (int x = -pcfRadius; x <= pcfRadius; ++x)
+        for (int y = -pcfRadius; y <= pcfRadius; ++y)
+            lit += texture(shadowMap, vec3(p.xy + vec2(x, y) * texel, p.z));
+    return lit / float((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
+}
+
+// irradiance from 9 SH coefficients, pre-convolved with the cosine lobe on the CPU
+vec3 irradianceSH(vec3 n)
+{
+    return shCoeffs[0]
+        + shCoeffs[1] * n.y + shCoeffs[2] * n.z + shCoeffs[3] * n.x
+        + shCoeffs[4] * n.x * n.y + shCoeffs[5] * n.y * n.z
+        + shCoeffs[6] * (3.0 * n.z * n.z - 1.0)
+        + shCoeffs[7] * n.x * n.z + shCoeffs[8] * (n.x * n.x - n.y * n.y);
+}
+
+// ourTexture is the page atlas of a virtual texture: the level the derivatives ask for is looked up in the
+// indirection, which names the slot holding that page or its nearest resident ancestor
+vec4 sampleVirtual(vec2 uv)
+{
+    vec2 dx = dFdx(uv) * float(vtPages * vtPage), dy = dFdy(uv) * float(vtPages * vtPage);
+    int level = int(clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, float(vtMaxLevel)));
+    vec2 wrapped = fract(uv);
+    ivec2 page = ivec2(wrapped * float(vtPages >> level));
+    vec4 entry = texelFetch(vtIndirection, ivec2(2 * (vtPages - (vtPages >> level)) + page.x, page.y), 0) * 255.0;
+    int resident = int(entry.b + 0.5);
+    vec2 inPage = fract(wrapped * float(vtPages >> resident)) * float(vtPage);
+    vec2 texel = floor(entry.rg + 0.5) * float(vtPage + 2 * vtBorder) + float(vtBorder) + inPage;
+    return textureLod(ourTexture, texel / float(vtSlots * (vtPage + 2 * vtBorder)), 0.0);
+}
+
+// image `index` of a TexturePacker: a layer of ourTextures, or a rect of the atlas in ourTexture that the
+// coordinates repeat inside, sampled with the gradients of the unwrapped coordinates so the seams keep their mip
+vec4 samplePacked(vec2 uv, int index)
+{
+    if (texturePacking == 1)
+        return texture(ourTextures, vec3(uv, float(index)));
+    vec4 rect = texelFetch(atlasRects, ivec2(index, 0), 0);
+    return textureGrad(ourTexture, rect.xy + fract(uv) * rect.zw, dFdx(uv) * rect.zw, dFdy(uv) * rect.zw);
+}
 
 void main()
 {
 	// ambient
     float ambientStrength = 0.1;
+    vec3 norm = normalize(Normal);
     vec3 ambient = ambientStrength * lightColor;
+    if (useSH)
+        ambient = ambientStrength * max(irradianceSH(norm), 0.0) / 3.141592654;
   	
     // diffuse 
-    vec3 norm = normalize(Normal);
     vec3 lightDir = normalize(lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
     vec3 diffuse = diff * lightColor;
@@ -31,6 +104,9 @@ void main()
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
     vec3 specular = specularStrength * spec * lightColor;  
         
-    vec3 result = (ambient + diffuse + specular) * colour;
-    FragColor = mix(texture(texture, TexCoord), vec4(result, 1.0), 0.5);
+    float lit = useShadowMap ? shadowFactor(FragPosLightSpace) : 1.0;
+    vec3 result = (ambient + lit * (diffuse + specular)) * colour;
+    vec4 albedo = layer > 0 ? samplePacked(TexCoord, layer - 1)
+        : useVirtualTexture ? sampleVirtual(TexCoord) : texture(ourTexture, TexCoord);
+    FragColor = mix(albedo, vec4(result, 1.0), 0.5);
 } 
\ No newline at end of file
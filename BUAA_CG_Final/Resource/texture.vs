@@ -6,15 +6,38 @@ layout (location = 2) in vec3 aNormal;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec4 FragPosLightSpace;
 
+#ifdef INSTANCED
+// the object's transform block and colour come with the instance, see instancing.h
+layout (location = 3) in mat4 model;
+layout (location = 7) in mat3 normalMatrix;
+layout (location = 10) in vec3 instanceColour;
+layout (location = 11) in int instanceLayer;
+
+flat out vec3 colour;
+flat out int layer;
+
+uniform mat4 viewProjection;
+#else
+// the object's transform block, computed once per object on the CPU
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;
+uniform mat4 mvp;
+#endif
+uniform mat4 lightSpace;
 
 void main()
 {
 	FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+	Normal = normalMatrix * aNormal;
+#ifdef INSTANCED
+	gl_Position = viewProjection * vec4(FragPos, 1.0);
+	colour = instanceColour;
+	layer = instanceLayer;
+#else
+	gl_Position = mvp * vec4(aPos, 1.0);
+#endif
 	TexCoord = textPos;
+	FragPosLightSpace = lightSpace * vec4(FragPos, 1.0);
 }
\ No newline at end of file
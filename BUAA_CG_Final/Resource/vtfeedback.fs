@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform int vtPages;
+uniform int vtMaxLevel;
+uniform int vtPage;
+uniform float vtLodBias;
+
+// the page texture.fs samples for this fragment, as x, y and level in bytes
+void main()
+{
+    vec2 dx = dFdx(TexCoord) * float(vtPages * vtPage), dy = dFdy(TexCoord) * float(vtPages * vtPage);
+    int level = int(clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias, 0.0, float(vtMaxLevel)));
+    ivec2 page = ivec2(fract(TexCoord) * float(vtPages >> level));
+    FragColor = vec4(vec3(page, level) / 255.0, 1.0);
+}
@@ -0,0 +1,369 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// the block compressed formats are extensions to GL 3.3 core, so the generated loader has no enums for them
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+
+// Encoders from RGBA8 texels to 4x4 blocks, named by the GL internal format they produce:
+// BC1 (8 bytes, opaque), BC3 (16 bytes, BC1 colour plus interpolated alpha), BC7 (16 bytes, mode 6 only,
+// one RGBA line with 16 steps) and ETC2 RGB8 (8 bytes, the ETC1 compatible individual and differential
+// blocks). Endpoints are fitted along the principal axis of the block, which is quick and holds up for photos;
+// this is meant for a first-run cache, not for offline quality.
+class BlockCompressor {
+public:
+	// bytes per 4x4 block, 0 for a format this class does not produce
+	static int blockBytes(GLenum format) {
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGB8_ETC2:
+			return 8;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	static size_t levelBytes(GLenum format, int width, int height) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	// compresses a tightly packed RGBA8 image, blocks past the right or bottom edge repeat the last column or row
+	static std::vector<unsigned char> compress(GLenum format, const unsigned char* rgba, int width, int height) {
+		int size = blockBytes(format);
+		std::vector<unsigned char> out(levelBytes(format, width, height));
+		unsigned char block[64];
+		unsigned char* dst = out.data();
+		for (int by = 0; by < height; by += 4) {
+			for (int bx = 0; bx < width; bx += 4) {
+				for (int y = 0; y < 4; ++y) {
+					for (int x = 0; x < 4; ++x) {
+						const unsigned char* src = rgba + ((size_t)std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)) * 4;
+						std::copy(src, src + 4, block + (y * 4 + x) * 4);
+					}
+				}
+				switch (format) {
+				case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+					encodeBC1(block, dst);
+					break;
+				case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+					encodeBC3(block, dst);
+					break;
+				case GL_COMPRESSED_RGBA_BPTC_UNORM:
+					encodeBC7(block, dst);
+					break;
+				case GL_COMPRESSED_RGB8_ETC2:
+					encodeETC2(block, dst);
+					break;
+				}
+				dst += size;
+			}
+		}
+		return out;
+	}
+
+	// 16 RGBA texels, top row first
+	static void encodeBC1(const unsigned char* block, unsigned char* out) {
+		float lo[4], hi[4];
+		fitLine(block, 3, lo, hi);
+		unsigned short c0 = pack565(hi), c1 = pack565(lo);
+		// c0 > c1 selects the four colour mode, c0 == c1 the three colour one where index 0 is still c0
+		if (c0 < c1)
+			std::swap(c0, c1);
+		int palette[4][3];
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		unsigned int indices = 0;
+		if (c0 != c1)
+			for (int i = 0; i < 16; ++i)
+				indices |= (unsigned int)nearest(block + i * 4, &palette[0][0], 4, 3) << (2 * i);
+		putLittleEndian(out, c0, 2);
+		putLittleEndian(out + 2, c1, 2);
+		putLittleEndian(out + 4, indices, 4);
+	}
+
+	static void encodeBC3(const unsigned char* block, unsigned char* out) {
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; ++i) {
+			a0 = std::max(a0, (int)block[i * 4 + 3]);
+			a1 = std::min(a1, (int)block[i * 4 + 3]);
+		}
+		// a0 > a1 selects the eight step mode
+		int palette[8] = { a0, a1 };
+		for (int k = 1; k < 7; ++k)
+			palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+		unsigned long long indices = 0;
+		if (a0 != a1) {
+			for (int i = 0; i < 16; ++i) {
+				int best = 0;
+				for (int k = 1; k < 8; ++k)
+					if (std::abs(palette[k] - block[i * 4 + 3]) < std::abs(palette[best] - block[i * 4 + 3]))
+						best = k;
+				indices |= (unsigned long long)best << (3 * i);
+			}
+		}
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+		for (int b = 0; b < 6; ++b)
+			out[2 + b] = (unsigned char)(indices >> (8 * b));
+		// the colour block of BC3 always uses the four colour mode
+		encodeBC1(block, out + 8);
+	}
+
+	static void encodeBC7(const unsigned char* block, unsigned char* out) {
+		static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		float line[2][4];
+		fitLine(block, 4, line[0], line[1]);
+		// 7 bits per channel plus a shared lowest bit per endpoint
+		int q[2][4], p[2];
+		for (int e = 0; e < 2; ++e) {
+			float bestError = 1e30f;
+			for (int bit = 0; bit < 2; ++bit) {
+				int candidate[4];
+				float error = 0.0f;
+				for (int c = 0; c < 4; ++c) {
+					candidate[c] = std::max(0, std::min(127, (int)std::floor((line[e][c] - bit) / 2.0f + 0.5f)));
+					float d = (float)(candidate[c] * 2 + bit) - line[e][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					p[e] = bit;
+					std::copy(candidate, candidate + 4, q[e]);
+				}
+			}
+		}
+		int palette[16][4];
+		for (int k = 0; k < 16; ++k)
+			for (int c = 0; c < 4; ++c)
+				palette[k][c] = ((64 - WEIGHTS[k]) * (q[0][c] * 2 + p[0]) + WEIGHTS[k] * (q[1][c] * 2 + p[1]) + 32) >> 6;
+		int indices[16];
+		for (int i = 0; i < 16; ++i)
+			indices[i] = nearest(block + i * 4, &palette[0][0], 16, 4);
+		// the first index is stored without its top bit, so it has to be below 8
+		if (indices[0] >= 8) {
+			for (int c = 0; c < 4; ++c)
+				std::swap(q[0][c], q[1][c]);
+			std::swap(p[0], p[1]);
+			for (int i = 0; i < 16; ++i)
+				indices[i] = 15 - indices[i];
+		}
+
+		BitWriter bits(out, 16);
+		bits.put(1 << 6, 7); // mode 6
+		for (int c = 0; c < 4; ++c) {
+			bits.put(q[0][c], 7);
+			bits.put(q[1][c], 7);
+		}
+		bits.put(p[0], 1);
+		bits.put(p[1], 1);
+		for (int i = 0; i < 16; ++i)
+			bits.put(indices[i], i == 0 ? 3 : 4);
+	}
+
+	// only the ETC1 modes, which every ETC2 decoder reads the same way
+	static void encodeETC2(const unsigned char* block, unsigned char* out) {
+		static const int MODIFIERS[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+		long long bestError = -1;
+		for (int flip = 0; flip < 2; ++flip) {
+			// flip 0 splits the block into left and right 2x4 halves, flip 1 into top and bottom 4x2 halves
+			int half[16];
+			float average[2][3] = { { 0.0f } };
+			for (int i = 0; i < 16; ++i) {
+				half[i] = flip ? (i / 4 >= 2) : (i % 4 >= 2);
+				for (int c = 0; c < 3; ++c)
+					average[half[i]][c] += block[i * 4 + c] / 8.0f;
+			}
+			int base5[2][3], base4[2][3];
+			bool differential = true;
+			for (int h = 0; h < 2; ++h) {
+				for (int c = 0; c < 3; ++c) {
+					base5[h][c] = std::min(31, (int)(average[h][c] * 31.0f / 255.0f + 0.5f));
+					base4[h][c] = std::min(15, (int)(average[h][c] * 15.0f / 255.0f + 0.5f));
+				}
+			}
+			for (int c = 0; c < 3; ++c)
+				differential = differential && base5[1][c] - base5[0][c] >= -4 && base5[1][c] - base5[0][c] <= 3;
+
+			for (int diff = 0; diff < 2; ++diff) {
+				if (diff && !differential)
+					continue;
+				int colour[2][3];
+				for (int h = 0; h < 2; ++h)
+					for (int c = 0; c < 3; ++c)
+						colour[h][c] = diff ? (base5[h][c] << 3) | (base5[h][c] >> 2) : (base4[h][c] << 4) | base4[h][c];
+				long long error = 0;
+				int table[2] = {}, selectors[16] = {};
+				for (int h = 0; h < 2; ++h) {
+					long long halfError = -1;
+					for (int t = 0; t < 8; ++t) {
+						int offsets[4] = { MODIFIERS[t][0], MODIFIERS[t][1], -MODIFIERS[t][0], -MODIFIERS[t][1] };
+						long long tableError = 0;
+						int tableSelectors[16];
+						for (int i = 0; i < 16; ++i) {
+							if (half[i] != h)
+								continue;
+							int best = 0, bestDistance = -1;
+							for (int m = 0; m < 4; ++m) {
+								int distance = 0;
+								for (int c = 0; c < 3; ++c) {
+									int d = std::max(0, std::min(255, colour[h][c] + offsets[m])) - block[i * 4 + c];
+									distance += d * d;
+								}
+								if (bestDistance < 0 || distance < bestDistance) {
+									bestDistance = distance;
+									best = m;
+								}
+							}
+							tableSelectors[i] = best;
+							tableError += bestDistance;
+						}
+						if (halfError < 0 || tableError < halfError) {
+							halfError = tableError;
+							table[h] = t;
+							for (int i = 0; i < 16; ++i)
+								if (half[i] == h)
+									selectors[i] = tableSelectors[i];
+						}
+					}
+					error += halfError;
+				}
+				if (bestError >= 0 && error >= bestError)
+					continue;
+				bestError = error;
+
+				for (int c = 0; c < 3; ++c)
+					out[c] = (unsigned char)(diff ? (base5[0][c] << 3) | ((base5[1][c] - base5[0][c]) & 7) : (base4[0][c] << 4) | base4[1][c]);
+				out[3] = (unsigned char)((table[0] << 5) | (table[1] << 2) | (diff << 1) | flip);
+				// texel x, y is bit x * 4 + y of the high and the low selector bits
+				unsigned int high = 0, low = 0;
+				for (int i = 0; i < 16; ++i) {
+					int bit = (i % 4) * 4 + i / 4;
+					high |= (unsigned int)(selectors[i] >> 1) << bit;
+					low |= (unsigned int)(selectors[i] & 1) << bit;
+				}
+				out[4] = (unsigned char)(high >> 8);
+				out[5] = (unsigned char)high;
+				out[6] = (unsigned char)(low >> 8);
+				out[7] = (unsigned char)low;
+			}
+		}
+	}
+
+private:
+	// LSB first into a zeroed block
+	struct BitWriter {
+		unsigned char* out;
+		int position;
+
+		BitWriter(unsigned char* out, int bytes) : out(out), position(0) {
+			std::fill(out, out + bytes, 0);
+		}
+
+		void put(int value, int count) {
+			for (int i = 0; i < count; ++i, ++position)
+				out[position >> 3] |= (unsigned char)(((value >> i) & 1) << (position & 7));
+		}
+	};
+
+	// the extremes of the block along its principal axis, in the first `channels` channels
+	static void fitLine(const unsigned char* block, int channels, float* lo, float* hi) {
+		float mean[4] = { 0.0f }, covariance[4][4] = { { 0.0f } };
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < channels; ++c)
+				mean[c] += block[i * 4 + c] / 16.0f;
+		for (int i = 0; i < 16; ++i)
+			for (int a = 0; a < channels; ++a)
+				for (int b = 0; b < channels; ++b)
+					covariance[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+		// power iteration from the diagonal
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; ++iteration) {
+			float next[4] = { 0.0f }, length = 0.0f;
+			for (int a = 0; a < channels; ++a) {
+				for (int b = 0; b < channels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::abs(next[a]));
+			}
+			if (length == 0.0f)
+				break;
+			for (int a = 0; a < channels; ++a)
+				axis[a] = next[a] / length;
+		}
+		float norm = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			norm += axis[c] * axis[c];
+		norm = std::sqrt(norm);
+		float tMin = 0.0f, tMax = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (block[i * 4 + c] - mean[c]) * axis[c] / norm;
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		for (int c = 0; c < channels; ++c) {
+			lo[c] = std::max(0.0f, std::min(255.0f, mean[c] + axis[c] / norm * tMin));
+			hi[c] = std::max(0.0f, std::min(255.0f, mean[c] + axis[c] / norm * tMax));
+		}
+	}
+
+	// index of the palette entry closest to the texel in the first `channels` channels
+	static int nearest(const unsigned char* texel, const int* palette, int entries, int channels) {
+		int best = 0, bestDistance = -1;
+		for (int k = 0; k < entries; ++k) {
+			int distance = 0;
+			for (int c = 0; c < channels; ++c) {
+				int d = palette[k * channels + c] - texel[c];
+				distance += d * d;
+			}
+			if (bestDistance < 0 || distance < bestDistance) {
+				bestDistance = distance;
+				best = k;
+			}
+		}
+		return best;
+	}
+
+	static unsigned short pack565(const float* rgb) {
+		int r = (int)(rgb[0] * 31.0f / 255.0f + 0.5f);
+		int g = (int)(rgb[1] * 63.0f / 255.0f + 0.5f);
+		int b = (int)(rgb[2] * 31.0f / 255.0f + 0.5f);
+		return (unsigned short)((r << 11) | (g << 5) | b);
+	}
+
+	static void unpack565(unsigned short c, int* rgb) {
+		int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	static void putLittleEndian(unsigned char* out, unsigned int v, int bytes) {
+		for (int i = 0; i < bytes; ++i)
+			out[i] = (unsigned char)(v >> (8 * i));
+	}
+};
+#endif
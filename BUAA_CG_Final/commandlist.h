@@ -0,0 +1,366 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "instancing.h"
+#include "gpuculling.h"
+
+#include <map>
+#include <vector>
+#include <cstring>
+#include <utility>
+
+// A linear buffer of backend-agnostic draw commands. Recording touches no GL state, so lists can be
+// filled on worker threads (one list per thread) and replayed in order on the GL thread.
+// Uniform names are stored by address and must outlive the list, i.e. be string literals, and so are the
+// instances of instanced draws.
+class CommandList {
+public:
+	enum Op {
+		USE_PROGRAM,
+		SET_INT,
+		SET_FLOAT,
+		SET_VEC3,
+		SET_VEC3_ARRAY,
+		SET_MAT3,
+		SET_MAT4,
+		BIND_TEXTURE,
+		BIND_VERTEX_ARRAY,
+		POLYGON_MODE,
+		LINE_WIDTH,
+		DRAW_ARRAYS,
+		DRAW_ELEMENTS,
+		DRAW_ARRAYS_INSTANCED,
+		DRAW_ELEMENTS_INSTANCED,
+		DRAW_INSTANCED_CULLED,
+	};
+
+	// keeps the allocation, so a list reused every frame stops allocating after the first one
+	void reset() {
+		data.clear();
+		culled.clear();
+		commands = 0;
+	}
+
+	size_t size() const {
+		return commands;
+	}
+
+	size_t bytes() const {
+		return data.size();
+	}
+
+	void useProgram(unsigned int program) {
+		push(USE_PROGRAM);
+		push(program);
+	}
+
+	void setInt(const char* name, int value) {
+		push(SET_INT);
+		push(name);
+		push(value);
+	}
+
+	void setFloat(const char* name, float value) {
+		push(SET_FLOAT);
+		push(name);
+		push(value);
+	}
+
+	void setVec3(const char* name, const glm::vec3& value) {
+		push(SET_VEC3);
+		push(name);
+		push(value);
+	}
+
+	void setVec3Array(const char* name, const glm::vec3* values, int count) {
+		push(SET_VEC3_ARRAY);
+		push(name);
+		push(count);
+		for (int i = 0; i < count; ++i)
+			push(values[i]);
+	}
+
+	void setMat3(const char* name, const glm::mat3& value) {
+		push(SET_MAT3);
+		push(name);
+		push(value);
+	}
+
+	void setMat4(const char* name, const glm::mat4& value) {
+		push(SET_MAT4);
+		push(name);
+		push(value);
+	}
+
+	void bindTexture(int unit, GLenum target, unsigned int texture) {
+		push(BIND_TEXTURE);
+		push(unit);
+		push(target);
+		push(texture);
+	}
+
+	void bindVertexArray(unsigned int vao) {
+		push(BIND_VERTEX_ARRAY);
+		push(vao);
+	}
+
+	void polygonMode(GLenum mode) {
+		push(POLYGON_MODE);
+		push(mode);
+	}
+
+	void lineWidth(float width) {
+		push(LINE_WIDTH);
+		push(width);
+	}
+
+	void drawArrays(GLenum mode, int first, int count) {
+		push(DRAW_ARRAYS);
+		push(mode);
+		push(first);
+		push(count);
+	}
+
+	void drawElements(GLenum mode, int count) {
+		push(DRAW_ELEMENTS);
+		push(mode);
+		push(count);
+	}
+
+	void drawArraysInstanced(GLenum mode, int first, int count, const InstanceData* instances, int instanceCount) {
+		push(DRAW_ARRAYS_INSTANCED);
+		push(mode);
+		push(first);
+		push(count);
+		push(instances);
+		push(instanceCount);
+	}
+
+	void drawElementsInstanced(GLenum mode, int count, const InstanceData* instances, int instanceCount) {
+		push(DRAW_ELEMENTS_INSTANCED);
+		push(mode);
+		push(count);
+		push(instances);
+		push(instanceCount);
+	}
+
+	// an instanced draw whose instances are frustum culled on the GPU first, by the backend's culler;
+	// `radius` is the mesh's bounding sphere in model space
+	void drawInstancedCulled(GLenum mode, int count, bool indexed, const InstanceData* instances, int instanceCount, float radius,
+		const glm::vec4 planes[6]) {
+		push(DRAW_INSTANCED_CULLED);
+		culled.push_back(data.size());
+		push(mode);
+		push(count);
+		push((int)indexed);
+		push(instances);
+		push(instanceCount);
+		push(radius);
+		for (int i = 0; i < 6; ++i)
+			push(planes[i]);
+	}
+
+private:
+	friend class GLCommandBackend;
+	std::vector<unsigned char> data;
+	// where the operands of every DRAW_INSTANCED_CULLED start, so the backend can cull them all before replaying
+	std::vector<size_t> culled;
+	size_t commands = 0;
+
+	void push(Op op) {
+		push((int)op);
+		++commands;
+	}
+
+	template<typename T>
+	void push(const T& value) {
+		size_t offset = data.size();
+		data.resize(offset + sizeof(T));
+		memcpy(&data[offset], &value, sizeof(T));
+	}
+};
+
+// Replays command lists with OpenGL, must only be used on the thread owning the context.
+class GLCommandBackend {
+public:
+	// culls the instances of DRAW_INSTANCED_CULLED, without one they are all drawn
+	GpuInstanceCuller* culler = nullptr;
+
+	void replay(const CommandList& list) {
+		if (culler && !list.culled.empty())
+			cullAll(list);
+		const unsigned char* p = list.data.data();
+		const unsigned char* end = p + list.data.size();
+		unsigned int program = 0, vao = 0;
+		int run = 0;
+		while (p < end) {
+			int op = read<int>(p);
+			switch (op) {
+			case CommandList::USE_PROGRAM:
+				program = read<unsigned int>(p);
+				glUseProgram(program);
+				break;
+			case CommandList::SET_INT: {
+				const char* name = read<const char*>(p);
+				glUniform1i(location(program, name), read<int>(p));
+				break;
+			}
+			case CommandList::SET_FLOAT: {
+				const char* name = read<const char*>(p);
+				glUniform1f(location(program, name), read<float>(p));
+				break;
+			}
+			case CommandList::SET_VEC3: {
+				const char* name = read<const char*>(p);
+				glm::vec3 value = read<glm::vec3>(p);
+				glUniform3fv(location(program, name), 1, &value[0]);
+				break;
+			}
+			case CommandList::SET_VEC3_ARRAY: {
+				const char* name = read<const char*>(p);
+				int count = read<int>(p);
+				glUniform3fv(location(program, name), count, (const float*)p);
+				p += count * sizeof(glm::vec3);
+				break;
+			}
+			case CommandList::SET_MAT3: {
+				const char* name = read<const char*>(p);
+				glm::mat3 value = read<glm::mat3>(p);
+				glUniformMatrix3fv(location(program, name), 1, GL_FALSE, &value[0][0]);
+				break;
+			}
+			case CommandList::SET_MAT4: {
+				const char* name = read<const char*>(p);
+				glm::mat4 value = read<glm::mat4>(p);
+				glUniformMatrix4fv(location(program, name), 1, GL_FALSE, &value[0][0]);
+				break;
+			}
+			case CommandList::BIND_TEXTURE: {
+				int unit = read<int>(p);
+				GLenum target = read<GLenum>(p);
+				glActiveTexture(GL_TEXTURE0 + unit);
+				glBindTexture(target, read<unsigned int>(p));
+				break;
+			}
+			case CommandList::BIND_VERTEX_ARRAY:
+				vao = read<unsigned int>(p);
+				glBindVertexArray(vao);
+				break;
+			case CommandList::POLYGON_MODE:
+				glPolygonMode(GL_FRONT_AND_BACK, read<GLenum>(p));
+				break;
+			case CommandList::LINE_WIDTH:
+				glLineWidth(read<float>(p));
+				break;
+			case CommandList::DRAW_ARRAYS: {
+				GLenum mode = read<GLenum>(p);
+				int first = read<int>(p);
+				glDrawArrays(mode, first, read<int>(p));
+				break;
+			}
+			case CommandList::DRAW_ELEMENTS: {
+				GLenum mode = read<GLenum>(p);
+				glDrawElements(mode, read<int>(p), GL_UNSIGNED_INT, 0);
+				break;
+			}
+			case CommandList::DRAW_ARRAYS_INSTANCED: {
+				GLenum mode = read<GLenum>(p);
+				int first = read<int>(p);
+				int count = read<int>(p);
+				const InstanceData* instances = read<const InstanceData*>(p);
+				int instanceCount = read<int>(p);
+				instanceBuffer.bind(instances, instanceCount);
+				glDrawArraysInstanced(mode, first, count, instanceCount);
+				instanceBuffer.unbind();
+				break;
+			}
+			case CommandList::DRAW_ELEMENTS_INSTANCED: {
+				GLenum mode = read<GLenum>(p);
+				int count = read<int>(p);
+				const InstanceData* instances = read<const InstanceData*>(p);
+				int instanceCount = read<int>(p);
+				instanceBuffer.bind(instances, instanceCount);
+				glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, 0, instanceCount);
+				instanceBuffer.unbind();
+				break;
+			}
+			case CommandList::DRAW_INSTANCED_CULLED: {
+				GLenum mode = read<GLenum>(p);
+				int count = read<int>(p);
+				bool indexed = read<int>(p) != 0;
+				const InstanceData* instances = read<const InstanceData*>(p);
+				int instanceCount = read<int>(p);
+				// the radius and planes, only cullAll() needs them
+				p += sizeof(float) + 6 * sizeof(glm::vec4);
+				if (culler) {
+					// culled by cullAll() before the first command
+					instanceCount = culler->count(run);
+					InstanceBuffer::attach(culler->buffer(), culler->offset(run));
+					++run;
+				} else {
+					instanceBuffer.bind(instances, instanceCount);
+				}
+				if (instanceCount > 0) {
+					if (indexed)
+						glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, 0, instanceCount);
+					else
+						glDrawArraysInstanced(mode, 0, count, instanceCount);
+				}
+				InstanceBuffer::unbind();
+				break;
+			}
+			}
+		}
+	}
+
+private:
+	InstanceBuffer instanceBuffer;
+
+	// issues the culling passes of all culled draws in the list and waits for their counts once, instead of
+	// once per draw; leaves the program and VAO for the list's first commands to set
+	void cullAll(const CommandList& list) {
+		// past the mode, vertex count and indexed flag to the instances and their count
+		const size_t INSTANCES = sizeof(GLenum) + 2 * sizeof(int);
+		int total = 0;
+		for (size_t offset : list.culled) {
+			const unsigned char* p = list.data.data() + offset + INSTANCES + sizeof(const InstanceData*);
+			total += read<int>(p);
+		}
+		culler->begin(total);
+		for (size_t offset : list.culled) {
+			const unsigned char* p = list.data.data() + offset + INSTANCES;
+			const InstanceData* instances = read<const InstanceData*>(p);
+			int instanceCount = read<int>(p);
+			float radius = read<float>(p);
+			glm::vec4 planes[6];
+			for (int i = 0; i < 6; ++i)
+				planes[i] = read<glm::vec4>(p);
+			culler->cull(instances, instanceCount, radius, planes);
+		}
+		culler->resolve();
+	}
+	// uniform locations are looked up once per program and name
+	std::map<std::pair<unsigned int, const char*>, int> locations;
+
+	int location(unsigned int program, const char* name) {
+		std::pair<unsigned int, const char*> key(program, name);
+		std::map<std::pair<unsigned int, const char*>, int>::iterator it = locations.find(key);
+		if (it != locations.end())
+			return it->second;
+		int loc = glGetUniformLocation(program, name);
+		locations[key] = loc;
+		return loc;
+	}
+
+	template<typename T>
+	static T read(const unsigned char*& p) {
+		T value;
+		memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return value;
+	}
+};
+#endif
@@ -0,0 +1,429 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+// A small per-frame render graph. Passes declare what they read and write, compile() orders them,
+// culls passes whose results nobody consumes, aliases transient textures with disjoint lifetimes
+// and works out the framebuffer binds and clears; execute() then runs the surviving passes.
+// Physical transient textures and framebuffer objects are kept across frames.
+class FrameGraph {
+public:
+	struct TextureDesc {
+		GLenum internalFormat;
+		GLenum format;
+		GLenum type;
+		int width;
+		int height;
+	};
+
+	class PassBuilder {
+	public:
+		PassBuilder(FrameGraph& graph, int pass) : graph(graph), pass(pass) {}
+		// sampled or otherwise consumed by the pass
+		void read(int resource) {
+			add(graph.passes[pass].reads, resource);
+		}
+		// written outside of the graph's framebuffer, e.g. by a pass managing its own FBO
+		void write(int resource) {
+			add(graph.passes[pass].writes, resource);
+		}
+		// face selects a cubemap face, -1 for 2D textures and the backbuffer
+		void writeColor(int resource, int face = -1) {
+			add(graph.passes[pass].writes, resource);
+			graph.passes[pass].color = resource;
+			graph.passes[pass].face = face;
+		}
+		void writeDepth(int resource) {
+			add(graph.passes[pass].writes, resource);
+			graph.passes[pass].depth = resource;
+		}
+		void clearColor(const glm::vec4& colour) {
+			graph.passes[pass].clearMask |= GL_COLOR_BUFFER_BIT;
+			graph.passes[pass].clearValue = colour;
+		}
+		void clearDepth() {
+			graph.passes[pass].clearMask |= GL_DEPTH_BUFFER_BIT;
+		}
+		// never culled, e.g. readbacks
+		void sideEffect() {
+			graph.passes[pass].sideEffect = true;
+		}
+
+	private:
+		FrameGraph& graph;
+		int pass;
+
+		static void add(std::vector<int>& list, int resource) {
+			if (std::find(list.begin(), list.end(), resource) == list.end())
+				list.push_back(resource);
+		}
+	};
+
+	// called around every executed pass, e.g. for GPU timers
+	std::function<void(const std::string&)> onPassBegin;
+	std::function<void(const std::string&)> onPassEnd;
+
+	// statistics of the last execute()
+	int framebufferBinds;
+	int clears;
+
+	FrameGraph() : framebufferBinds(0), clears(0), compiled(false) {}
+
+	~FrameGraph() {
+		for (size_t i = 0; i < transientPool.size(); ++i)
+			glDeleteTextures(1, &transientPool[i].texture);
+		for (std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebufferCache.begin(); it != framebufferCache.end(); ++it)
+			glDeleteFramebuffers(1, &it->second);
+	}
+
+	// starts declaring a new frame, persistent GL objects are kept
+	void reset() {
+		resources.clear();
+		passes.clear();
+		order.clear();
+		compiled = false;
+	}
+
+	// framebuffer is the object presented at the end of the frame, 0 for the window
+	int importBackbuffer(const std::string& name, int width, int height, unsigned int framebuffer = 0) {
+		Resource r(name);
+		r.imported = true;
+		r.backbuffer = true;
+		r.framebuffer = framebuffer;
+		r.desc.width = width;
+		r.desc.height = height;
+		resources.push_back(r);
+		return (int)resources.size() - 1;
+	}
+
+	int importTexture(const std::string& name, unsigned int texture, GLenum target, int width, int height) {
+		Resource r(name);
+		r.imported = true;
+		r.texture = texture;
+		r.target = target;
+		r.desc.width = width;
+		r.desc.height = height;
+		resources.push_back(r);
+		return (int)resources.size() - 1;
+	}
+
+	int createTexture(const std::string& name, const TextureDesc& desc) {
+		Resource r(name);
+		r.desc = desc;
+		resources.push_back(r);
+		return (int)resources.size() - 1;
+	}
+
+	int addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, const std::function<void()>& execute) {
+		passes.push_back(Pass(name, execute));
+		int index = (int)passes.size() - 1;
+		PassBuilder builder(*this, index);
+		setup(builder);
+		return index;
+	}
+
+	unsigned int texture(int resource) const {
+		return resources[resource].texture;
+	}
+
+	void compile() {
+		sortPasses();
+		cullPasses();
+		allocateTransients();
+		resolveFramebuffers();
+		compiled = true;
+	}
+
+	void execute() {
+		if (!compiled)
+			compile();
+		framebufferBinds = 0;
+		clears = 0;
+		int bound = -1;
+		for (size_t i = 0; i < order.size(); ++i) {
+			Pass& p = passes[order[i]];
+			if (p.culled)
+				continue;
+			if (onPassBegin)
+				onPassBegin(p.name);
+			auto start = std::chrono::steady_clock::now();
+			if (p.color >= 0 || p.depth >= 0) {
+				if ((int)p.fbo != bound) {
+					const Resource& target = resources[p.color >= 0 ? p.color : p.depth];
+					glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+					glViewport(0, 0, target.desc.width, target.desc.height);
+					bound = p.fbo;
+					++framebufferBinds;
+				}
+				if (p.clearMask) {
+					glClearColor(p.clearValue.r, p.clearValue.g, p.clearValue.b, p.clearValue.a);
+					glClear(p.clearMask);
+					++clears;
+				}
+			}
+			p.execute();
+			p.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (onPassEnd)
+				onPassEnd(p.name);
+			// passes with their own framebuffer leave the binding unknown
+			if (p.color < 0 && p.depth < 0 && !p.writes.empty())
+				bound = -1;
+		}
+	}
+
+	void dump(std::ostream& out) const {
+		out << "frame graph: " << passes.size() << " passes, " << resources.size() << " resources, "
+			<< transientPool.size() << " physical transients" << std::endl;
+		for (size_t i = 0; i < order.size(); ++i) {
+			const Pass& p = passes[order[i]];
+			out << "  " << (p.culled ? "[culled] " : "") << p.name;
+			if (!p.culled && (p.color >= 0 || p.depth >= 0))
+				out << " fbo=" << p.fbo;
+			if (p.clearMask & GL_COLOR_BUFFER_BIT)
+				out << " clear-color";
+			if (p.clearMask & GL_DEPTH_BUFFER_BIT)
+				out << " clear-depth";
+			if (p.sideEffect)
+				out << " side-effect";
+			out << std::endl;
+			for (size_t r = 0; r < p.reads.size(); ++r)
+				out << "    read  " << resources[p.reads[r]].name << std::endl;
+			for (size_t w = 0; w < p.writes.size(); ++w)
+				out << "    write " << resources[p.writes[w]].name << std::endl;
+			if (!p.culled)
+				out << "    cpu " << p.cpuMs << " ms" << std::endl;
+		}
+		for (size_t i = 0; i < resources.size(); ++i) {
+			const Resource& r = resources[i];
+			out << "  resource " << r.name << (r.backbuffer ? " backbuffer" : r.imported ? " imported" : " transient")
+				<< " " << r.desc.width << "x" << r.desc.height;
+			if (!r.imported)
+				out << " physical=" << r.physical << " lifetime=[" << r.firstUse << ", " << r.lastUse << "]";
+			out << std::endl;
+		}
+	}
+
+private:
+	struct Resource {
+		std::string name;
+		bool imported;
+		bool backbuffer;
+		unsigned int texture;
+		unsigned int framebuffer;
+		GLenum target;
+		TextureDesc desc;
+		int physical;
+		int firstUse;
+		int lastUse;
+		Resource(const std::string& name) : name(name), imported(false), backbuffer(false), texture(0), framebuffer(0), target(GL_TEXTURE_2D),
+			physical(-1), firstUse(-1), lastUse(-1) {
+			desc.internalFormat = GL_RGBA8;
+			desc.format = GL_RGBA;
+			desc.type = GL_UNSIGNED_BYTE;
+			desc.width = desc.height = 0;
+		}
+	};
+
+	struct Pass {
+		std::string name;
+		std::function<void()> execute;
+		std::vector<int> reads;
+		std::vector<int> writes;
+		int color;
+		int face;
+		int depth;
+		GLbitfield clearMask;
+		glm::vec4 clearValue;
+		bool sideEffect;
+		bool culled;
+		unsigned int fbo;
+		double cpuMs;
+		Pass(const std::string& name, const std::function<void()>& execute) : name(name), execute(execute), color(-1), face(-1), depth(-1),
+			clearMask(0), clearValue(0.0f), sideEffect(false), culled(false), fbo(0), cpuMs(0.0) {}
+	};
+
+	struct Physical {
+		TextureDesc desc;
+		unsigned int texture;
+		int busyUntil;
+	};
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order;
+	bool compiled;
+	std::vector<Physical> transientPool;
+	std::map<std::vector<unsigned int>, unsigned int> framebufferCache;
+
+	// topological order from read-after-write, write-after-read and write-after-write hazards,
+	// ties broken by declaration order so independent passes keep the order they were added in
+	void sortPasses() {
+		size_t n = passes.size();
+		std::vector<std::vector<int> > next(n);
+		std::vector<int> incoming(n, 0);
+		std::vector<int> lastWriter(resources.size(), -1);
+		std::vector<std::vector<int> > readers(resources.size());
+		for (size_t p = 0; p < n; ++p) {
+			std::vector<int> deps;
+			for (size_t i = 0; i < passes[p].reads.size(); ++i) {
+				int r = passes[p].reads[i];
+				if (lastWriter[r] >= 0)
+					deps.push_back(lastWriter[r]);
+			}
+			for (size_t i = 0; i < passes[p].writes.size(); ++i) {
+				int r = passes[p].writes[i];
+				if (lastWriter[r] >= 0)
+					deps.push_back(lastWriter[r]);
+				deps.insert(deps.end(), readers[r].begin(), readers[r].end());
+			}
+			for (size_t i = 0; i < passes[p].reads.size(); ++i)
+				readers[passes[p].reads[i]].push_back((int)p);
+			for (size_t i = 0; i < passes[p].writes.size(); ++i) {
+				lastWriter[passes[p].writes[i]] = (int)p;
+				readers[passes[p].writes[i]].clear();
+			}
+			for (size_t i = 0; i < deps.size(); ++i) {
+				if (deps[i] != (int)p) {
+					next[deps[i]].push_back((int)p);
+					++incoming[p];
+				}
+			}
+		}
+		order.clear();
+		std::vector<bool> done(n, false);
+		while (order.size() < n) {
+			size_t p = 0;
+			while (p < n && (done[p] || incoming[p] > 0))
+				++p;
+			if (p == n) {
+				std::cout << "ERROR::FRAMEGRAPH::CYCLE" << std::endl;
+				return;
+			}
+			done[p] = true;
+			order.push_back((int)p);
+			for (size_t i = 0; i < next[p].size(); ++i)
+				--incoming[next[p][i]];
+		}
+	}
+
+	// walks backwards from the backbuffer and side-effect passes, keeping only producers of needed resources
+	void cullPasses() {
+		std::vector<bool> needed(resources.size(), false);
+		for (int i = (int)order.size() - 1; i >= 0; --i) {
+			Pass& p = passes[order[i]];
+			bool keep = p.sideEffect;
+			for (size_t w = 0; w < p.writes.size(); ++w)
+				keep = keep || resources[p.writes[w]].backbuffer || needed[p.writes[w]];
+			p.culled = !keep;
+			if (keep) {
+				for (size_t r = 0; r < p.reads.size(); ++r)
+					needed[p.reads[r]] = true;
+			}
+		}
+	}
+
+	// transient textures with the same description and disjoint lifetimes share one physical texture
+	void allocateTransients() {
+		for (size_t i = 0; i < order.size(); ++i) {
+			const Pass& p = passes[order[i]];
+			if (p.culled)
+				continue;
+			std::vector<int> used(p.reads);
+			used.insert(used.end(), p.writes.begin(), p.writes.end());
+			for (size_t u = 0; u < used.size(); ++u) {
+				Resource& r = resources[used[u]];
+				if (r.firstUse < 0)
+					r.firstUse = (int)i;
+				r.lastUse = (int)i;
+			}
+		}
+		for (size_t i = 0; i < transientPool.size(); ++i)
+			transientPool[i].busyUntil = -1;
+		std::vector<int> transients;
+		for (size_t i = 0; i < resources.size(); ++i) {
+			if (!resources[i].imported && resources[i].firstUse >= 0)
+				transients.push_back((int)i);
+		}
+		for (size_t k = 0; k < transients.size(); ++k) {
+			// allocate in order of first use
+			for (size_t j = k + 1; j < transients.size(); ++j) {
+				if (resources[transients[j]].firstUse < resources[transients[k]].firstUse)
+					std::swap(transients[j], transients[k]);
+			}
+			Resource& r = resources[transients[k]];
+			int found = -1;
+			for (size_t i = 0; i < transientPool.size() && found < 0; ++i) {
+				const TextureDesc& d = transientPool[i].desc;
+				if (transientPool[i].busyUntil < r.firstUse && d.internalFormat == r.desc.internalFormat
+					&& d.width == r.desc.width && d.height == r.desc.height)
+					found = (int)i;
+			}
+			if (found < 0) {
+				Physical phys;
+				phys.desc = r.desc;
+				glGenTextures(1, &phys.texture);
+				glBindTexture(GL_TEXTURE_2D, phys.texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, r.desc.internalFormat, r.desc.width, r.desc.height, 0, r.desc.format, r.desc.type, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				transientPool.push_back(phys);
+				found = (int)transientPool.size() - 1;
+			}
+			transientPool[found].busyUntil = r.lastUse;
+			r.physical = found;
+			r.texture = transientPool[found].texture;
+		}
+	}
+
+	void resolveFramebuffers() {
+		for (size_t i = 0; i < order.size(); ++i) {
+			Pass& p = passes[order[i]];
+			if (p.culled || (p.color < 0 && p.depth < 0))
+				continue;
+			if ((p.color >= 0 && resources[p.color].backbuffer) || (p.depth >= 0 && resources[p.depth].backbuffer)) {
+				p.fbo = resources[p.color >= 0 ? p.color : p.depth].framebuffer;
+				continue;
+			}
+			std::vector<unsigned int> key(3, 0);
+			GLenum colorTarget = GL_TEXTURE_2D;
+			if (p.color >= 0) {
+				key[0] = resources[p.color].texture;
+				if (p.face >= 0)
+					colorTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + p.face;
+				key[1] = colorTarget;
+			}
+			if (p.depth >= 0)
+				key[2] = resources[p.depth].texture;
+			std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebufferCache.find(key);
+			if (it != framebufferCache.end()) {
+				p.fbo = it->second;
+				continue;
+			}
+			glGenFramebuffers(1, &p.fbo);
+			glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+			if (p.color >= 0) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTarget, key[0], 0);
+			} else {
+				glDrawBuffer(GL_NONE);
+				glReadBuffer(GL_NONE);
+			}
+			if (p.depth >= 0)
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, key[2], 0);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "ERROR::FRAMEBUFFER:: Framebuffer of pass " << p.name << " is not complete!" << std::endl;
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			framebufferCache[key] = p.fbo;
+		}
+	}
+};
+#endif
@@ -0,0 +1,169 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include "stb_image.h"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+// RGB8 image, top row first, for comparing rendered frames against stored goldens
+class Image {
+public:
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+
+	Image(int width = 0, int height = 0) : width(width), height(height), pixels((size_t)width * height * 3, 0) {}
+
+	// anything stb_image reads, the renders are PPM and the goldens PNG
+	bool load(const char* path) {
+		int channels;
+		stbi_set_flip_vertically_on_load(false);
+		unsigned char* data = stbi_load(path, &width, &height, &channels, 3);
+		if (!data) {
+			width = height = 0;
+			pixels.clear();
+			return false;
+		}
+		pixels.assign(data, data + (size_t)width * height * 3);
+		stbi_image_free(data);
+		return true;
+	}
+
+	// PNG with stored (uncompressed) deflate blocks, so no zlib is needed
+	bool savePng(const char* path) const {
+		std::vector<unsigned char> raw;
+		raw.reserve((size_t)(width * 3 + 1) * height);
+		for (int y = 0; y < height; ++y) {
+			raw.push_back(0); // no filter
+			raw.insert(raw.end(), pixels.begin() + (size_t)y * width * 3, pixels.begin() + (size_t)(y + 1) * width * 3);
+		}
+
+		std::vector<unsigned char> zlib;
+		zlib.push_back(0x78);
+		zlib.push_back(0x01);
+		for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+			size_t length = std::min((size_t)65535, raw.size() - offset);
+			zlib.push_back(offset + length >= raw.size() ? 1 : 0);
+			zlib.push_back(length & 0xff);
+			zlib.push_back(length >> 8);
+			zlib.push_back(~length & 0xff);
+			zlib.push_back((~length >> 8) & 0xff);
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		}
+		unsigned int a = 1, b = 0;
+		for (size_t i = 0; i < raw.size(); ++i) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		putBigEndian(zlib, (b << 16) | a);
+
+		std::vector<unsigned char> header;
+		putBigEndian(header, width);
+		putBigEndian(header, height);
+		const unsigned char format[] = { 8, 2, 0, 0, 0 }; // 8-bit RGB, no interlace
+		header.insert(header.end(), format, format + 5);
+
+		FILE* file = fopen(path, "wb");
+		if (!file) {
+			std::cout << "ERROR::GOLDEN::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+			return false;
+		}
+		const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		fwrite(signature, 1, sizeof(signature), file);
+		writeChunk(file, "IHDR", header);
+		writeChunk(file, "IDAT", zlib);
+		writeChunk(file, "IEND", std::vector<unsigned char>());
+		fclose(file);
+		return true;
+	}
+
+	// peak signal-to-noise ratio over all channels in dB, infinite for identical images
+	static double psnr(const Image& a, const Image& b) {
+		double sum = 0.0;
+		for (size_t i = 0; i < a.pixels.size(); ++i) {
+			double d = (double)a.pixels[i] - b.pixels[i];
+			sum += d * d;
+		}
+		double mse = sum / a.pixels.size();
+		return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+	}
+
+	// mean structural similarity of the luma over 8x8 windows, 4 pixels apart
+	static double ssim(const Image& a, const Image& b) {
+		std::vector<float> la = a.luma(), lb = b.luma();
+		const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+		double total = 0.0;
+		int windows = 0;
+		for (int y = 0; y + 8 <= a.height; y += 4) {
+			for (int x = 0; x + 8 <= a.width; x += 4) {
+				double ma = 0.0, mb = 0.0, va = 0.0, vb = 0.0, cov = 0.0;
+				for (int j = 0; j < 8; ++j) {
+					for (int i = 0; i < 8; ++i) {
+						size_t p = (size_t)(y + j) * a.width + x + i;
+						ma += la[p];
+						mb += lb[p];
+					}
+				}
+				ma /= 64.0;
+				mb /= 64.0;
+				for (int j = 0; j < 8; ++j) {
+					for (int i = 0; i < 8; ++i) {
+						size_t p = (size_t)(y + j) * a.width + x + i;
+						va += (la[p] - ma) * (la[p] - ma);
+						vb += (lb[p] - mb) * (lb[p] - mb);
+						cov += (la[p] - ma) * (lb[p] - mb);
+					}
+				}
+				va /= 63.0;
+				vb /= 63.0;
+				cov /= 63.0;
+				total += (2 * ma * mb + c1) * (2 * cov + c2) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+				++windows;
+			}
+		}
+		return windows ? total / windows : 1.0;
+	}
+
+	// absolute difference per channel, scaled up so small errors are visible
+	static Image diff(const Image& a, const Image& b, int scale = 4) {
+		Image out(a.width, a.height);
+		for (size_t i = 0; i < out.pixels.size(); ++i)
+			out.pixels[i] = (unsigned char)std::min(255, std::abs((int)a.pixels[i] - (int)b.pixels[i]) * scale);
+		return out;
+	}
+
+private:
+	std::vector<float> luma() const {
+		std::vector<float> out((size_t)width * height);
+		for (size_t i = 0; i < out.size(); ++i)
+			out[i] = 0.299f * pixels[i * 3] + 0.587f * pixels[i * 3 + 1] + 0.114f * pixels[i * 3 + 2];
+		return out;
+	}
+
+	static void putBigEndian(std::vector<unsigned char>& out, unsigned int v) {
+		for (int shift = 24; shift >= 0; shift -= 8)
+			out.push_back((v >> shift) & 0xff);
+	}
+
+	static void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+		std::vector<unsigned char> chunk;
+		putBigEndian(chunk, (unsigned int)data.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		// CRC-32 over the type and the data
+		unsigned int crc = 0xffffffffu;
+		for (size_t i = 4; i < chunk.size(); ++i) {
+			crc ^= chunk[i];
+			for (int k = 0; k < 8; ++k)
+				crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+		}
+		putBigEndian(chunk, ~crc);
+		fwrite(chunk.data(), 1, chunk.size(), file);
+	}
+};
+#endif
@@ -0,0 +1,156 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "instancing.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// frustum planes straight from the rows of the view-projection matrix, pointing inwards and not normalized
+inline void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]) {
+	glm::mat4 m = glm::transpose(viewProjection);
+	planes[0] = m[3] + m[0];
+	planes[1] = m[3] - m[0];
+	planes[2] = m[3] + m[1];
+	planes[3] = m[3] - m[1];
+	planes[4] = m[3] + m[2];
+	planes[5] = m[3] - m[2];
+}
+
+// Frustum culls the instances of instanced draws on the GPU with nothing beyond GL 3.3. cull.vs tests the
+// bounding sphere of every instance against the planes with the rasterizer discarded, cull.gs emits only the
+// visible ones and transform feedback streams them into a second buffer in InstanceData layout, which the draw
+// then reads its instances from. GL 3.3 has no way to source the instance count from the GPU (the
+// transform feedback draws take it as the vertex count), so the counts have to be read back. To wait only
+// once per frame, the culling passes of all runs are issued first, each into its own range of the buffer with
+// its own primitives-written query, and resolve() reads the queries back before the first draw.
+class GpuInstanceCuller {
+public:
+	// instances tested and kept since beginFrame()
+	int tested;
+	int visible;
+
+	explicit GpuInstanceCuller(unsigned int program) : tested(0), visible(0), program(program), vao(0), output(0), capacity(0),
+		planesLocation(-1), radiusLocation(-1) {}
+
+	~GpuInstanceCuller() {
+		if (!vao)
+			return;
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &output);
+		if (!queries.empty())
+			glDeleteQueries((GLsizei)queries.size(), queries.data());
+	}
+
+	// outputs of cull.gs captured by transform feedback, in InstanceData order
+	static std::vector<std::string> varyings() {
+		return std::vector<std::string>{ "cullModel", "cullNormal", "cullColour", "cullLayer" };
+	}
+
+	void beginFrame() {
+		tested = visible = 0;
+	}
+
+	// starts a batch of cull() calls testing `total` instances between them, which drops the previous batch
+	void begin(int total) {
+		if (!vao) {
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &output);
+			planesLocation = glGetUniformLocation(program, "planes");
+			radiusLocation = glGetUniformLocation(program, "radius");
+		}
+		if (total > capacity) {
+			capacity = total;
+			glBindBuffer(GL_ARRAY_BUFFER, output);
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_COPY);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		firsts.clear();
+		counts.clear();
+	}
+
+	// issues the culling pass of a mesh whose bounding sphere in model space has `radius` without waiting for it,
+	// returns the run's index; changes the program, the VAO and the array buffer binding
+	int cull(const InstanceData* instances, int count, float radius, const glm::vec4 planes[6]) {
+		int run = (int)firsts.size();
+		int first = run ? firsts.back() + counts.back() : 0;
+		if (first + count > capacity) {
+			std::cout << "ERROR::GPU_CULLING::BATCH_OVERFLOW" << std::endl;
+			return -1;
+		}
+		if (run == (int)queries.size()) {
+			queries.push_back(0);
+			glGenQueries(1, &queries.back());
+		}
+		firsts.push_back(first);
+		counts.push_back(count);
+
+		// one point per instance, reading the same attributes as the instanced shaders
+		glBindVertexArray(vao);
+		input.bind(instances, count);
+		glUseProgram(program);
+		glUniform4fv(planesLocation, 6, &planes[0][0]);
+		glUniform1f(radiusLocation, radius);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, output, first * sizeof(InstanceData), count * sizeof(InstanceData));
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[run]);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArraysInstanced(GL_POINTS, 0, 1, count);
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		return run;
+	}
+
+	// reads back how many instances every run of the batch kept, the only wait for the culling passes
+	void resolve() {
+		for (size_t run = 0; run < counts.size(); ++run) {
+			GLuint written = 0;
+			glGetQueryObjectuiv(queries[run], GL_QUERY_RESULT, &written);
+			tested += counts[run];
+			visible += (int)written;
+			counts[run] = (int)written;
+		}
+	}
+
+	// the instances a run kept, valid after resolve()
+	int count(int run) const {
+		return run < 0 ? 0 : counts[run];
+	}
+
+	// where in buffer() the run's visible instances start, in bytes
+	size_t offset(int run) const {
+		return run < 0 ? 0 : firsts[run] * sizeof(InstanceData);
+	}
+
+	// the visible instances of the current batch
+	unsigned int buffer() const {
+		return output;
+	}
+
+	void report(std::ostream& out) const {
+		out << "gpu culling: " << visible << " of " << tested << " instances visible" << std::endl;
+	}
+
+private:
+	unsigned int program;
+	unsigned int vao;
+	unsigned int output;
+	int capacity;
+	int planesLocation;
+	int radiusLocation;
+	std::vector<unsigned int> queries;
+	std::vector<int> firsts;
+	std::vector<int> counts;
+	InstanceBuffer input;
+
+	GpuInstanceCuller(const GpuInstanceCuller&);
+	GpuInstanceCuller& operator=(const GpuInstanceCuller&);
+};
+#endif
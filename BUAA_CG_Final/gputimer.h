@@ -0,0 +1,178 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include "streamformat.h"
+
+#include <map>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <ostream>
+#include <algorithm>
+
+// nearest-rank percentile of sorted samples
+inline double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty())
+		return 0.0;
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// GPU time per named pass from GL_TIMESTAMP queries. Every pass owns a ring of query pairs, one pair
+// per frame in flight, so results are read back a few frames later and never stall the pipeline.
+// The last `window` samples of each pass are kept for rolling min/avg/p99.
+class GpuTimer {
+public:
+	struct Stats {
+		int samples;
+		double minMs;
+		double avgMs;
+		double p99Ms;
+		double lastMs;
+	};
+	// results still not available when their slot came round again, the ring is too short if this grows
+	int dropped;
+
+	GpuTimer(unsigned int latency = 4, unsigned int window = 240) : dropped(0), latency(latency), window(window), frame(0) {}
+
+	~GpuTimer() {
+		for (std::map<std::string, Timer>::iterator it = timers.begin(); it != timers.end(); ++it)
+			glDeleteQueries((GLsizei)it->second.queries.size(), it->second.queries.data());
+	}
+
+	// collects every result that has arrived, call once per frame before the first begin()
+	void beginFrame() {
+		for (std::map<std::string, Timer>::iterator it = timers.begin(); it != timers.end(); ++it) {
+			Timer& timer = it->second;
+			// from the oldest frame in flight, whose slot this frame reuses, so samples stay in frame order
+			for (unsigned int i = 0; i < latency; ++i) {
+				unsigned int slot = (unsigned int)((frame + i) % latency);
+				if (!timer.pending[slot])
+					continue;
+				GLint available = 0;
+				glGetQueryObjectiv(timer.queries[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available)
+					break;
+				GLuint64 start = 0, end = 0;
+				glGetQueryObjectui64v(timer.queries[2 * slot], GL_QUERY_RESULT, &start);
+				glGetQueryObjectui64v(timer.queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+				timer.pending[slot] = false;
+				timer.samples.push_back((end - start) / 1e6);
+				if (timer.samples.size() > window)
+					timer.samples.pop_front();
+			}
+		}
+	}
+
+	void endFrame() {
+		++frame;
+	}
+
+	void begin(const std::string& name) {
+		Timer& timer = timers[name];
+		if (timer.queries.empty()) {
+			timer.queries.resize(2 * latency);
+			timer.pending.resize(latency, false);
+			glGenQueries((GLsizei)timer.queries.size(), timer.queries.data());
+		}
+		timer.lastFrame = frame;
+		unsigned int slot = frame % latency;
+		if (timer.pending[slot]) {
+			++dropped;
+			timer.pending[slot] = false;
+		}
+		glQueryCounter(timer.queries[2 * slot], GL_TIMESTAMP);
+	}
+
+	void end(const std::string& name) {
+		Timer& timer = timers[name];
+		if (timer.queries.empty())
+			return;
+		unsigned int slot = frame % latency;
+		glQueryCounter(timer.queries[2 * slot + 1], GL_TIMESTAMP);
+		timer.pending[slot] = true;
+	}
+
+	bool stats(const std::string& name, Stats& out) const {
+		std::map<std::string, Timer>::const_iterator it = timers.find(name);
+		if (it == timers.end() || it->second.samples.empty())
+			return false;
+		const std::deque<double>& samples = it->second.samples;
+		std::vector<double> sorted(samples.begin(), samples.end());
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (size_t i = 0; i < sorted.size(); ++i)
+			sum += sorted[i];
+		out.samples = (int)sorted.size();
+		out.minMs = sorted.front();
+		out.avgMs = sum / sorted.size();
+		out.p99Ms = percentile(sorted, 99.0);
+		out.lastMs = samples.back();
+		return true;
+	}
+
+	// the rolling window of a pass, oldest first
+	std::vector<double> samples(const std::string& name) const {
+		std::map<std::string, Timer>::const_iterator it = timers.find(name);
+		if (it == timers.end())
+			return std::vector<double>();
+		return std::vector<double>(it->second.samples.begin(), it->second.samples.end());
+	}
+
+	// sum of the rolling averages of the passes run in the last frame, one-off passes drop out
+	double totalMs() const {
+		double total = 0.0;
+		Stats s;
+		for (std::map<std::string, Timer>::const_iterator it = timers.begin(); it != timers.end(); ++it)
+			if (it->second.lastFrame + 1 >= frame && stats(it->first, s))
+				total += s.avgMs;
+		return total;
+	}
+
+	// one human-readable line per pass
+	void log(std::ostream& out) const {
+		StreamFormat restore(out);
+		out << std::fixed << std::setprecision(3);
+		out << "gpu frame " << frame << ": " << totalMs() << " ms" << std::endl;
+		Stats s;
+		for (std::map<std::string, Timer>::const_iterator it = timers.begin(); it != timers.end(); ++it) {
+			if (!stats(it->first, s))
+				continue;
+			out << "  " << std::left << std::setw(24) << it->first << std::right << " min " << s.minMs
+				<< "  avg " << s.avgMs << "  p99 " << s.p99Ms << " ms" << std::endl;
+		}
+	}
+
+	// the same statistics as JSON, for scripts
+	void dump(std::ostream& out) const {
+		out << "{\n  \"frames\": " << frame << ",\n  \"dropped\": " << dropped << ",\n  \"passes\": [";
+		Stats s;
+		bool first = true;
+		for (std::map<std::string, Timer>::const_iterator it = timers.begin(); it != timers.end(); ++it) {
+			if (!stats(it->first, s))
+				continue;
+			out << (first ? "\n" : ",\n") << "    { \"name\": \"" << it->first << "\", \"samples\": " << s.samples
+				<< ", \"min_ms\": " << s.minMs << ", \"avg_ms\": " << s.avgMs << ", \"p99_ms\": " << s.p99Ms << " }";
+			first = false;
+		}
+		out << "\n  ]\n}" << std::endl;
+	}
+
+private:
+	struct Timer {
+		std::vector<GLuint> queries;
+		std::vector<bool> pending;
+		std::deque<double> samples;
+		unsigned long long lastFrame;
+		Timer() : lastFrame(0) {}
+	};
+	std::map<std::string, Timer> timers;
+	unsigned int latency;
+	unsigned int window;
+	unsigned long long frame;
+};
+#endif
@@ -0,0 +1,157 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// OpenGL 3.3 core context without a window, created through EGL on a surfaceless display so it also
+// works on machines with neither a display server nor a GPU (Mesa llvmpipe). The frame is rendered
+// into an offscreen framebuffer, which takes the place of the window's default framebuffer.
+class HeadlessContext {
+public:
+	unsigned int fbo;
+	int width;
+	int height;
+
+	HeadlessContext(int width, int height) : fbo(0), width(width), height(height), colour(0), depth(0),
+		display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+				std::cout << "ERROR::HEADLESS:: Failed to initialize an EGL display" << std::endl;
+				display = EGL_NO_DISPLAY;
+				return;
+			}
+		}
+
+		const EGLint configAttribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_NONE,
+		};
+		EGLConfig config;
+		EGLint configs = 0;
+		if (!eglChooseConfig(display, configAttribs, &config, 1, &configs) || configs == 0) {
+			std::cout << "ERROR::HEADLESS:: No EGL config supports desktop OpenGL" << std::endl;
+			return;
+		}
+		eglBindAPI(EGL_OPENGL_API);
+		const EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+			EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+			EGL_NONE,
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+		if (context == EGL_NO_CONTEXT) {
+			std::cout << "ERROR::HEADLESS:: Failed to create an OpenGL 3.3 core context" << std::endl;
+			return;
+		}
+		// the pbuffer only exists to make the context current where surfaceless contexts are not supported
+		const EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+		if (!eglMakeCurrent(display, surface, surface, context)) {
+			std::cout << "ERROR::HEADLESS:: Failed to make the context current" << std::endl;
+			eglDestroyContext(display, context);
+			context = EGL_NO_CONTEXT;
+		}
+	}
+
+	~HeadlessContext() {
+		if (display == EGL_NO_DISPLAY)
+			return;
+		if (fbo) {
+			glDeleteFramebuffers(1, &fbo);
+			glDeleteRenderbuffers(1, &colour);
+			glDeleteRenderbuffers(1, &depth);
+		}
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+	}
+
+	bool valid() const {
+		return context != EGL_NO_CONTEXT;
+	}
+
+	// for gladLoadGLLoader, Mesa also resolves core functions through eglGetProcAddress
+	static void* getProcAddress(const char* name) {
+		return (void*)eglGetProcAddress(name);
+	}
+
+	// creates the offscreen colour and depth buffers, needs the GL functions to be loaded
+	bool createFramebuffer() {
+		glGenRenderbuffers(1, &colour);
+		glBindRenderbuffer(GL_RENDERBUFFER, colour);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (!complete)
+			std::cout << "ERROR::FRAMEBUFFER:: Headless framebuffer is not complete!" << std::endl;
+		glViewport(0, 0, width, height);
+		return complete;
+	}
+
+	// reads the offscreen framebuffer back, top row first, 3 bytes per pixel
+	std::vector<unsigned char> readPixels() const {
+		std::vector<unsigned char> pixels(width * height * 3);
+		std::vector<unsigned char> row(width * 3);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+		for (int y = 0; y < height / 2; ++y) {
+			unsigned char* top = &pixels[y * width * 3];
+			unsigned char* bottom = &pixels[(height - 1 - y) * width * 3];
+			std::copy(top, top + width * 3, row.begin());
+			std::copy(bottom, bottom + width * 3, top);
+			std::copy(row.begin(), row.end(), bottom);
+		}
+		return pixels;
+	}
+
+	// writes the frame as a binary PPM, which needs no image library
+	bool save(const char* path) const {
+		std::vector<unsigned char> pixels = readPixels();
+		FILE* file = fopen(path, "wb");
+		if (!file) {
+			std::cout << "ERROR::HEADLESS::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+			return false;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		fwrite(pixels.data(), 1, pixels.size(), file);
+		fclose(file);
+		return true;
+	}
+
+private:
+	unsigned int colour;
+	unsigned int depth;
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+};
+#endif
@@ -0,0 +1,273 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+#include <cmath>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+// a large object drawn into the occluder depth pass
+struct Occluder {
+	glm::mat4 model;
+	unsigned int vao;
+	unsigned int count; // vertices, drawn with glDrawArrays
+};
+
+// Hierarchical-Z occlusion culling against a depth pass of a few large occluders. render() draws them into a
+// depth target of a fraction of the view's size, hiz.fs reduces it into a pyramid whose texels keep the
+// farthest depth beneath them, and every level is read back through a PBO. update() takes the pyramid over
+// once its fence has signalled, so the CPU tests in occludes() run a frame behind and never stall: an object
+// is hidden when its nearest depth lies behind the farthest depth of the few texels its screen rectangle
+// covers on a coarse enough level.
+class HiZBuffer {
+public:
+	// spheres tested and found hidden since beginFrame()
+	int tested;
+	int occluded;
+
+	HiZBuffer(int width, int height) : tested(0), occluded(0), width(std::max(width, 1)), height(std::max(height, 1)),
+		depthFbo(0), pyramidFbo(0), depth(0), pyramid(0), vao(0), pbo(0), fence(0), pending(false), valid(false),
+		readViewProjection(1.0f), pendingViewProjection(1.0f) {
+		size_t offset = 0;
+		for (int w = this->width, h = this->height;; w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+			sizes.push_back(glm::ivec2(w, h));
+			offsets.push_back(offset);
+			offset += (size_t)w * h;
+			if (w == 1 && h == 1)
+				break;
+		}
+		levels.resize(offset);
+	}
+
+	~HiZBuffer() {
+		if (!depthFbo)
+			return;
+		if (fence)
+			glDeleteSync(fence);
+		glDeleteFramebuffers(1, &depthFbo);
+		glDeleteFramebuffers(1, &pyramidFbo);
+		glDeleteTextures(1, &depth);
+		glDeleteTextures(1, &pyramid);
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &pbo);
+	}
+
+	// the pyramid texture, for declaring the pass to a frame graph
+	unsigned int texture() {
+		if (!depthFbo)
+			create();
+		return pyramid;
+	}
+
+	void beginFrame() {
+		tested = occluded = 0;
+	}
+
+	// draws the occluders with depth.vs (lightSpace set to the view projection), reduces their depth with
+	// hiz.fs and starts reading the pyramid back; skipped while the last readback is still in flight
+	void render(Shader& depthShader, Shader& reduceShader, const glm::mat4& viewProjection, const std::vector<Occluder>& occluders) {
+		if (pending)
+			return;
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		GLint framebuffer;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		if (!depthFbo)
+			create();
+
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+		glViewport(0, 0, width, height);
+		glEnable(GL_DEPTH_TEST);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		depthShader.use();
+		depthShader.setMat4("lightSpace", viewProjection);
+		for (size_t i = 0; i < occluders.size(); ++i) {
+			depthShader.setMat4("model", occluders[i].model);
+			glBindVertexArray(occluders[i].vao);
+			glDrawArrays(GL_TRIANGLES, 0, occluders[i].count);
+		}
+
+		// level 0 copies the depth, every further level reduces the one before it, which alone is sampled
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, pyramidFbo);
+		glBindVertexArray(vao);
+		reduceShader.use();
+		reduceShader.setInt("source", 0);
+		glActiveTexture(GL_TEXTURE0);
+		for (size_t level = 0; level < sizes.size(); ++level) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, (int)level);
+			glViewport(0, 0, sizes[level].x, sizes[level].y);
+			if (level == 0) {
+				glBindTexture(GL_TEXTURE_2D, depth);
+				reduceShader.setInt("reduce", 0);
+			} else {
+				glBindTexture(GL_TEXTURE_2D, pyramid);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (int)level - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)level - 1);
+				reduceShader.setInt("reduce", 1);
+				reduceShader.setVec2("sourceSize", glm::vec2(sizes[level - 1]));
+			}
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)sizes.size() - 1);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		for (size_t level = 0; level < sizes.size(); ++level)
+			glGetTexImage(GL_TEXTURE_2D, (int)level, GL_RED, GL_FLOAT, (void*)(offsets[level] * sizeof(float)));
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending = true;
+		pendingViewProjection = viewProjection;
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindVertexArray(0);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	// non-blocking, returns true when the pyramid of the last render() became the one tested against
+	bool update() {
+		if (!pending)
+			return false;
+		GLenum state = glClientWaitSync(fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			return false;
+		glDeleteSync(fence);
+		fence = 0;
+		pending = false;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		const float* texels = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, levels.size() * sizeof(float), GL_MAP_READ_BIT);
+		if (texels) {
+			memcpy(levels.data(), texels, levels.size() * sizeof(float));
+			readViewProjection = pendingViewProjection;
+			valid = true;
+		} else {
+			std::cout << "ERROR::HIZ::PBO_MAP_FAILED" << std::endl;
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return valid;
+	}
+
+	// whether the sphere lies behind the occluders of the pyramid read back last, as seen from that pyramid's
+	// view; false without a pyramid and for spheres off screen or reaching behind the near plane
+	bool occludes(const glm::vec3& center, float radius) {
+		if (!valid)
+			return false;
+		++tested;
+		// screen rectangle and nearest depth of the sphere's bounding box
+		glm::vec3 lo, hi;
+		for (int i = 0; i < 8; ++i) {
+			glm::vec3 corner = center + radius * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+			glm::vec4 clip = readViewProjection * glm::vec4(corner, 1.0f);
+			if (clip.w <= 0.0f)
+				return false;
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			lo = i ? glm::min(lo, ndc) : ndc;
+			hi = i ? glm::max(hi, ndc) : ndc;
+		}
+		if (hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f || lo.z < -1.0f)
+			return false;
+		lo = glm::max(lo, glm::vec3(-1.0f));
+		hi = glm::min(hi, glm::vec3(1.0f));
+		float nearest = lo.z * 0.5f + 0.5f;
+		// a texel of margin, the occluders were rasterized at texel centres
+		int x0 = std::max((int)std::floor((lo.x * 0.5f + 0.5f) * width) - 1, 0);
+		int y0 = std::max((int)std::floor((lo.y * 0.5f + 0.5f) * height) - 1, 0);
+		int x1 = std::min((int)std::floor((hi.x * 0.5f + 0.5f) * width) + 1, width - 1);
+		int y1 = std::min((int)std::floor((hi.y * 0.5f + 0.5f) * height) + 1, height - 1);
+		// the finest level on which the rectangle spans at most 2x2 texels, the last texel of a row or
+		// column also covers what an odd level dropped
+		size_t level = 0;
+		while (level + 1 < sizes.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+			++level;
+		const glm::ivec2& size = sizes[level];
+		const float* texels = &levels[offsets[level]];
+		float farthest = 0.0f;
+		for (int y = std::min(y0 >> level, size.y - 1); y <= std::min(y1 >> level, size.y - 1); ++y)
+			for (int x = std::min(x0 >> level, size.x - 1); x <= std::min(x1 >> level, size.x - 1); ++x)
+				farthest = std::max(farthest, texels[(size_t)y * size.x + x]);
+		if (nearest <= farthest)
+			return false;
+		++occluded;
+		return true;
+	}
+
+	void report(std::ostream& out) const {
+		out << "hi-z: " << occluded << " of " << tested << " objects occluded (" << width << "x" << height << " pyramid of "
+			<< sizes.size() << " levels)" << std::endl;
+	}
+
+private:
+	int width;
+	int height;
+	unsigned int depthFbo;
+	unsigned int pyramidFbo;
+	unsigned int depth;
+	unsigned int pyramid;
+	unsigned int vao;
+	unsigned int pbo;
+	GLsync fence;
+	bool pending;
+	bool valid;
+	// the view projection the pyramid was rendered with, the tests project with it
+	glm::mat4 readViewProjection;
+	glm::mat4 pendingViewProjection;
+	std::vector<glm::ivec2> sizes;
+	std::vector<size_t> offsets;
+	std::vector<float> levels;
+
+	HiZBuffer(const HiZBuffer&);
+	HiZBuffer& operator=(const HiZBuffer&);
+
+	void create() {
+		glGenFramebuffers(1, &depthFbo);
+		glGenFramebuffers(1, &pyramidFbo);
+		glGenTextures(1, &depth);
+		glGenTextures(1, &pyramid);
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &pbo);
+
+		glBindTexture(GL_TEXTURE_2D, depth);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		for (size_t level = 0; level < sizes.size(); ++level)
+			glTexImage2D(GL_TEXTURE_2D, (int)level, GL_R32F, sizes[level].x, sizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)sizes.size() - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Hi-Z depth framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, pyramidFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Hi-Z pyramid framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, levels.size() * sizeof(float), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+};
+#endif
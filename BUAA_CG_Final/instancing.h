@@ -0,0 +1,75 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// One instance of an instanced draw, read by the INSTANCED shader variants as vertex attributes with a divisor
+// of 1: the model matrix in locations 3-6, the normal matrix in 7-9, the colour in 10 and the layer in 11,
+// after the mesh's own attributes in 0-2.
+struct InstanceData {
+	glm::mat4 model;
+	glm::mat3 normal;
+	glm::vec3 colour;
+	int layer; // as DrawItem::layer
+};
+
+// The streamed vertex buffer behind the instance attributes. Every draw orphans and refills it, so the driver
+// never waits for the previous draw to finish reading. Must only be used on the thread owning the context.
+class InstanceBuffer {
+public:
+	static const unsigned int FIRST_ATTRIBUTE = 3;
+	static const unsigned int ATTRIBUTES = 9;
+
+	InstanceBuffer() : vbo(0) {}
+
+	~InstanceBuffer() {
+		if (vbo)
+			glDeleteBuffers(1, &vbo);
+	}
+
+	// uploads the instances and points the attributes of the bound VAO at them
+	void bind(const InstanceData* instances, int count) {
+		if (!vbo)
+			glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+		attach(vbo);
+	}
+
+	// points the attributes of the bound VAO at instances already in `buffer`, starting `first` bytes in
+	static void attach(unsigned int buffer, size_t first = 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (unsigned int i = 0; i < 4; ++i)
+			pointer(FIRST_ATTRIBUTE + i, 4, first + offsetof(InstanceData, model) + i * sizeof(glm::vec4));
+		for (unsigned int i = 0; i < 3; ++i)
+			pointer(FIRST_ATTRIBUTE + 4 + i, 3, first + offsetof(InstanceData, normal) + i * sizeof(glm::vec3));
+		pointer(FIRST_ATTRIBUTE + 7, 3, first + offsetof(InstanceData, colour));
+		glEnableVertexAttribArray(FIRST_ATTRIBUTE + 8);
+		glVertexAttribIPointer(FIRST_ATTRIBUTE + 8, 1, GL_INT, sizeof(InstanceData), (void*)(first + offsetof(InstanceData, layer)));
+		glVertexAttribDivisor(FIRST_ATTRIBUTE + 8, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// disables the attributes again, so plain draws of the same VAO do not keep them enabled
+	static void unbind() {
+		for (unsigned int i = 0; i < ATTRIBUTES; ++i)
+			glDisableVertexAttribArray(FIRST_ATTRIBUTE + i);
+	}
+
+private:
+	unsigned int vbo;
+
+	InstanceBuffer(const InstanceBuffer&);
+	InstanceBuffer& operator=(const InstanceBuffer&);
+
+	static void pointer(unsigned int attribute, int size, size_t offset) {
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribPointer(attribute, size, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+		glVertexAttribDivisor(attribute, 1);
+	}
+};
+#endif
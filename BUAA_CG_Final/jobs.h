@@ -0,0 +1,105 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for CPU-only frame work. run() hands out a batch of jobs and blocks
+// until all of them are done; the calling thread works on the batch as well.
+class JobPool {
+public:
+	JobPool(unsigned int threads = 0) : batch(NULL), next(0), remaining(0), active(0), generation(0), quit(false) {
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		// the caller is one of the workers
+		for (unsigned int i = 1; i < threads; ++i)
+			workers.push_back(std::thread(&JobPool::work, this));
+	}
+
+	~JobPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+
+	unsigned int threads() const {
+		return (unsigned int)workers.size() + 1;
+	}
+
+	// several threads may call it, their batches run one after the other
+	void run(const std::vector<std::function<void()> >& jobs) {
+		if (jobs.empty())
+			return;
+		std::lock_guard<std::mutex> serial(caller);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			batch = &jobs;
+			next = 0;
+			remaining = (int)jobs.size();
+			++generation;
+		}
+		wake.notify_all();
+		drain();
+		std::unique_lock<std::mutex> lock(mutex);
+		// also wait for workers that woke up late and found nothing left to do
+		done.wait(lock, [this]() { return remaining == 0 && active == 0; });
+		batch = NULL;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex caller;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::vector<std::function<void()> >* batch;
+	std::atomic<int> next;
+	int remaining;
+	int active;
+	unsigned long long generation;
+	bool quit;
+
+	void drain() {
+		const std::vector<std::function<void()> >* jobs;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs = batch;
+			if (!jobs)
+				return;
+			++active;
+		}
+		int finished = 0;
+		for (int i = next++; i < (int)jobs->size(); i = next++) {
+			(*jobs)[i]();
+			++finished;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		remaining -= finished;
+		--active;
+		if (remaining == 0 && active == 0)
+			done.notify_all();
+	}
+
+	void work() {
+		unsigned long long seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || generation != seen; });
+				if (quit)
+					return;
+				seen = generation;
+			}
+			drain();
+		}
+	}
+};
+#endif
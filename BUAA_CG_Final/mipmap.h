@@ -0,0 +1,474 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "jobs.h"
+
+#include <cmath>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// the AVX2 paths are compiled for that target on their own and picked at runtime, the rest of the build stays SSE2
+#if defined(MIP_USE_SSE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MIP_USE_AVX2
+#define MIP_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(MIP_USE_SSE) && defined(_MSC_VER)
+#define MIP_USE_AVX2
+#define MIP_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+// CPU mip chain for tightly packed 8-bit RGB or RGBA images, the same level sizes as glGenerateMipmap
+// (halved and rounded down). BOX averages 2x2 texels, in 16-bit integers with SSE2/AVX2 for RGBA; with srgb it
+// sums 14-bit linear values looked up per channel and looks the sum up in an encode table, eight channels at a
+// time with AVX2 gathers. KAISER is a separable 8-tap Kaiser-windowed sinc, in floats with one SSE register per
+// texel. srgb filters RGB in linear light and converts back, alpha stays linear. Each level is split into bands
+// of rows that run on the job pool; a level needs the whole previous one, so once the levels are small the rest
+// of the chain is one job.
+class MipmapGenerator {
+public:
+	enum Filter {
+		BOX,
+		KAISER,
+	};
+
+	enum Isa {
+		SCALAR,
+		SSE2,
+		AVX2,
+	};
+
+	Filter filter;
+	bool srgb;
+	Isa isa; // the widest the CPU supports by default, lower it to compare
+
+	// without a pool the chain is built on the calling thread
+	MipmapGenerator(Filter filter = BOX, bool srgb = false, JobPool* jobs = NULL) : filter(filter), srgb(srgb), isa(bestIsa()), jobs(jobs) {}
+
+	static Isa bestIsa() {
+#if defined(MIP_USE_AVX2) && defined(__GNUC__)
+		if (__builtin_cpu_supports("avx2"))
+			return AVX2;
+#elif defined(MIP_USE_AVX2)
+		int info[4];
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+			return AVX2;
+#endif
+#ifdef MIP_USE_SSE
+		return SSE2;
+#else
+		return SCALAR;
+#endif
+	}
+
+	static const char* name(Isa isa) {
+		return isa == AVX2 ? "avx2" : isa == SSE2 ? "sse2" : "scalar";
+	}
+
+	// including level 0
+	static int levels(int width, int height) {
+		int count = 1;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			++count;
+		}
+		return count;
+	}
+
+	// of levels 1 and up, stored one after the other
+	static size_t chainBytes(int width, int height, int channels) {
+		size_t bytes = 0;
+		while (width > 1 || height > 1) {
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+			bytes += (size_t)width * height * channels;
+		}
+		return bytes;
+	}
+
+	// writes levels 1 and up of `src` to `dst`, which holds chainBytes(), e.g. the mapped upload buffer right after level 0
+	void generate(const unsigned char* src, int width, int height, int channels, unsigned char* dst) const {
+		const size_t SMALL_LEVEL = 128 * 128; // texels below which the rest of the chain is one job
+		while (width > 1 || height > 1) {
+			int w = std::max(1, width / 2), h = std::max(1, height / 2);
+			if ((size_t)w * h < SMALL_LEVEL || !jobs) {
+				auto tail = [=]() {
+					const unsigned char* level = src;
+					int levelWidth = width, levelHeight = height;
+					unsigned char* out = dst;
+					while (levelWidth > 1 || levelHeight > 1) {
+						int outWidth = std::max(1, levelWidth / 2), outHeight = std::max(1, levelHeight / 2);
+						rows(level, levelWidth, levelHeight, channels, out, 0, outHeight);
+						level = out;
+						out += (size_t)outWidth * outHeight * channels;
+						levelWidth = outWidth;
+						levelHeight = outHeight;
+					}
+				};
+				if (jobs)
+					jobs->run(std::vector<std::function<void()> >(1, tail));
+				else
+					tail();
+				return;
+			}
+			int bands = std::min(h, (int)jobs->threads() * 4);
+			std::vector<std::function<void()> > work;
+			for (int b = 0; b < bands; ++b) {
+				int begin = h * b / bands, end = h * (b + 1) / bands;
+				work.push_back([=]() { rows(src, width, height, channels, dst, begin, end); });
+			}
+			jobs->run(work);
+			src = dst;
+			dst += (size_t)w * h * channels;
+			width = w;
+			height = h;
+		}
+	}
+
+private:
+	static const int TAPS = 8; // KAISER reads source texels 2x - 3 to 2x + 4 for output texel x
+	static const int SRGB_STEPS = 8192;
+	static const int LINEAR_ONE = 16383; // 1.0 in the integer linear values of the sRGB box filter, four fit 16 bits
+	static const int FILTER_ROWS = 16;
+
+	JobPool* jobs;
+
+	// output rows [begin, end) of the level below src
+	void rows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int begin, int end) const {
+		if (filter == BOX) {
+			if (srgb)
+				srgbBoxRows(src, width, height, channels, dst, begin, end);
+			else
+				boxRows(src, width, height, channels, dst, begin, end);
+			return;
+		}
+		// a few rows at a time so the float rows stay in cache
+		for (int y = begin; y < end; y += FILTER_ROWS)
+			filterRows(src, width, height, channels, dst, y, std::min(end, y + FILTER_ROWS));
+	}
+
+	void boxRows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int begin, int end) const {
+		int w = std::max(1, width / 2);
+		for (int y = begin; y < end; ++y) {
+			const unsigned char* row0 = src + (size_t)std::min(2 * y, height - 1) * width * channels;
+			const unsigned char* row1 = src + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+			unsigned char* out = dst + (size_t)y * w * channels;
+			int x = 0;
+			// width 1 repeats its only column, which the vector paths do not
+			if (channels == 4 && width > 1) {
+#ifdef MIP_USE_AVX2
+				if (isa == AVX2)
+					x = boxRowAvx2(row0, row1, out, w);
+#endif
+#ifdef MIP_USE_SSE
+				if (isa != SCALAR)
+					x = boxRowSse2(row0, row1, out, w, x);
+#endif
+			}
+			for (; x < w; ++x) {
+				int x0 = std::min(2 * x, width - 1) * channels, x1 = std::min(2 * x + 1, width - 1) * channels;
+				for (int c = 0; c < channels; ++c)
+					out[x * channels + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+			}
+		}
+	}
+
+#ifdef MIP_USE_SSE
+	// four RGBA texels per step from x, returns where it stopped
+	static int boxRowSse2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int w, int x) {
+		const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+		for (; x + 4 <= w; x += 4) {
+			__m128i half[2];
+			for (int i = 0; i < 2; ++i) {
+				__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + i * 16));
+				__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + i * 16));
+				// texels 0 and 1, 2 and 3 summed over both rows in 16 bits
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				half[i] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+			}
+			_mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(half[0], half[1]));
+		}
+		return x;
+	}
+#endif
+
+#ifdef MIP_USE_AVX2
+	// eight RGBA texels per step, the unpacks work within 128-bit lanes so the result is put back in order at the end
+	MIP_AVX2_TARGET static int boxRowAvx2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int w) {
+		const __m256i zero = _mm256_setzero_si256(), two = _mm256_set1_epi16(2);
+		int x = 0;
+		for (; x + 8 <= w; x += 8) {
+			__m256i half[2];
+			for (int i = 0; i < 2; ++i) {
+				__m256i a = _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + i * 32));
+				__m256i b = _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + i * 32));
+				__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+				__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+				__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+				half[i] = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+			}
+			// 64-bit pairs come out as 0 2 1 3
+			__m256i packed = _mm256_packus_epi16(half[0], half[1]);
+			_mm256_storeu_si256((__m256i*)(out + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+		return x;
+	}
+#endif
+
+	// BOX in linear light without floats: four decoded values are summed and the sum indexes the encode table
+	void srgbBoxRows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int begin, int end) const {
+		int w = std::max(1, width / 2);
+		const int* linear = linearTable();
+		const unsigned char* encode = sumEncodeTable();
+		for (int y = begin; y < end; ++y) {
+			const unsigned char* row0 = src + (size_t)std::min(2 * y, height - 1) * width * channels;
+			const unsigned char* row1 = src + (size_t)std::min(2 * y + 1, height - 1) * width * channels;
+			unsigned char* out = dst + (size_t)y * w * channels;
+			int x = 0;
+#ifdef MIP_USE_AVX2
+			if (channels == 4 && width > 1 && isa == AVX2)
+				x = srgbBoxRowAvx2(row0, row1, out, w, linear, encode);
+#endif
+			for (; x < w; ++x) {
+				int x0 = std::min(2 * x, width - 1) * channels, x1 = std::min(2 * x + 1, width - 1) * channels;
+				for (int c = 0; c < 3; ++c)
+					out[x * channels + c] = encode[linear[row0[x0 + c]] + linear[row0[x1 + c]] + linear[row1[x0 + c]] + linear[row1[x1 + c]]];
+				if (channels == 4)
+					out[x * 4 + 3] = (unsigned char)((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) >> 2);
+			}
+		}
+	}
+
+#ifdef MIP_USE_AVX2
+	// two RGBA texels per step, one channel per 32-bit lane; the encode gather reads four bytes and keeps the first,
+	// the table is padded for it
+	MIP_AVX2_TARGET static int srgbBoxRowAvx2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int w,
+		const int* linear, const unsigned char* encode) {
+		// even source texels of both outputs, the odd ones are 4 bytes further
+		const __m128i even = _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m256i alphaLanes = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+		const __m256i two = _mm256_set1_epi32(2), low = _mm256_set1_epi32(0xff);
+		int x = 0;
+		for (; x + 2 <= w; x += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+			__m256i texels[4] = {
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(a, even)), _mm256_cvtepu8_epi32(_mm_shuffle_epi8(_mm_srli_si128(a, 4), even)),
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(b, even)), _mm256_cvtepu8_epi32(_mm_shuffle_epi8(_mm_srli_si128(b, 4), even)),
+			};
+			__m256i sum = _mm256_setzero_si256(), alpha = two;
+			for (int i = 0; i < 4; ++i) {
+				sum = _mm256_add_epi32(sum, _mm256_i32gather_epi32(linear, texels[i], 4));
+				alpha = _mm256_add_epi32(alpha, texels[i]);
+			}
+			__m256i colour = _mm256_and_si256(_mm256_i32gather_epi32((const int*)encode, sum, 1), low);
+			__m256i result = _mm256_blendv_epi8(colour, _mm256_srli_epi32(alpha, 2), alphaLanes);
+			// 32 to 8 bits, the two 128-bit lanes hold one texel each
+			__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(result, result), _mm256_setzero_si256());
+			int lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed)), hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+			memcpy(out + x * 4, &lo, 4);
+			memcpy(out + x * 4 + 4, &hi, 4);
+		}
+		return x;
+	}
+#endif
+
+	// KAISER: each source row the band needs is converted to floats (four per texel, linear with srgb) and filtered
+	// horizontally, then the columns are filtered vertically and converted back
+	void filterRows(const unsigned char* src, int width, int height, int channels, unsigned char* dst, int begin, int end) const {
+		int w = std::max(1, width / 2);
+		float weights[TAPS];
+		const int taps = TAPS, first = -3;
+		kernel(weights);
+		// source rows top to bottom feed this band
+		int top = std::max(0, 2 * begin + first), bottom = std::min(height - 1, 2 * (end - 1) + first + taps - 1);
+		std::vector<float> horizontal((size_t)(bottom - top + 1) * w * 4);
+		std::vector<float> texels((size_t)width * 4);
+		const float* colour = decodeTable(srgb);
+		const float* alpha = decodeTable(false);
+		const unsigned char* encode = encodeTable();
+#ifdef MIP_USE_SSE
+		__m128 weight[TAPS];
+		for (int k = 0; k < taps; ++k)
+			weight[k] = _mm_set1_ps(weights[k]);
+#endif
+
+		for (int sy = top; sy <= bottom; ++sy) {
+			const unsigned char* row = src + (size_t)sy * width * channels;
+			for (int x = 0; x < width; ++x) {
+				for (int c = 0; c < 3; ++c)
+					texels[x * 4 + c] = colour[row[x * channels + c]];
+				texels[x * 4 + 3] = channels == 4 ? alpha[row[x * channels + 3]] : 1.0f;
+			}
+			float* out = &horizontal[(size_t)(sy - top) * w * 4];
+			for (int x = 0; x < w; ++x) {
+				// only the texels near the edges need their taps clamped
+				int sx = 2 * x + first;
+				bool inside = sx >= 0 && sx + taps <= width;
+#ifdef MIP_USE_SSE
+				if (isa != SCALAR) {
+					__m128 sum = _mm_setzero_ps();
+					for (int k = 0; k < taps; ++k)
+						sum = _mm_add_ps(sum, _mm_mul_ps(weight[k], _mm_loadu_ps(&texels[(inside ? sx + k : std::max(0, std::min(width - 1, sx + k))) * 4])));
+					_mm_storeu_ps(out + x * 4, sum);
+					continue;
+				}
+#endif
+				for (int c = 0; c < 4; ++c) {
+					float sum = 0.0f;
+					for (int k = 0; k < taps; ++k)
+						sum += weights[k] * texels[(inside ? sx + k : std::max(0, std::min(width - 1, sx + k))) * 4 + c];
+					out[x * 4 + c] = sum;
+				}
+			}
+		}
+
+		std::vector<float> column((size_t)w * 4);
+		for (int y = begin; y < end; ++y) {
+			const float* sources[TAPS];
+			for (int k = 0; k < taps; ++k)
+				sources[k] = &horizontal[(size_t)(std::max(0, std::min(height - 1, 2 * y + first + k)) - top) * w * 4];
+			verticalFilter(sources, weights, taps, w * 4, column.data());
+			unsigned char* out = dst + (size_t)y * w * channels;
+			for (int x = 0; x < w; ++x)
+				for (int c = 0; c < channels; ++c)
+					out[x * channels + c] = c < 3 && srgb ? encode[(int)(std::max(0.0f, std::min(1.0f, column[x * 4 + c])) * SRGB_STEPS + 0.5f)]
+						: (unsigned char)(std::max(0.0f, std::min(1.0f, column[x * 4 + c])) * 255.0f + 0.5f);
+		}
+	}
+
+	void verticalFilter(const float* const* sources, const float* weights, int taps, int count, float* out) const {
+		int i = 0;
+#ifdef MIP_USE_AVX2
+		if (isa == AVX2)
+			i = verticalFilterAvx2(sources, weights, taps, count, out);
+#endif
+#ifdef MIP_USE_SSE
+		if (isa != SCALAR) {
+			for (; i + 4 <= count; i += 4) {
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < taps; ++k)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(sources[k] + i)));
+				_mm_storeu_ps(out + i, sum);
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			float sum = 0.0f;
+			for (int k = 0; k < taps; ++k)
+				sum += weights[k] * sources[k][i];
+			out[i] = sum;
+		}
+	}
+
+#ifdef MIP_USE_AVX2
+	MIP_AVX2_TARGET static int verticalFilterAvx2(const float* const* sources, const float* weights, int taps, int count, float* out) {
+		int i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256 sum = _mm256_setzero_ps();
+			for (int k = 0; k < taps; ++k)
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(sources[k] + i)));
+			_mm256_storeu_ps(out + i, sum);
+		}
+		return i;
+	}
+#endif
+
+	// normalized taps, distances 3.5 to 0.5 texels from the centre between source texels 2x and 2x + 1
+	static void kernel(float* weights) {
+		const double PI = 3.14159265358979, ALPHA = 4.0;
+		auto bessel0 = [](double x) {
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 20; ++k) {
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		};
+		double total = 0.0;
+		for (int k = 0; k < TAPS; ++k) {
+			double d = k - 3.5; // in source texels
+			double sinc = std::sin(PI * d / 2.0) / (PI * d / 2.0);
+			double t = d / (TAPS / 2.0);
+			weights[k] = (float)(sinc * bessel0(ALPHA * std::sqrt(1.0 - t * t)) / bessel0(ALPHA));
+			total += weights[k];
+		}
+		for (int k = 0; k < TAPS; ++k)
+			weights[k] = (float)(weights[k] / total);
+	}
+
+	// 8-bit values to floats, sRGB decoded or not
+	static const float* decodeTable(bool srgb) {
+		static const std::vector<float> table = buildDecodeTable();
+		return table.data() + (srgb ? 256 : 0);
+	}
+
+	static std::vector<float> buildDecodeTable() {
+		std::vector<float> table(512);
+		for (int i = 0; i < 256; ++i) {
+			double c = i / 255.0;
+			table[i] = (float)c;
+			table[256 + i] = (float)(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+		}
+		return table;
+	}
+
+	// sRGB 8-bit values to linear ones in 0 to LINEAR_ONE
+	static const int* linearTable() {
+		static const std::vector<int> table = buildLinearTable();
+		return table.data();
+	}
+
+	static std::vector<int> buildLinearTable() {
+		std::vector<int> table(256);
+		const float* linear = decodeTable(true);
+		for (int i = 0; i < 256; ++i)
+			table[i] = (int)(linear[i] * LINEAR_ONE + 0.5f);
+		return table;
+	}
+
+	// sums of four linearTable() values to sRGB, three bytes of padding for the AVX2 gather
+	static const unsigned char* sumEncodeTable() {
+		static const std::vector<unsigned char> table = buildSumEncodeTable();
+		return table.data();
+	}
+
+	static std::vector<unsigned char> buildSumEncodeTable() {
+		std::vector<unsigned char> table(4 * LINEAR_ONE + 4);
+		for (int i = 0; i <= 4 * LINEAR_ONE; ++i) {
+			double c = (double)i / (4 * LINEAR_ONE);
+			c = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+			table[i] = (unsigned char)(c * 255.0 + 0.5);
+		}
+		return table;
+	}
+
+	// linear floats in SRGB_STEPS steps to sRGB, fine enough to stay within half an 8-bit step near black
+	static const unsigned char* encodeTable() {
+		static const std::vector<unsigned char> table = buildEncodeTable();
+		return table.data();
+	}
+
+	static std::vector<unsigned char> buildEncodeTable() {
+		std::vector<unsigned char> table(SRGB_STEPS + 1);
+		for (int i = 0; i <= SRGB_STEPS; ++i) {
+			double c = (double)i / SRGB_STEPS;
+			c = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+			table[i] = (unsigned char)(c * 255.0 + 0.5);
+		}
+		return table;
+	}
+};
+#endif
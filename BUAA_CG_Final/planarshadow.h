@@ -0,0 +1,89 @@
+#ifndef PLANAR_SHADOW_H
+#define PLANAR_SHADOW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+#include <iostream>
+
+// Projected shadow of one caster, rasterized into a texture laid over the receiving plane.
+// The texture is only rebuilt when the light, the caster or the plane has moved.
+class PlanarShadow {
+public:
+	unsigned int texture;
+
+	PlanarShadow(unsigned int size = 1024) : size(size), valid(false), lastSurfaceY(0.0f) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Shadow framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	~PlanarShadow() {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &texture);
+	}
+
+	// re-rasterizes the shadow if anything it depends on changed, returns true if it did; surfaceY is the height
+	// the caster is projected onto, which may differ from where surfaceModel puts the visible plane
+	bool update(Shader& shadowShader, const glm::vec3& lightPos, const glm::mat4& casterModel, const glm::mat4& surfaceModel,
+		float surfaceY, unsigned int casterVAO, unsigned int casterCount) {
+		if (valid && lightPos == lastLight && casterModel == lastCaster && surfaceModel == lastSurface && surfaceY == lastSurfaceY)
+			return false;
+		lastLight = lightPos;
+		lastCaster = casterModel;
+		lastSurface = surfaceModel;
+		lastSurfaceY = surfaceY;
+		valid = true;
+
+		// view brings world space into the plane's local space, projection maps local (x, z) in [-1, 1] onto the texture
+		glm::mat4 toTexture(0.0f);
+		toTexture[0][0] = 1.0f;
+		toTexture[2][1] = 1.0f;
+		toTexture[3][3] = 1.0f;
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, size, size);
+		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDisable(GL_DEPTH_TEST);
+
+		shadowShader.use();
+		shadowShader.setMat4("projection", toTexture);
+		shadowShader.setMat4("view", glm::inverse(surfaceModel));
+		shadowShader.setMat4("model", casterModel);
+		shadowShader.setFloat("surfaceY", surfaceY);
+		shadowShader.setVec3("lightPos", lightPos);
+		glBindVertexArray(casterVAO);
+		glDrawArrays(GL_TRIANGLES, 0, casterCount);
+
+		glEnable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		return true;
+	}
+
+private:
+	unsigned int fbo;
+	unsigned int size;
+	bool valid;
+	glm::vec3 lastLight;
+	glm::mat4 lastCaster;
+	glm::mat4 lastSurface;
+	float lastSurfaceY;
+};
+#endif
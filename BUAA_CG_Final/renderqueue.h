@@ -0,0 +1,264 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "commandlist.h"
+#include "transforms.h"
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// everything needed to issue one draw, model and colour are the per-object uniforms shared by all our shaders
+// (the model expands into the queue's transform block) and layer selects the image of a packed texture
+struct DrawItem {
+	unsigned int program;
+	unsigned int vao;
+	GLenum mode;
+	int count;
+	bool indexed;
+	GLenum textureTarget;
+	unsigned int texture;
+	GLenum polygonMode;
+	float lineWidth;
+	glm::mat4 model;
+	glm::vec3 colour;
+	int layer = 0; // 1 + the image's index in a TexturePacker, 0 samples the bound texture
+	float radius = 0.0f; // of the mesh's bounding sphere in model space, above 0 lets gpuCulling cull its instances
+};
+
+// Draws are submitted with a 64-bit sort key, radix sorted and recorded into a command list with
+// redundant program, texture and VAO binds skipped. Runs of draws that differ only in their model, colour and
+// layer become one instanced draw of the program's instanced variant, if it has one. Touches no GL state, so
+// any thread can own a queue.
+// Key layout from the most significant bit:
+// pass (4) | transparent (1) | program (10) | texture (12) | vao (12) | depth (24) | unused (1)
+class RenderQueue {
+public:
+	struct Stats {
+		int draws;
+		int programs;
+		int textures;
+		int vaos;
+		int calls; // draw calls, fewer than draws once instanced
+	};
+	// state changes if the draws ran in submission order, and what record() actually emitted
+	Stats submitted;
+	Stats sorted;
+
+	// the shortest run drawn instanced, 0 draws everything one by one
+	int minInstances;
+	// instanced runs of draws with a radius are frustum culled on the GPU at replay instead of drawn whole,
+	// the caller then submits them without culling them itself
+	bool gpuCulling;
+
+	RenderQueue() : minInstances(2), gpuCulling(false), viewProjection(1.0f) {
+		submitted = sorted = Stats{ 0, 0, 0, 0, 0 };
+	}
+
+	// depth is normalized to [0, 1], opaque draws sort front to back and transparent ones back to front
+	static uint64_t makeKey(unsigned int pass, bool transparent, unsigned int program, unsigned int texture, unsigned int vao, float depth) {
+		depth = glm::clamp(depth, 0.0f, 1.0f);
+		uint64_t z = (uint64_t)(depth * 0xFFFFFF);
+		if (transparent)
+			z = 0xFFFFFF - z;
+		uint64_t key = (uint64_t)(pass & 0xF) << 60;
+		key |= (uint64_t)(transparent ? 1 : 0) << 59;
+		// state bits are skipped for transparent draws, their order is decided by depth alone
+		if (!transparent) {
+			key |= (uint64_t)(program & 0x3FF) << 49;
+			key |= (uint64_t)(texture & 0xFFF) << 37;
+			key |= (uint64_t)(vao & 0xFFF) << 25;
+		}
+		key |= z << 1;
+		return key;
+	}
+
+	// recorded whenever the queue switches to the program, for uniforms that are constant over the queue
+	void setProgramSetup(unsigned int program, const std::function<void(CommandList&)>& setup) {
+		setups[program] = setup;
+	}
+
+	// of the view the queue is recorded for, every draw gets its model, normalMatrix and mvp uniforms from it
+	void setViewProjection(const glm::mat4& value) {
+		viewProjection = value;
+	}
+
+	// the variant reads model, normal matrix, colour and layer from the instance attributes of InstanceBuffer
+	// and the view projection from a uniform, the rest of its uniforms come from the program's setup
+	void setInstancedProgram(unsigned int program, unsigned int instancedProgram) {
+		instanced[program] = instancedProgram;
+	}
+
+	void clear() {
+		keys.clear();
+		items.clear();
+	}
+
+	void submit(uint64_t key, const DrawItem& item) {
+		keys.push_back(key);
+		items.push_back(item);
+	}
+
+	void submit(unsigned int pass, bool transparent, float depth, const DrawItem& item) {
+		submit(makeKey(pass, transparent, item.program, item.texture, item.vao, depth), item);
+	}
+
+	void record(CommandList& list) {
+		std::vector<uint32_t> order(items.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = (uint32_t)i;
+		submitted = count(order);
+		radixSort(order);
+		sorted = count(order);
+		sorted.calls = 0;
+
+		// the transform blocks of all draws in one batch, before any command is recorded
+		models.resize(items.size());
+		for (size_t i = 0; i < items.size(); ++i)
+			models[i] = items[i].model;
+		transforms.resize(items.size());
+		ObjectTransform::compute(viewProjection, models.data(), models.size(), transforms.data());
+
+		// filled in sorted order before any is recorded, so the addresses in the list stay valid
+		instances.resize(order.size());
+
+		unsigned int program = 0, texture = 0, vao = 0;
+		int layer = 0;
+		GLenum polygonMode = GL_FILL;
+		bool first = true;
+		for (size_t i = 0; i < order.size();) {
+			const DrawItem& item = items[order[i]];
+			size_t run = 1;
+			bool instancing = false;
+			std::map<unsigned int, unsigned int>::iterator variant = instanced.find(item.program);
+			if (variant != instanced.end() && minInstances > 0) {
+				while (i + run < order.size() && sameMesh(item, items[order[i + run]]))
+					++run;
+				instancing = run >= (size_t)minInstances;
+				if (!instancing)
+					run = 1;
+			}
+			unsigned int itemProgram = instancing ? variant->second : item.program;
+			if (first || itemProgram != program) {
+				program = itemProgram;
+				list.useProgram(program);
+				std::map<unsigned int, std::function<void(CommandList&)> >::iterator it = setups.find(item.program);
+				if (it != setups.end())
+					it->second(list);
+				if (instancing)
+					list.setMat4("viewProjection", viewProjection);
+				// the program still holds whatever layer it drew last
+				layer = -1;
+			}
+			if (item.texture && (first || item.texture != texture)) {
+				texture = item.texture;
+				list.bindTexture(0, item.textureTarget, texture);
+			}
+			if (first || item.vao != vao) {
+				vao = item.vao;
+				list.bindVertexArray(vao);
+			}
+			if (first || item.polygonMode != polygonMode) {
+				polygonMode = item.polygonMode;
+				list.polygonMode(polygonMode);
+				if (polygonMode == GL_LINE)
+					list.lineWidth(item.lineWidth);
+			}
+			first = false;
+			++sorted.calls;
+			if (instancing) {
+				for (size_t k = i; k < i + run; ++k) {
+					const ObjectTransform& transform = transforms[order[k]];
+					instances[k].model = transform.model;
+					instances[k].normal = transform.normal;
+					instances[k].colour = items[order[k]].colour;
+					instances[k].layer = items[order[k]].layer;
+				}
+				if (gpuCulling && item.radius > 0.0f) {
+					glm::vec4 planes[6];
+					frustumPlanes(viewProjection, planes);
+					list.drawInstancedCulled(item.mode, item.count, item.indexed, &instances[i], (int)run, item.radius, planes);
+				} else if (item.indexed)
+					list.drawElementsInstanced(item.mode, item.count, &instances[i], (int)run);
+				else
+					list.drawArraysInstanced(item.mode, 0, item.count, &instances[i], (int)run);
+				i += run;
+				continue;
+			}
+			const ObjectTransform& transform = transforms[order[i]];
+			list.setMat4("model", transform.model);
+			list.setMat3("normalMatrix", transform.normal);
+			list.setMat4("mvp", transform.mvp);
+			list.setVec3("colour", item.colour);
+			if (item.layer != layer) {
+				layer = item.layer;
+				list.setInt("layer", layer);
+			}
+			if (item.indexed)
+				list.drawElements(item.mode, item.count);
+			else
+				list.drawArrays(item.mode, 0, item.count);
+			++i;
+		}
+		if (polygonMode != GL_FILL)
+			list.polygonMode(GL_FILL);
+	}
+
+private:
+	std::vector<uint64_t> keys;
+	std::vector<DrawItem> items;
+	glm::mat4 viewProjection;
+	std::vector<glm::mat4> models;
+	std::vector<ObjectTransform> transforms;
+	std::vector<InstanceData> instances;
+	std::map<unsigned int, unsigned int> instanced;
+	std::map<unsigned int, std::function<void(CommandList&)> > setups;
+
+	Stats count(const std::vector<uint32_t>& order) const {
+		Stats stats = { (int)order.size(), 0, 0, 0, (int)order.size() };
+		for (size_t i = 0; i < order.size(); ++i) {
+			const DrawItem& item = items[order[i]];
+			const DrawItem* prev = i > 0 ? &items[order[i - 1]] : NULL;
+			if (!prev || prev->program != item.program)
+				++stats.programs;
+			if (item.texture && (!prev || prev->texture != item.texture))
+				++stats.textures;
+			if (!prev || prev->vao != item.vao)
+				++stats.vaos;
+		}
+		return stats;
+	}
+
+	// whether two draws can share an instanced draw call
+	static bool sameMesh(const DrawItem& a, const DrawItem& b) {
+		return a.program == b.program && a.vao == b.vao && a.mode == b.mode && a.count == b.count && a.indexed == b.indexed
+			&& a.textureTarget == b.textureTarget && a.texture == b.texture && a.polygonMode == b.polygonMode
+			&& (a.polygonMode != GL_LINE || a.lineWidth == b.lineWidth) && a.radius == b.radius;
+	}
+
+	// stable LSD radix sort over 8-bit digits, digits shared by every key are skipped
+	void radixSort(std::vector<uint32_t>& order) const {
+		std::vector<uint32_t> scratch(order.size());
+		for (int shift = 0; shift < 64; shift += 8) {
+			size_t histogram[256] = {};
+			for (size_t i = 0; i < order.size(); ++i)
+				++histogram[(keys[order[i]] >> shift) & 0xFF];
+			if (order.empty() || histogram[(keys[order[0]] >> shift) & 0xFF] == order.size())
+				continue;
+			size_t offset = 0;
+			for (int d = 0; d < 256; ++d) {
+				size_t n = histogram[d];
+				histogram[d] = offset;
+				offset += n;
+			}
+			for (size_t i = 0; i < order.size(); ++i)
+				scratch[histogram[(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+			order.swap(scratch);
+		}
+	}
+};
+#endif
@@ -0,0 +1,258 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <glad/glad.h>
+
+#include "textureloader.h"
+#include "blockcompress.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <unordered_map>
+
+// Owns textures loaded through a TextureLoader and keeps them inside a memory budget. Every texture tracks the
+// bytes of each resident level and the frame it was last used in. When update() finds the total over the budget it
+// first drops the largest levels of the least recently used textures (raising GL_TEXTURE_BASE_LEVEL and freeing the
+// levels below it) down to a tail of at most tailSize texels on a side, then evicts whole textures in the same order
+// back to the grey placeholder. Textures used in the current frame are never touched. use() reloads what is missing
+// in the background, from the KTX cache for compressed textures, while the texture keeps sampling what it still has.
+class TextureResidency {
+public:
+	struct Counters {
+		size_t budget;
+		size_t residentBytes;
+		size_t loadingBytes; // of reloads in flight
+		int textures;
+		int evictedTextures; // holding the placeholder
+		int droppedLevels; // missing from textures that are not evicted
+		unsigned long long levelEvictions; // since construction
+		unsigned long long textureEvictions;
+		unsigned long long reloads;
+	};
+
+	// in bytes, may be changed at any time
+	size_t budget;
+
+	TextureResidency(TextureLoader& loader, size_t budget, int tailSize = 64) : budget(budget), loader(loader), tailSize(tailSize),
+		frame(0), resident(0), loading(0), levelEvictions(0), textureEvictions(0), reloads(0) {
+		loader.loaded = [this](const TextureLoader::Loaded& loaded) { this->loaded(loaded); };
+	}
+
+	// deletes every texture, the context has to be current
+	~TextureResidency() {
+		loader.loaded = nullptr;
+		for (auto i = entries.begin(); i != entries.end(); ++i) {
+			loader.cancel(i->first);
+			glDeleteTextures(1, &i->first);
+		}
+	}
+
+	// a texture of TextureLoader::request(); with load false it only gets the placeholder until its first use
+	unsigned int request(const std::string& path, GLint wrap, GLint filter, bool mipmaps, bool flip, GLenum compressed = 0, bool load = true) {
+		Entry entry;
+		entry.path = path;
+		entry.mipmaps = mipmaps;
+		entry.flip = flip;
+		entry.compressed = compressed;
+		unsigned int texture;
+		if (load) {
+			texture = loader.request(path, wrap, filter, mipmaps, flip, compressed);
+			entry.loading = true;
+		} else {
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, TextureLoader::minFilter(filter, mipmaps));
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+			TextureLoader::placeholder();
+		}
+		entry.lastUsed = frame;
+		entries[texture] = entry;
+		return texture;
+	}
+
+	// deletes the texture now
+	void release(unsigned int texture) {
+		auto i = entries.find(texture);
+		if (i == entries.end())
+			return;
+		loader.cancel(texture);
+		resident -= i->second.bytes;
+		if (i->second.loading)
+			loading -= i->second.incoming;
+		entries.erase(i);
+		glDeleteTextures(1, &texture);
+	}
+
+	// stamps the texture with the current frame and returns it for binding; a texture missing levels is reloaded
+	unsigned int use(unsigned int texture) {
+		auto i = entries.find(texture);
+		if (i == entries.end())
+			return texture;
+		Entry& entry = i->second;
+		entry.lastUsed = frame;
+		if (!entry.loading && (entry.levels == 0 || entry.baseLevel > 0))
+			wanted.push_back(texture);
+		return texture;
+	}
+
+	// once per frame after drawing: starts the reloads use() asked for and evicts down to the budget, then begins
+	// the next frame
+	void update() {
+		std::vector<std::pair<unsigned long long, unsigned int> > order;
+		for (size_t w = 0; w < wanted.size(); ++w) {
+			auto i = entries.find(wanted[w]);
+			if (i == entries.end() || i->second.loading)
+				continue;
+			Entry& entry = i->second;
+			// unknown until the first load, counted when it arrives
+			size_t extra = entry.levels ? chainBytes(entry, 0) - entry.bytes : 0;
+			evict(extra, order);
+			// an evicted texture comes back whatever the budget says, missing levels only if they fit
+			if (entry.levels && entry.baseLevel > 0 && resident + loading + extra > budget)
+				continue;
+			entry.loading = true;
+			entry.incoming = extra;
+			loading += extra;
+			++reloads;
+			// a streamed reload only specifies the levels that were dropped
+			loader.load(i->first, entry.path, entry.mipmaps, entry.flip, entry.compressed, entry.levels ? entry.baseLevel : -1);
+		}
+		wanted.clear();
+		evict(0, order);
+		++frame;
+	}
+
+	Counters counters() const {
+		Counters counters = { budget, resident, loading, (int)entries.size(), 0, 0, levelEvictions, textureEvictions, reloads };
+		for (auto i = entries.begin(); i != entries.end(); ++i) {
+			if (i->second.levels == 0)
+				++counters.evictedTextures;
+			else
+				counters.droppedLevels += i->second.baseLevel;
+		}
+		return counters;
+	}
+
+	void report(std::ostream& out) const {
+		Counters c = counters();
+		out << "texture residency: " << c.residentBytes / 1024 << " / " << c.budget / 1024 << " KB, " << c.textures << " textures ("
+			<< c.evictedTextures << " on the placeholder, " << c.droppedLevels << " levels dropped), " << c.loadingBytes / 1024 << " KB loading, "
+			<< c.levelEvictions << " level and " << c.textureEvictions << " texture evictions, " << c.reloads << " reloads" << std::endl;
+	}
+
+private:
+	struct Entry {
+		std::string path;
+		bool mipmaps;
+		bool flip;
+		GLenum compressed;
+		int width, height;
+		int channels;
+		GLenum format; // compressed format of the loaded levels, 0 for uncompressed
+		int levels; // 0 while it holds the placeholder
+		int baseLevel; // levels below it were dropped
+		size_t bytes; // resident
+		size_t incoming; // counted against the budget while a reload is in flight
+		bool loading;
+		unsigned long long lastUsed;
+
+		Entry() : mipmaps(false), flip(false), compressed(0), width(0), height(0), channels(0), format(0), levels(0), baseLevel(0),
+			bytes(0), incoming(0), loading(false), lastUsed(0) {}
+	};
+
+	TextureLoader& loader;
+	int tailSize;
+	unsigned long long frame;
+	std::unordered_map<unsigned int, Entry> entries;
+	std::vector<unsigned int> wanted;
+	size_t resident;
+	size_t loading;
+	unsigned long long levelEvictions;
+	unsigned long long textureEvictions;
+	unsigned long long reloads;
+
+	static size_t levelBytes(const Entry& entry, int level) {
+		int w = std::max(1, entry.width >> level), h = std::max(1, entry.height >> level);
+		return entry.format ? BlockCompressor::levelBytes(entry.format, w, h) : (size_t)w * h * entry.channels;
+	}
+
+	// of the levels from `base` on
+	static size_t chainBytes(const Entry& entry, int base) {
+		size_t bytes = 0;
+		for (int i = base; i < entry.levels; ++i)
+			bytes += levelBytes(entry, i);
+		return bytes;
+	}
+
+	void loaded(const TextureLoader::Loaded& loaded) {
+		auto i = entries.find(loaded.texture);
+		if (i == entries.end())
+			return;
+		Entry& entry = i->second;
+		loading -= entry.incoming;
+		entry.incoming = 0;
+		entry.loading = false;
+		if (loaded.levels == 0)
+			return;
+		resident -= entry.bytes;
+		entry.width = loaded.width;
+		entry.height = loaded.height;
+		entry.channels = loaded.channels;
+		entry.format = loaded.compressed;
+		entry.levels = loaded.levels;
+		entry.baseLevel = 0;
+		entry.bytes = chainBytes(entry, 0);
+		resident += entry.bytes;
+	}
+
+	// drops levels, then whole textures, least recently used first, until `extra` more bytes fit the budget.
+	// `order` holds the candidates by last use, it is filled on the first call of a frame that has to evict
+	void evict(size_t extra, std::vector<std::pair<unsigned long long, unsigned int> >& order) {
+		if (resident + loading + extra <= budget)
+			return;
+		if (order.empty()) {
+			for (auto i = entries.begin(); i != entries.end(); ++i)
+				if (i->second.lastUsed < frame && i->second.levels && !i->second.loading)
+					order.push_back(std::make_pair(i->second.lastUsed, i->first));
+			std::sort(order.begin(), order.end());
+		}
+		for (size_t i = 0; i < order.size() && resident + loading + extra > budget; ++i) {
+			Entry& entry = entries[order[i].second];
+			while (entry.levels && entry.baseLevel + 1 < entry.levels && std::max(entry.width, entry.height) >> entry.baseLevel > tailSize
+				&& resident + loading + extra > budget)
+				dropLevel(order[i].second, entry);
+		}
+		for (size_t i = 0; i < order.size() && resident + loading + extra > budget; ++i)
+			if (entries[order[i].second].levels)
+				evictTexture(order[i].second, entries[order[i].second]);
+	}
+
+	// frees the base level by giving it a zero size, the texture stays complete from the next level on
+	void dropLevel(unsigned int texture, Entry& entry) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, entry.baseLevel, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		size_t bytes = levelBytes(entry, entry.baseLevel);
+		resident -= bytes;
+		entry.bytes -= bytes;
+		++entry.baseLevel;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.baseLevel);
+		++levelEvictions;
+	}
+
+	void evictTexture(unsigned int texture, Entry& entry) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		for (int i = 1; i < entry.levels; ++i)
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		TextureLoader::placeholder();
+		resident -= entry.bytes;
+		entry.bytes = 0;
+		entry.levels = 0;
+		entry.baseLevel = 0;
+		++textureEvictions;
+	}
+};
+#endif
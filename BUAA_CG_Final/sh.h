@@ -0,0 +1,224 @@
+#ifndef SH_H
+#define SH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SH_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// Projects a cubemap onto 9 spherical-harmonics irradiance coefficients.
+// The cubemap is downsampled by its mip chain and read back through a PBO,
+// so request() never stalls; poll() picks up the result once the fence signals.
+class SHIrradiance {
+public:
+	glm::vec3 coeffs[9];
+	bool ready;
+
+	SHIrradiance(unsigned int cubemap, unsigned int maxSize = 32) : ready(false), cubemap(cubemap), pending(false), dirty(false), fence(0) {
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		int faceSize;
+		glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &faceSize);
+		level = 0;
+		while ((faceSize >> level) > (int)maxSize)
+			++level;
+		size = faceSize >> level;
+		if (size < 1)
+			size = 1;
+		faceTexels = size * size;
+		faceStride = (faceTexels + 3) & ~3;
+
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, 6 * faceTexels * 4 * sizeof(float), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		buildTexelTable();
+		for (int i = 0; i < 9; ++i)
+			coeffs[i] = glm::vec3(0.0f);
+	}
+
+	~SHIrradiance() {
+		if (fence)
+			glDeleteSync(fence);
+		glDeleteBuffers(1, &pbo);
+	}
+
+	// call after the environment pass has re-rendered the cubemap
+	void request() {
+		if (pending) {
+			dirty = true;
+			return;
+		}
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		for (int i = 0; i < 6; ++i) {
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, GL_RGBA, GL_FLOAT, (void*)(i * faceTexels * 4 * sizeof(float)));
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending = true;
+	}
+
+	// non-blocking, returns true when new coefficients became available this call
+	bool poll() {
+		if (!pending)
+			return false;
+		GLenum state = glClientWaitSync(fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			return false;
+		glDeleteSync(fence);
+		fence = 0;
+		pending = false;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		const float* texels = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 6 * faceTexels * 4 * sizeof(float), GL_MAP_READ_BIT);
+		if (texels) {
+			project(texels);
+			ready = true;
+		} else {
+			std::cout << "ERROR::SH::PBO_MAP_FAILED" << std::endl;
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (dirty) {
+			dirty = false;
+			request();
+		}
+		return ready;
+	}
+
+private:
+	unsigned int cubemap;
+	unsigned int pbo;
+	int level;
+	int size;
+	int faceTexels;
+	int faceStride;
+	bool pending;
+	bool dirty;
+	GLsync fence;
+	// per texel direction and solid angle, SoA, each face padded to a multiple of 4
+	std::vector<float> dirX, dirY, dirZ, weight;
+
+	void buildTexelTable() {
+		dirX.assign(6 * faceStride, 0.0f);
+		dirY.assign(6 * faceStride, 0.0f);
+		dirZ.assign(6 * faceStride, 0.0f);
+		weight.assign(6 * faceStride, 0.0f);
+		float total = 0.0f;
+		for (int face = 0; face < 6; ++face) {
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					float s = 2.0f * (x + 0.5f) / size - 1.0f;
+					float t = 2.0f * (y + 0.5f) / size - 1.0f;
+					glm::vec3 d;
+					switch (face) {
+					case 0: d = glm::vec3(1.0f, -t, -s); break;
+					case 1: d = glm::vec3(-1.0f, -t, s); break;
+					case 2: d = glm::vec3(s, 1.0f, t); break;
+					case 3: d = glm::vec3(s, -1.0f, -t); break;
+					case 4: d = glm::vec3(s, -t, 1.0f); break;
+					default: d = glm::vec3(-s, -t, -1.0f); break;
+					}
+					float len2 = 1.0f + s * s + t * t;
+					d /= std::sqrt(len2);
+					int i = face * faceStride + y * size + x;
+					dirX[i] = d.x;
+					dirY[i] = d.y;
+					dirZ[i] = d.z;
+					// differential solid angle of a texel on the unit cube face
+					weight[i] = 4.0f / (size * size) / (len2 * std::sqrt(len2));
+					total += weight[i];
+				}
+			}
+		}
+		// renormalize so the weights integrate to exactly 4*pi
+		float scale = 4.0f * 3.141592654f / total;
+		for (size_t i = 0; i < weight.size(); ++i)
+			weight[i] *= scale;
+	}
+
+	void project(const float* texels) {
+		float acc[9][3] = {};
+		for (int face = 0; face < 6; ++face) {
+			const float* src = texels + face * faceTexels * 4;
+			const float* px = &dirX[face * faceStride];
+			const float* py = &dirY[face * faceStride];
+			const float* pz = &dirZ[face * faceStride];
+			const float* pw = &weight[face * faceStride];
+			int i = 0;
+#ifdef SH_USE_SSE
+			__m128 sum[9][3];
+			for (int k = 0; k < 9; ++k)
+				sum[k][0] = sum[k][1] = sum[k][2] = _mm_setzero_ps();
+			for (; i + 4 <= faceTexels; i += 4) {
+				__m128 r = _mm_loadu_ps(src + 4 * i);
+				__m128 g = _mm_loadu_ps(src + 4 * i + 4);
+				__m128 b = _mm_loadu_ps(src + 4 * i + 8);
+				__m128 a = _mm_loadu_ps(src + 4 * i + 12);
+				_MM_TRANSPOSE4_PS(r, g, b, a);
+				__m128 w = _mm_loadu_ps(pw + i);
+				__m128 x = _mm_loadu_ps(px + i);
+				__m128 y = _mm_loadu_ps(py + i);
+				__m128 z = _mm_loadu_ps(pz + i);
+				__m128 basis[9];
+				basis[0] = w;
+				basis[1] = _mm_mul_ps(w, y);
+				basis[2] = _mm_mul_ps(w, z);
+				basis[3] = _mm_mul_ps(w, x);
+				basis[4] = _mm_mul_ps(basis[3], y);
+				basis[5] = _mm_mul_ps(basis[1], z);
+				basis[6] = _mm_mul_ps(w, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z, z)), _mm_set1_ps(1.0f)));
+				basis[7] = _mm_mul_ps(basis[3], z);
+				basis[8] = _mm_mul_ps(w, _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+				for (int k = 0; k < 9; ++k) {
+					sum[k][0] = _mm_add_ps(sum[k][0], _mm_mul_ps(basis[k], r));
+					sum[k][1] = _mm_add_ps(sum[k][1], _mm_mul_ps(basis[k], g));
+					sum[k][2] = _mm_add_ps(sum[k][2], _mm_mul_ps(basis[k], b));
+				}
+			}
+			for (int k = 0; k < 9; ++k) {
+				for (int c = 0; c < 3; ++c) {
+					float lanes[4];
+					_mm_storeu_ps(lanes, sum[k][c]);
+					acc[k][c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+				}
+			}
+#endif
+			for (; i < faceTexels; ++i) {
+				float w = pw[i], x = px[i], y = py[i], z = pz[i];
+				float basis[9] = { w, w * y, w * z, w * x, w * x * y, w * y * z, w * (3.0f * z * z - 1.0f), w * x * z, w * (x * x - y * y) };
+				for (int k = 0; k < 9; ++k) {
+					acc[k][0] += basis[k] * src[4 * i];
+					acc[k][1] += basis[k] * src[4 * i + 1];
+					acc[k][2] += basis[k] * src[4 * i + 2];
+				}
+			}
+		}
+
+		// SH basis constants, then the clamped cosine convolution (pi, 2pi/3, pi/4)
+		const float PI = 3.141592654f;
+		const float basisScale[9] = {
+			0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f
+		};
+		const float band[9] = {
+			PI, 2.0f * PI / 3.0f, 2.0f * PI / 3.0f, 2.0f * PI / 3.0f, PI / 4.0f, PI / 4.0f, PI / 4.0f, PI / 4.0f, PI / 4.0f
+		};
+		for (int k = 0; k < 9; ++k) {
+			// stored pre-multiplied by the basis constant once more, so the shader evaluates plain polynomials
+			float s = basisScale[k] * basisScale[k] * band[k];
+			coeffs[k] = glm::vec3(acc[k][0], acc[k][1], acc[k][2]) * s;
+		}
+	}
+};
+#endif
@@ -5,17 +5,22 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
-class Shader {
-public:
-	unsigned int ID;
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
+// shader sources read from disk, needs no GL context so it can be done off the GL thread
+struct ShaderSource {
+	std::string vertexCode;
+	std::string fragmentCode;
+	std::string geometryCode;
+	// outputs of the last stage captured interleaved by transform feedback, empty for none
+	std::vector<std::string> feedback;
+
+	ShaderSource() {}
+
+	ShaderSource(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
 		std::ifstream vShaderFile;
 		std::ifstream fShaderFile;
 		std::ifstream gShaderFile;
@@ -42,8 +47,36 @@ public:
 		} catch (std::ifstream::failure e) {
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
+	}
+
+	// compiles a variant of the sources, `#define name` goes right after each stage's #version line
+	void define(const std::string& name) {
+		std::string* stages[] = { &vertexCode, &fragmentCode, &geometryCode };
+		for (std::string* code : stages) {
+			size_t line = code->find('\n');
+			if (line != std::string::npos)
+				code->insert(line + 1, "#define " + name + "\n");
+		}
+	}
+};
+
+class Shader {
+public:
+	unsigned int ID;
+	Shader() : ID(0) {}
+
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+		compile(ShaderSource(vertexPath, fragmentPath, geometryPath));
+	}
+
+	Shader(const ShaderSource& source) {
+		compile(source);
+	}
+
+	void compile(const ShaderSource& source) {
+		bool hasGeometry = !source.geometryCode.empty();
+		const char* vShaderCode = source.vertexCode.c_str();
+		const char* fShaderCode = source.fragmentCode.c_str();
 		unsigned int vertex, fragment;
 		vertex = glCreateShader(GL_VERTEX_SHADER);
 		glShaderSource(vertex, 1, &vShaderCode, NULL);
@@ -54,8 +87,8 @@ public:
 		glCompileShader(fragment);
 		checkCompileErrors(fragment, "FRAGMENT");
 		unsigned int geometry;
-		if (geometryPath != nullptr) {
-			const char* gShaderCode = geometryCode.c_str();
+		if (hasGeometry) {
+			const char* gShaderCode = source.geometryCode.c_str();
 			geometry = glCreateShader(GL_GEOMETRY_SHADER);
 			glShaderSource(geometry, 1, &gShaderCode, NULL);
 			glCompileShader(geometry);
@@ -64,13 +97,19 @@ public:
 		ID = glCreateProgram();
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
+		if (hasGeometry)
 			glAttachShader(ID, geometry);
+		if (!source.feedback.empty()) {
+			std::vector<const char*> varyings;
+			for (const std::string& varying : source.feedback)
+				varyings.push_back(varying.c_str());
+			glTransformFeedbackVaryings(ID, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+		}
 		glLinkProgram(ID);
 		checkCompileErrors(ID, "PROGRAM");
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
+		if (hasGeometry)
 			glDeleteShader(geometry);
 
 	}
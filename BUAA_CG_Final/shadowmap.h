@@ -0,0 +1,192 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "commandlist.h"
+#include "instancing.h"
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+
+// one mesh drawn into the depth pass, radius is its bounding sphere in model space
+struct ShadowCaster {
+	glm::mat4 model;
+	unsigned int vao;
+	unsigned int count;
+	float radius;
+};
+
+// Depth-texture shadow map for a point light, fitted to the bounds of all casters.
+// All casters go into a single depth pass, which is skipped while nothing has moved.
+class ShadowMap {
+public:
+	unsigned int texture;
+	glm::mat4 lightSpace;
+	bool perspective;
+
+	ShadowMap(unsigned int size = 2048, bool perspective = true) : perspective(perspective), size(size), valid(false) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		// linear filtering with compare mode gives a 2x2 hardware PCF per tap
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Shadow map framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		lightSpace = glm::mat4(1.0f);
+	}
+
+	~ShadowMap() {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &texture);
+	}
+
+	// fits the light frustum around all casters, returns true if the projection changed
+	bool fit(const glm::vec3& lightPos, const std::vector<ShadowCaster>& casters) {
+		if (casters.empty())
+			return false;
+		// bounding sphere of all caster bounding spheres
+		glm::vec3 lo(1e30f), hi(-1e30f);
+		std::vector<glm::vec4> spheres(casters.size());
+		for (size_t i = 0; i < casters.size(); ++i) {
+			const glm::mat4& m = casters[i].model;
+			float scale = std::sqrt(glm::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+				glm::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2])))));
+			spheres[i] = glm::vec4(glm::vec3(m[3]), casters[i].radius * scale);
+			lo = glm::min(lo, glm::vec3(spheres[i]) - spheres[i].w);
+			hi = glm::max(hi, glm::vec3(spheres[i]) + spheres[i].w);
+		}
+		glm::vec3 center = (lo + hi) * 0.5f;
+		float radius = 0.0f;
+		for (size_t i = 0; i < spheres.size(); ++i)
+			radius = glm::max(radius, glm::length(glm::vec3(spheres[i]) - center) + spheres[i].w);
+
+		glm::vec3 dir = center - lightPos;
+		float dist = glm::length(dir);
+		dir = dist > 0.0f ? dir / dist : glm::vec3(0.0f, -1.0f, 0.0f);
+		glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+		glm::mat4 fitted;
+		if (perspective && dist > radius * 1.01f) {
+			float fov = 2.0f * std::asin(radius / dist);
+			glm::mat4 view = glm::lookAt(lightPos, center, up);
+			// the far plane reaches past the casters so receivers behind them still land inside the map
+			fitted = glm::perspective(fov, 1.0f, dist - radius, (dist + radius) * 4.0f) * view;
+		} else {
+			// orthographic along the light direction, also used when the light sits inside the bounds
+			glm::mat4 view = glm::lookAt(center - dir * (radius * 2.0f), center, up);
+			fitted = glm::ortho(-radius, radius, -radius, radius, 0.0f, radius * 8.0f) * view;
+		}
+		bool changed = fitted != lightSpace;
+		lightSpace = fitted;
+		return changed;
+	}
+
+	// refits and redraws every caster in one depth pass if the light or any caster moved, consecutive casters
+	// of one mesh are a single instanced draw when the INSTANCED variant of the depth shader is given
+	bool render(Shader& depthShader, const glm::vec3& lightPos, const std::vector<ShadowCaster>& casters, Shader* instancedShader = nullptr) {
+		fit(lightPos, casters);
+		bool moved = lightSpace != lastLightSpace || casters.size() != lastModels.size();
+		for (size_t i = 0; !moved && i < casters.size(); ++i)
+			moved = casters[i].model != lastModels[i];
+		if (valid && !moved)
+			return false;
+		valid = true;
+		lastLightSpace = lightSpace;
+		lastModels.resize(casters.size());
+		for (size_t i = 0; i < casters.size(); ++i)
+			lastModels[i] = casters[i].model;
+
+		// the bound framebuffer is put back, headless the default one draws nowhere
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		GLint framebuffer;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, size, size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		if (instancedShader) {
+			instancedShader->use();
+			instancedShader->setMat4("lightSpace", lightSpace);
+		}
+		depthShader.use();
+		depthShader.setMat4("lightSpace", lightSpace);
+		unsigned int program = depthShader.ID;
+		for (size_t i = 0; i < casters.size();) {
+			size_t run = 1;
+			while (instancedShader && i + run < casters.size() && casters[i + run].vao == casters[i].vao && casters[i + run].count == casters[i].count)
+				++run;
+			Shader& shader = run > 1 ? *instancedShader : depthShader;
+			if (shader.ID != program) {
+				program = shader.ID;
+				shader.use();
+			}
+			glBindVertexArray(casters[i].vao);
+			if (run > 1) {
+				instances.resize(run);
+				for (size_t k = 0; k < run; ++k) {
+					instances[k].model = casters[i + k].model;
+					instances[k].normal = glm::mat3(1.0f);
+					instances[k].colour = glm::vec3(1.0f);
+					instances[k].layer = 0;
+				}
+				instanceBuffer.bind(instances.data(), (int)run);
+				glDrawArraysInstanced(GL_TRIANGLES, 0, casters[i].count, (GLsizei)run);
+				instanceBuffer.unbind();
+			} else {
+				depthShader.setMat4("model", casters[i].model);
+				glDrawArrays(GL_TRIANGLES, 0, casters[i].count);
+			}
+			i += run;
+		}
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		return true;
+	}
+
+	// forces the next render() to redraw the depth pass
+	void invalidate() {
+		valid = false;
+	}
+
+	// records the setup of the current receiver program, pcfRadius 0 takes a single hardware-filtered tap
+	void bind(CommandList& list, int unit, int pcfRadius) const {
+		list.bindTexture(unit, GL_TEXTURE_2D, texture);
+		list.setInt("shadowMap", unit);
+		list.setInt("pcfRadius", pcfRadius);
+		list.setMat4("lightSpace", lightSpace);
+	}
+
+private:
+	unsigned int fbo;
+	unsigned int size;
+	bool valid;
+	glm::mat4 lastLightSpace;
+	std::vector<glm::mat4> lastModels;
+	std::vector<InstanceData> instances;
+	InstanceBuffer instanceBuffer;
+};
+#endif
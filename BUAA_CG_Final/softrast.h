@@ -0,0 +1,557 @@
+#ifndef SOFT_RAST_H
+#define SOFT_RAST_H
+
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFT_USE_SSE
+#include <emmintrin.h>
+#endif
+
+const int SOFT_MAX_VARYINGS = 12;
+const int SOFT_TILE_SIZE = 64; // a multiple of the 8-pixel span
+const int SOFT_SETUP_CHUNK = 4096; // triangles per setup job
+
+// output of the vertex stage: clip-space position and the values interpolated for the fragment stage
+struct SoftVertex {
+	glm::vec4 position;
+	float varyings[SOFT_MAX_VARYINGS];
+};
+
+// C++ counterpart of a vertex and fragment shader pair
+class SoftShader {
+public:
+	int varyings;
+
+	SoftShader(int varyings) : varyings(varyings) {}
+	virtual ~SoftShader() {}
+
+	// in points at the vertex in the draw's interleaved vertex data
+	virtual void vertex(const float* in, SoftVertex& out) const = 0;
+	// varyings are perspective-correct
+	virtual glm::vec4 fragment(const float* varyings) const = 0;
+};
+
+// RGBA8 colour and float depth, row 0 is the bottom row like an OpenGL framebuffer
+class SoftTarget {
+public:
+	int width;
+	int height;
+	std::vector<unsigned char> colour;
+	std::vector<float> depth;
+
+	SoftTarget(int width = 0, int height = 0) {
+		resize(width, height);
+	}
+
+	void resize(int width, int height) {
+		this->width = width;
+		this->height = height;
+		colour.assign((size_t)width * height * 4, 0);
+		depth.assign((size_t)width * height, 1.0f);
+	}
+
+	glm::vec4 fetch(int x, int y) const {
+		const unsigned char* c = &colour[((size_t)y * width + x) * 4];
+		return glm::vec4(c[0], c[1], c[2], c[3]) / 255.0f;
+	}
+
+	// bilinear with clamped edges, (u, v) in [0, 1] from the bottom left
+	glm::vec4 sample(float u, float v) const {
+		float x = u * width - 0.5f, y = v * height - 0.5f;
+		int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+		float fx = x - x0, fy = y - y0;
+		int x1 = glm::clamp(x0 + 1, 0, width - 1), y1 = glm::clamp(y0 + 1, 0, height - 1);
+		x0 = glm::clamp(x0, 0, width - 1);
+		y0 = glm::clamp(y0, 0, height - 1);
+		return glm::mix(glm::mix(fetch(x0, y0), fetch(x1, y0), fx), glm::mix(fetch(x0, y1), fetch(x1, y1), fx), fy);
+	}
+
+	// writes the colour as a binary PPM, top row first
+	bool save(const char* path) const {
+		FILE* file = fopen(path, "wb");
+		if (!file) {
+			std::cout << "ERROR::SOFTWARE::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+			return false;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		std::vector<unsigned char> row(width * 3);
+		for (int y = height - 1; y >= 0; --y) {
+			for (int x = 0; x < width; ++x)
+				for (int c = 0; c < 3; ++c)
+					row[x * 3 + c] = colour[((size_t)y * width + x) * 4 + c];
+			fwrite(row.data(), 1, row.size(), file);
+		}
+		fclose(file);
+		return true;
+	}
+};
+
+// 8-bit image sampled bilinearly with GL_REPEAT, rows bottom up as stb_image loads them flipped
+class SoftTexture {
+public:
+	int width;
+	int height;
+	int channels;
+	std::vector<unsigned char> texels;
+
+	SoftTexture() : width(0), height(0), channels(0) {}
+
+	glm::vec4 sample(const glm::vec2& uv) const {
+		if (texels.empty())
+			return glm::vec4(1.0f);
+		float x = uv.x * width - 0.5f, y = uv.y * height - 0.5f;
+		float fx0 = std::floor(x), fy0 = std::floor(y);
+		float fx = x - fx0, fy = y - fy0;
+		int x0 = wrap((int)fx0, width), y0 = wrap((int)fy0, height);
+		int x1 = wrap(x0 + 1, width), y1 = wrap(y0 + 1, height);
+		return glm::mix(glm::mix(fetch(x0, y0), fetch(x1, y0), fx), glm::mix(fetch(x0, y1), fetch(x1, y1), fx), fy);
+	}
+
+private:
+	static int wrap(int i, int n) {
+		i %= n;
+		return i < 0 ? i + n : i;
+	}
+
+	glm::vec4 fetch(int x, int y) const {
+		const unsigned char* t = &texels[((size_t)y * width + x) * channels];
+		glm::vec4 c(t[0], channels > 1 ? t[1] : t[0], channels > 2 ? t[2] : t[0], channels > 3 ? t[3] : 255);
+		return c / 255.0f;
+	}
+};
+
+// six faces in GL order (+X, -X, +Y, -Y, +Z, -Z) addressed like a GL cubemap, linear and clamped per face
+class SoftCubemap {
+public:
+	SoftTarget faces[6];
+
+	void resize(int size) {
+		for (int i = 0; i < 6; ++i)
+			faces[i].resize(size, size);
+	}
+
+	glm::vec4 sample(const glm::vec3& r) const {
+		glm::vec3 a = glm::abs(r);
+		int face;
+		float sc, tc, ma;
+		if (a.x >= a.y && a.x >= a.z) {
+			face = r.x > 0.0f ? 0 : 1;
+			sc = r.x > 0.0f ? -r.z : r.z;
+			tc = -r.y;
+			ma = a.x;
+		} else if (a.y >= a.z) {
+			face = r.y > 0.0f ? 2 : 3;
+			sc = r.x;
+			tc = r.y > 0.0f ? r.z : -r.z;
+			ma = a.y;
+		} else {
+			face = r.z > 0.0f ? 4 : 5;
+			sc = r.z > 0.0f ? r.x : -r.x;
+			tc = -r.y;
+			ma = a.z;
+		}
+		return faces[face].sample((sc / ma + 1.0f) * 0.5f, (tc / ma + 1.0f) * 0.5f);
+	}
+};
+
+// Tiled software rasterizer. draw() runs the vertex shader, near-plane clipping and triangle setup in
+// chunks on the job pool and bins what covers a pixel centre into SOFT_TILE_SIZE tiles, in submission order;
+// end() rasterizes every tile as its own job, evaluating edge functions and depth over 8-pixel spans.
+// Depth test is GL_LESS and nothing is culled, like the GL path.
+class SoftRasterizer {
+public:
+	struct Stats {
+		int draws;
+		long long triangles; // set up after clipping and line expansion, including those that cover no pixel
+		long long binned;
+		long long fragments; // passed the depth test and shaded
+	};
+	Stats stats;
+
+	SoftRasterizer(JobPool& jobs) : jobs(jobs), target(NULL), tilesX(0), tilesY(0) {
+		stats.draws = 0;
+		stats.triangles = stats.binned = stats.fragments = 0;
+	}
+
+	// starts a frame into target, colour and depth are cleared tile by tile in end()
+	void begin(SoftTarget& target, const glm::vec4& clearColour) {
+		this->target = &target;
+		this->clearColour = clearColour;
+		tilesX = (target.width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		tilesY = (target.height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		bins.resize(tilesX * tilesY);
+		for (size_t i = 0; i < bins.size(); ++i)
+			bins[i].clear();
+		vertices.clear();
+		triangles.clear();
+		shaders.clear();
+		stats.draws = 0;
+		stats.triangles = stats.binned = stats.fragments = 0;
+	}
+
+	// stride is in floats, indices may be NULL for non-indexed triangles; the shader must outlive end()
+	void draw(const SoftShader& shader, const float* in, int stride, int vertexCount, const unsigned int* indices, int indexCount,
+		bool wireframe = false, float lineWidth = 1.0f) {
+		int draw = (int)shaders.size();
+		shaders.push_back(&shader);
+		++stats.draws;
+
+		// indexed vertices may be shared across chunks, so they are all shaded up front
+		if (indices) {
+			shaded.resize(vertexCount);
+			std::vector<std::function<void()> > shade;
+			for (int first = 0; first < vertexCount; first += SOFT_SETUP_CHUNK * 3) {
+				shade.push_back([&, first]() {
+					int last = std::min(vertexCount, first + SOFT_SETUP_CHUNK * 3);
+					for (int i = first; i < last; ++i)
+						shader.vertex(in + (size_t)i * stride, shaded[i]);
+				});
+			}
+			jobs.run(shade);
+		}
+
+		int count = (indices ? indexCount : vertexCount) / 3;
+		int chunks = (count + SOFT_SETUP_CHUNK - 1) / SOFT_SETUP_CHUNK;
+		if ((int)batches.size() < chunks)
+			batches.resize(chunks);
+		std::vector<std::function<void()> > setup;
+		for (int c = 0; c < chunks; ++c) {
+			setup.push_back([&, c]() {
+				Batch& batch = batches[c];
+				batch.vertices.clear();
+				batch.triangles.clear();
+				batch.setup = 0;
+				int first = c * SOFT_SETUP_CHUNK, last = std::min(count, first + SOFT_SETUP_CHUNK);
+				if (!indices) {
+					batch.shaded.resize((last - first) * 3);
+					for (int i = 0; i < (last - first) * 3; ++i)
+						shader.vertex(in + ((size_t)first * 3 + i) * stride, batch.shaded[i]);
+				}
+				for (int t = first; t < last; ++t) {
+					const SoftVertex* v[3];
+					for (int k = 0; k < 3; ++k)
+						v[k] = indices ? &shaded[indices[t * 3 + k]] : &batch.shaded[(t - first) * 3 + k];
+					clipAndSetup(batch, draw, v, shader.varyings, wireframe, lineWidth);
+				}
+			});
+		}
+		jobs.run(setup);
+
+		// chunks are appended in order, so triangles stay in submission order inside every bin
+		for (int c = 0; c < chunks; ++c) {
+			Batch& batch = batches[c];
+			unsigned int base = (unsigned int)vertices.size();
+			vertices.insert(vertices.end(), batch.vertices.begin(), batch.vertices.end());
+			stats.triangles += batch.setup;
+			for (size_t i = 0; i < batch.triangles.size(); ++i) {
+				Triangle& t = batch.triangles[i];
+				for (int k = 0; k < 3; ++k)
+					t.v[k] += base;
+				unsigned int index = (unsigned int)triangles.size();
+				triangles.push_back(t);
+				for (int ty = t.minY / SOFT_TILE_SIZE; ty <= t.maxY / SOFT_TILE_SIZE; ++ty)
+					for (int tx = t.minX / SOFT_TILE_SIZE; tx <= t.maxX / SOFT_TILE_SIZE; ++tx)
+						bins[ty * tilesX + tx].push_back(index);
+			}
+			stats.binned += batch.triangles.size();
+		}
+	}
+
+	// rasterizes all binned triangles into the target
+	void end() {
+		std::vector<std::function<void()> > tiles;
+		std::atomic<long long> fragments(0);
+		for (int ty = 0; ty < tilesY; ++ty)
+			for (int tx = 0; tx < tilesX; ++tx)
+				tiles.push_back([this, tx, ty, &fragments]() { fragments += rasterTile(tx, ty); });
+		jobs.run(tiles);
+		stats.fragments = fragments;
+	}
+
+private:
+	// window position of a vertex, z in [0, 1]
+	struct ScreenVertex {
+		float x, y, z, invW;
+		const SoftVertex* vertex;
+	};
+
+	struct Triangle {
+		int draw;
+		unsigned int v[3];
+		float invW[3];
+		// edge functions A x + B y + C, edge k is opposite vertex k and positive inside
+		float A[3], B[3], C[3];
+		bool topLeft[3];
+		float zA, zB, zC;
+		float invArea;
+		int minX, minY, maxX, maxY;
+	};
+
+	// output of one setup job, vertex indices are local until the batch is appended
+	struct Batch {
+		std::vector<SoftVertex> shaded;
+		std::vector<SoftVertex> vertices;
+		std::vector<Triangle> triangles;
+		long long setup;
+	};
+
+	JobPool& jobs;
+	SoftTarget* target;
+	glm::vec4 clearColour;
+	int tilesX, tilesY;
+	std::vector<SoftVertex> shaded;
+	std::vector<Batch> batches;
+	std::vector<SoftVertex> vertices;
+	std::vector<Triangle> triangles;
+	std::vector<const SoftShader*> shaders;
+	std::vector<std::vector<unsigned int> > bins;
+
+	// Sutherland-Hodgman against z > -w, the only plane that can produce w <= 0; x, y and far are left
+	// to the bounding box and the depth test
+	void clipAndSetup(Batch& batch, int draw, const SoftVertex* const* v, int varyings, bool wireframe, float lineWidth) const {
+		float d[3];
+		int inside = 0;
+		for (int k = 0; k < 3; ++k) {
+			d[k] = v[k]->position.z + v[k]->position.w;
+			if (d[k] > 0.0f)
+				++inside;
+		}
+		if (inside == 3) {
+			setup(batch, draw, v, 3, 0, wireframe, lineWidth);
+			return;
+		}
+		if (inside == 0)
+			return;
+		SoftVertex clipped[2];
+		const SoftVertex* polygon[4];
+		int n = 0, m = 0;
+		unsigned int clippedMask = 0;
+		for (int k = 0; k < 3; ++k) {
+			int j = (k + 1) % 3;
+			if (d[k] > 0.0f)
+				polygon[n++] = v[k];
+			if ((d[k] > 0.0f) != (d[j] > 0.0f)) {
+				float t = d[k] / (d[k] - d[j]);
+				SoftVertex& c = clipped[m++];
+				c.position = glm::mix(v[k]->position, v[j]->position, t);
+				for (int i = 0; i < varyings; ++i)
+					c.varyings[i] = v[k]->varyings[i] + (v[j]->varyings[i] - v[k]->varyings[i]) * t;
+				clippedMask |= 1u << n;
+				polygon[n++] = &c;
+			}
+		}
+		setup(batch, draw, polygon, n, clippedMask, wireframe, lineWidth);
+	}
+
+	// projects a convex polygon of 3 or 4 vertices and emits it as a fan, or its edges as lines;
+	// bit k of clippedMask is set if vertex k was added by clipping
+	void setup(Batch& batch, int draw, const SoftVertex* const* v, int n, unsigned int clippedMask, bool wireframe, float lineWidth) const {
+		ScreenVertex s[4];
+		for (int k = 0; k < n; ++k) {
+			const glm::vec4& p = v[k]->position;
+			s[k].invW = 1.0f / p.w;
+			s[k].x = (p.x * s[k].invW * 0.5f + 0.5f) * target->width;
+			s[k].y = (p.y * s[k].invW * 0.5f + 0.5f) * target->height;
+			s[k].z = p.z * s[k].invW * 0.5f + 0.5f;
+			s[k].vertex = v[k];
+		}
+		if (!wireframe) {
+			for (int k = 1; k + 1 < n; ++k)
+				emit(batch, draw, s[0], s[k], s[k + 1]);
+			return;
+		}
+		// each edge becomes a screen-space quad lineWidth pixels wide, the edge added by clipping is not outlined
+		for (int k = 0; k < n; ++k) {
+			const ScreenVertex& a = s[k];
+			const ScreenVertex& b = s[(k + 1) % n];
+			if ((clippedMask >> k & 1) && (clippedMask >> ((k + 1) % n) & 1))
+				continue;
+			glm::vec2 dir(b.x - a.x, b.y - a.y);
+			float len = glm::length(dir);
+			if (len == 0.0f)
+				continue;
+			glm::vec2 offset = glm::vec2(-dir.y, dir.x) / len * (lineWidth * 0.5f);
+			ScreenVertex q[4] = { a, b, b, a };
+			q[0].x += offset.x; q[0].y += offset.y;
+			q[1].x += offset.x; q[1].y += offset.y;
+			q[2].x -= offset.x; q[2].y -= offset.y;
+			q[3].x -= offset.x; q[3].y -= offset.y;
+			emit(batch, draw, q[0], q[1], q[2]);
+			emit(batch, draw, q[0], q[2], q[3]);
+		}
+	}
+
+	void emit(Batch& batch, int draw, ScreenVertex a, ScreenVertex b, ScreenVertex c) const {
+		++batch.setup;
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (area == 0.0f || area != area)
+			return;
+		// no culling, clockwise triangles are turned around
+		if (area < 0.0f) {
+			std::swap(b, c);
+			area = -area;
+		}
+		// pixels whose centres fall inside the bounds, most sub-pixel triangles of a dense mesh end here
+		Triangle t;
+		t.minX = std::max(0, (int)std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f));
+		t.minY = std::max(0, (int)std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f));
+		t.maxX = std::min(target->width - 1, (int)std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f));
+		t.maxY = std::min(target->height - 1, (int)std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f));
+		if (t.minX > t.maxX || t.minY > t.maxY)
+			return;
+
+		const ScreenVertex* s[3] = { &a, &b, &c };
+		t.draw = draw;
+		t.invArea = 1.0f / area;
+		t.zA = t.zB = t.zC = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			const ScreenVertex& p = *s[(k + 1) % 3];
+			const ScreenVertex& q = *s[(k + 2) % 3];
+			t.v[k] = (unsigned int)batch.vertices.size();
+			batch.vertices.push_back(*s[k]->vertex);
+			t.invW[k] = s[k]->invW;
+			t.A[k] = p.y - q.y;
+			t.B[k] = q.x - p.x;
+			t.C[k] = -(t.A[k] * p.x + t.B[k] * p.y);
+			// top-left fill rule so shared edges are drawn once
+			t.topLeft[k] = t.A[k] > 0.0f || (t.A[k] == 0.0f && t.B[k] < 0.0f);
+			t.zA += t.A[k] * s[k]->z * t.invArea;
+			t.zB += t.B[k] * s[k]->z * t.invArea;
+			t.zC += t.C[k] * s[k]->z * t.invArea;
+		}
+		batch.triangles.push_back(t);
+	}
+
+	long long rasterTile(int tx, int ty) {
+		SoftTarget& rt = *target;
+		int x0 = tx * SOFT_TILE_SIZE, y0 = ty * SOFT_TILE_SIZE;
+		int x1 = std::min(rt.width, x0 + SOFT_TILE_SIZE) - 1, y1 = std::min(rt.height, y0 + SOFT_TILE_SIZE) - 1;
+		unsigned char clear[4];
+		for (int c = 0; c < 4; ++c)
+			clear[c] = (unsigned char)(glm::clamp(clearColour[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+		for (int y = y0; y <= y1; ++y) {
+			size_t row = (size_t)y * rt.width;
+			std::fill(rt.depth.begin() + row + x0, rt.depth.begin() + row + x1 + 1, 1.0f);
+			for (int x = x0; x <= x1; ++x)
+				memcpy(&rt.colour[(row + x) * 4], clear, 4);
+		}
+
+		long long fragments = 0;
+		const std::vector<unsigned int>& bin = bins[ty * tilesX + tx];
+		for (size_t b = 0; b < bin.size(); ++b) {
+			const Triangle& t = triangles[bin[b]];
+			const SoftShader& shader = *shaders[t.draw];
+			int minX = std::max(t.minX, x0), maxX = std::min(t.maxX, x1);
+			int minY = std::max(t.minY, y0), maxY = std::min(t.maxY, y1);
+			if (minX > maxX || minY > maxY)
+				continue;
+			for (int y = minY; y <= maxY; ++y) {
+				float py = y + 0.5f;
+				for (int span = minX & ~7; span <= maxX; span += 8) {
+					float e[3][8], z[8];
+					unsigned int mask = coverage(t, span, maxX, py, &rt.depth[(size_t)y * rt.width], e, z);
+					// lanes outside the triangle's part of the tile, or past the right edge of the target
+					int lo = std::max(minX - span, 0), hi = std::min(maxX - span, 7);
+					mask &= ((1u << (hi + 1)) - 1) & ~((1u << lo) - 1);
+					for (int lane = 0; mask; ++lane, mask >>= 1) {
+						if (!(mask & 1))
+							continue;
+						shade(t, shader, span + lane, y, e[0][lane], e[1][lane], e[2][lane], z[lane]);
+						++fragments;
+					}
+				}
+			}
+		}
+		return fragments;
+	}
+
+	// edge functions and depth of the 8 pixels starting at x, bit i set if pixel i is covered and passes the depth test;
+	// the depth row is only read up to lastX, the lanes beyond it are masked by the caller
+	static unsigned int coverage(const Triangle& t, int x, int lastX, float py, const float* depthRow, float e[3][8], float z[8]) {
+		float px = x + 0.5f;
+#ifdef SOFT_USE_SSE
+		const __m128 lanesLo = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		const __m128 lanesHi = _mm_set_ps(7.0f, 6.0f, 5.0f, 4.0f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 inLo = _mm_castsi128_ps(_mm_set1_epi32(-1)), inHi = inLo;
+		for (int k = 0; k < 3; ++k) {
+			__m128 a = _mm_set1_ps(t.A[k]);
+			__m128 base = _mm_set1_ps(t.A[k] * px + t.B[k] * py + t.C[k]);
+			__m128 lo = _mm_add_ps(base, _mm_mul_ps(a, lanesLo));
+			__m128 hi = _mm_add_ps(base, _mm_mul_ps(a, lanesHi));
+			_mm_storeu_ps(e[k], lo);
+			_mm_storeu_ps(e[k] + 4, hi);
+			if (t.topLeft[k]) {
+				inLo = _mm_and_ps(inLo, _mm_cmpge_ps(lo, zero));
+				inHi = _mm_and_ps(inHi, _mm_cmpge_ps(hi, zero));
+			} else {
+				inLo = _mm_and_ps(inLo, _mm_cmpgt_ps(lo, zero));
+				inHi = _mm_and_ps(inHi, _mm_cmpgt_ps(hi, zero));
+			}
+		}
+		if ((_mm_movemask_ps(inLo) | _mm_movemask_ps(inHi)) == 0)
+			return 0;
+		__m128 za = _mm_set1_ps(t.zA);
+		__m128 zBase = _mm_set1_ps(t.zA * px + t.zB * py + t.zC);
+		__m128 zLo = _mm_add_ps(zBase, _mm_mul_ps(za, lanesLo));
+		__m128 zHi = _mm_add_ps(zBase, _mm_mul_ps(za, lanesHi));
+		_mm_storeu_ps(z, zLo);
+		_mm_storeu_ps(z + 4, zHi);
+		// the span may run past the right edge of the target
+		float depth[8];
+		for (int i = 0; i < 8; ++i)
+			depth[i] = depthRow[std::min(x + i, lastX)];
+		inLo = _mm_and_ps(inLo, _mm_cmplt_ps(zLo, _mm_loadu_ps(depth)));
+		inHi = _mm_and_ps(inHi, _mm_cmplt_ps(zHi, _mm_loadu_ps(depth + 4)));
+		return (unsigned int)(_mm_movemask_ps(inLo) | (_mm_movemask_ps(inHi) << 4));
+#else
+		unsigned int mask = 0;
+		for (int i = 0; i < 8; ++i) {
+			bool in = true;
+			for (int k = 0; k < 3; ++k) {
+				e[k][i] = t.A[k] * (px + i) + t.B[k] * py + t.C[k];
+				in = in && (t.topLeft[k] ? e[k][i] >= 0.0f : e[k][i] > 0.0f);
+			}
+			z[i] = t.zA * (px + i) + t.zB * py + t.zC;
+			if (in && x + i <= lastX && z[i] < depthRow[x + i])
+				mask |= 1u << i;
+		}
+		return mask;
+#endif
+	}
+
+	void shade(const Triangle& t, const SoftShader& shader, int x, int y, float e0, float e1, float e2, float z) {
+		// perspective-correct barycentrics from the screen-space ones
+		float w0 = e0 * t.invW[0], w1 = e1 * t.invW[1], w2 = e2 * t.invW[2];
+		float norm = 1.0f / (w0 + w1 + w2);
+		w0 *= norm;
+		w1 *= norm;
+		w2 *= norm;
+		const float* a = vertices[t.v[0]].varyings;
+		const float* b = vertices[t.v[1]].varyings;
+		const float* c = vertices[t.v[2]].varyings;
+		float varyings[SOFT_MAX_VARYINGS];
+		for (int i = 0; i < shader.varyings; ++i)
+			varyings[i] = a[i] * w0 + b[i] * w1 + c[i] * w2;
+		glm::vec4 colour = glm::clamp(shader.fragment(varyings), 0.0f, 1.0f);
+
+		SoftTarget& rt = *target;
+		size_t i = (size_t)y * rt.width + x;
+		rt.depth[i] = z;
+		for (int k = 0; k < 4; ++k)
+			rt.colour[i * 4 + k] = (unsigned char)(colour[k] * 255.0f + 0.5f);
+	}
+};
+#endif
@@ -0,0 +1,149 @@
+#ifndef SOFT_SHADERS_H
+#define SOFT_SHADERS_H
+
+#include <glm/glm.hpp>
+
+#include "softrast.h"
+
+// C++ versions of the demo shaders in Resource/ for the software rasterizer, uniforms are public members.
+// Vertex input layouts match the GL VAOs.
+
+// plain.vs / plain.fs, position only
+class SoftPlainShader : public SoftShader {
+public:
+	glm::mat4 model, view, projection;
+	glm::vec3 colour;
+
+	SoftPlainShader() : SoftShader(0), model(1.0f), view(1.0f), projection(1.0f), colour(1.0f) {}
+
+	void prepare() {
+		mvp = projection * view * model;
+	}
+
+	void vertex(const float* in, SoftVertex& out) const {
+		out.position = mvp * glm::vec4(in[0], in[1], in[2], 1.0f);
+	}
+
+	glm::vec4 fragment(const float*) const {
+		return glm::vec4(colour, 1.0f);
+	}
+
+private:
+	glm::mat4 mvp;
+};
+
+// reflection.vs / reflection.fs, position and normal
+class SoftReflectionShader : public SoftShader {
+public:
+	glm::mat4 model, view, projection;
+	glm::vec3 cameraPos;
+	const SoftCubemap* skybox;
+
+	SoftReflectionShader() : SoftShader(9), model(1.0f), view(1.0f), projection(1.0f), cameraPos(0.0f), skybox(NULL) {}
+
+	void prepare() {
+		mvp = projection * view * model;
+		normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+	}
+
+	void vertex(const float* in, SoftVertex& out) const {
+		glm::vec4 pos(in[0], in[1], in[2], 1.0f);
+		glm::vec3 normal = normalMatrix * glm::vec3(in[3], in[4], in[5]);
+		glm::vec3 position = glm::vec3(model * pos);
+		out.position = mvp * pos;
+		for (int i = 0; i < 3; ++i) {
+			out.varyings[i] = normal[i];
+			out.varyings[3 + i] = position[i];
+			out.varyings[6 + i] = in[i] * 2.0f;
+		}
+	}
+
+	glm::vec4 fragment(const float* v) const {
+		glm::vec3 I = glm::normalize(glm::vec3(v[3], v[4], v[5]) - cameraPos);
+		glm::vec3 R = glm::reflect(I, glm::normalize(glm::vec3(v[0], v[1], v[2])));
+		glm::vec3 env = skybox ? glm::vec3(skybox->sample(R)) : glm::vec3(0.0f);
+		return glm::vec4(glm::mix(env, glm::vec3(v[6], v[7], v[8]), 0.3f), 1.0f);
+	}
+
+private:
+	glm::mat4 mvp;
+	glm::mat3 normalMatrix;
+};
+
+// texture.vs / texture.fs without SH ambient or the shadow map, position, uv and normal
+class SoftTextureShader : public SoftShader {
+public:
+	glm::mat4 model, view, projection;
+	glm::vec3 lightPos, viewPos, lightColor, colour;
+	const SoftTexture* texture;
+
+	SoftTextureShader() : SoftShader(8), model(1.0f), view(1.0f), projection(1.0f), lightPos(0.0f), viewPos(0.0f),
+		lightColor(1.0f), colour(1.0f), texture(NULL) {}
+
+	void prepare() {
+		viewProjection = projection * view;
+		normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+	}
+
+	void vertex(const float* in, SoftVertex& out) const {
+		glm::vec4 fragPos = model * glm::vec4(in[0], in[1], in[2], 1.0f);
+		glm::vec3 normal = normalMatrix * glm::vec3(in[5], in[6], in[7]);
+		out.position = viewProjection * fragPos;
+		for (int i = 0; i < 3; ++i) {
+			out.varyings[i] = fragPos[i];
+			out.varyings[3 + i] = normal[i];
+		}
+		out.varyings[6] = in[3];
+		out.varyings[7] = in[4];
+	}
+
+	glm::vec4 fragment(const float* v) const {
+		glm::vec3 fragPos(v[0], v[1], v[2]);
+		glm::vec3 norm = glm::normalize(glm::vec3(v[3], v[4], v[5]));
+		glm::vec3 ambient = 0.1f * lightColor;
+
+		glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+		glm::vec3 diffuse = glm::max(glm::dot(norm, lightDir), 0.0f) * lightColor;
+
+		glm::vec3 viewDir = glm::normalize(viewPos - fragPos);
+		glm::vec3 reflectDir = glm::reflect(-lightDir, norm);
+		float spec = std::pow(glm::max(glm::dot(viewDir, reflectDir), 0.0f), 32.0f);
+		glm::vec3 specular = 0.5f * spec * lightColor;
+
+		glm::vec3 result = (ambient + diffuse + specular) * colour;
+		glm::vec4 texel = texture ? texture->sample(glm::vec2(v[6], v[7])) : glm::vec4(1.0f);
+		return glm::mix(texel, glm::vec4(result, 1.0f), 0.5f);
+	}
+
+private:
+	glm::mat4 viewProjection;
+	glm::mat3 normalMatrix;
+};
+
+// shadow.vs / shadow.fs, flattens the mesh onto the plane y = surfaceY along rays from the light
+class SoftShadowShader : public SoftShader {
+public:
+	glm::mat4 model, view, projection;
+	glm::vec3 lightPos;
+	float surfaceY;
+
+	SoftShadowShader() : SoftShader(0), model(1.0f), view(1.0f), projection(1.0f), lightPos(0.0f), surfaceY(0.0f) {}
+
+	void prepare() {
+		viewProjection = projection * view;
+	}
+
+	void vertex(const float* in, SoftVertex& out) const {
+		glm::vec3 modPos = glm::vec3(model * glm::vec4(in[0], in[1], in[2], 1.0f));
+		float alpha = (surfaceY - modPos.y) / (modPos.y - lightPos.y);
+		out.position = viewProjection * glm::vec4(modPos + (modPos - lightPos) * alpha, 1.0f);
+	}
+
+	glm::vec4 fragment(const float*) const {
+		return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+
+private:
+	glm::mat4 viewProjection;
+};
+#endif
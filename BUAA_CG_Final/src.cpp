@@ -1,21 +1,158 @@
 #include <glad/glad.h>
+#ifdef HEADLESS
+#include "headless.h"
+#else
 #include <GLFW/glfw3.h>
+#endif
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "sh.h"
+#include "planarshadow.h"
+#include "shadowmap.h"
+#include "framegraph.h"
+#include "renderqueue.h"
+#include "commandlist.h"
+#include "jobs.h"
+#include "gputimer.h"
+#include "streamformat.h"
+#include "softrast.h"
+#include "softshaders.h"
+#include "golden.h"
+#include "textureloader.h"
+#include "taskgraph.h"
+#include "texturecache.h"
+#include "mipmap.h"
+#include "residency.h"
+#include "virtualtexture.h"
+#include "texturepacker.h"
+#include "transformhierarchy.h"
+#include "gpuculling.h"
+#include "hiz.h"
 #include "stb_image.h"
 
 #include <iostream>
 #include <cmath>
 #include <vector>
-
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <memory>
+
+#ifdef HEADLESS
+typedef HeadlessContext Window;
+#else
+typedef GLFWwindow Window;
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+#endif
+
+// what a run of the scene can vary, main() takes the first value of --epoch, --env-size and --objects
+// and --bench sweeps all of them
+struct SceneSettings {
+	unsigned int epoch; // sphere subdivisions
+	unsigned int envSize; // environment cubemap face resolution
+	unsigned int objects; // textured spheres, the first one is the original
+};
+
+// frame times of the measured frames of one benchmark run
+struct BenchResult {
+	SceneSettings settings;
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+};
+
+// one canonical frame of the golden image test, rendered through the same entry points as the command line
+struct GoldenCase {
+	const char* name;
+	bool software;
+	SceneSettings settings;
+	unsigned int frames; // the last one is compared, it is rendered at (frames - 1) * FIXED_TIMESTEP
+	const char* golden; // compared against another case's golden instead of its own, NULL for its own
+	double minPsnr; // dB
+	double minSsim;
+};
+
+// model, view and projection matrices of one frame, shared by the GL and the software path
+struct SceneTransforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 gram;
+	glm::mat4 cube;
+	glm::mat4 sphere;
+	glm::mat4 light;
+	glm::mat4 surface;
+};
+
+// nodes of the scene in its transform hierarchy, the cube spins in a child of the node placing it
+struct SceneNodes {
+	int gram;
+	int cube;
+	int cubeSpin;
+	int sphere;
+	int light;
+	int surface;
+	std::vector<int> objects;
+};
+
+// shader programs of the scene, compiled once at startup
+enum SceneShader {
+	REFLECT_SHADER,
+	PLAIN_SHADER,
+	TEXTURE_SHADER,
+	SHADOW_SHADER,
+	SURFACE_SHADER,
+	DEPTH_SHADER,
+	VT_FEEDBACK_SHADER,
+	INSTANCED_REFLECT_SHADER,
+	INSTANCED_PLAIN_SHADER,
+	INSTANCED_TEXTURE_SHADER,
+	INSTANCED_DEPTH_SHADER,
+	CULL_SHADER,
+	HIZ_SHADER,
+	SHADER_COUNT,
+};
+
+struct SceneAssets;
+
+int startup(const SceneSettings& settings, int argc, char* argv[]);
+int runScene(Window* window, SceneAssets& assets, const SceneSettings& settings, int argc, char* argv[], BenchResult* bench);
+int benchmark(Window* window, SceneAssets& assets, int argc, char* argv[]);
+int softwareRender(const SceneSettings& settings, int argc, char* argv[]);
+int goldenTest(Window* window, SceneAssets& assets, int argc, char* argv[]);
+int textureReport();
+int mipmapBenchmark(int argc, char* argv[]);
+int jpegBenchmark(int argc, char* argv[]);
+int residencyBenchmark(int argc, char* argv[]);
 void norm(float* v, float mod);
 void copyTri(float* dst, float* v0, float* v1, float* v2);
+void buildGram(float* gramVertices, unsigned int* innerIndices, unsigned int* outerIndices);
+std::vector<float> buildSphere(unsigned int epoch);
+std::vector<std::vector<unsigned char> > buildObjectImages(unsigned int count, const MipmapGenerator& mipmaps, int& size);
+std::vector<glm::mat4> environmentViews();
+SceneNodes buildScene(TransformHierarchy& scene, unsigned int objects);
+void animateScene(TransformHierarchy& scene, const SceneNodes& nodes, double time);
+SceneTransforms sceneTransforms(const TransformHierarchy& scene, const SceneNodes& nodes);
+bool hasArg(int argc, char* argv[], const char* name);
+const char* argValue(int argc, char* argv[], const char* name);
+std::vector<unsigned int> argList(int argc, char* argv[], const char* name, unsigned int fallback);
+bool sphereInFrustum(const glm::mat4& viewProjection, const glm::vec3& center, float radius);
+void shadowBenchmark(ShadowMap& shadowMap, Shader& depthShader, Shader& shadowShader, unsigned int vao, unsigned int count);
+void instancingBenchmark(Shader& textShader, Shader& instancedTextShader, ShadowMap& shadowMap, Shader& depthShader, Shader& instancedDepthShader);
+void cullingBenchmark(Shader& textShader, Shader& instancedTextShader, Shader& cullShader, ShadowMap& shadowMap);
+void occlusionBenchmark(Shader& textShader, Shader& instancedTextShader, Shader& plainShader, Shader& depthShader, Shader& hizShader, ShadowMap& shadowMap);
+unsigned int benchSphereArray(const std::vector<float>& vertices, unsigned int& vbo);
+void benchTextSetup(CommandList& list, ShadowMap& shadowMap);
+double benchMedianMs(int warmup, int frames, const std::function<void()>& frame);
 
 // global settings
 const unsigned int SCR_WIDTH = 800;
@@ -28,6 +165,35 @@ const glm::vec3 LIGHT_POS = glm::vec3(-0.2f, 1.0f, 0.3f);
 // texture settings
 const char* IMG_PATH = "name.jpg";
 const int REPEAT = 3;
+const size_t TEXTURE_UPLOAD_BYTES = 4 << 20; // uploaded per frame at most, but always at least one image
+const GLenum TEXTURE_FORMAT = GL_COMPRESSED_RGBA_BPTC_UNORM; // block format of the KTX cache (BC1/BC3/BC7/ETC2), 0 loads the JPEG
+const MipmapGenerator::Filter MIPMAP_FILTER = MipmapGenerator::BOX; // KAISER is sharper and about five times as slow
+const bool MIPMAP_SRGB = true; // average in linear light, the JPEG is sRGB encoded
+const unsigned int MIPMAP_BENCH_SIZE = 8192; // synthetic image of --mipmap-bench besides the demo texture
+const int MIPMAP_BENCH_RUNS = 3; // the fastest run is reported
+const int JPEG_BENCH_RUNS = 3; // the fastest run is reported
+const size_t TEXTURE_BUDGET_MB = 256; // least recently used mips, then whole textures, are evicted beyond it
+const unsigned int RESIDENCY_BENCH_TEXTURES = 2000; // requests of the demo texture in --residency-bench
+const unsigned int RESIDENCY_BENCH_VISIBLE = 64; // textures used per frame, a window that moves by one each frame
+const unsigned int RESIDENCY_BENCH_FRAMES = 600;
+const size_t RESIDENCY_BENCH_BUDGET_MB = 64; // the visible window of BC7 copies takes about 40 MB
+const int VIRTUAL_TEXTURE_SLOTS = 16; // atlas slots on a side for --virtual-texture, 136x136 texels each
+const int VIRTUAL_PAGES_PER_FRAME = 8; // page uploads per frame at most
+const int VIRTUAL_FEEDBACK_SCALE = 8; // the feedback pass renders at 1/8 of the view's size
+const int OBJECT_TEXTURE_SIZE = 256; // --object-textures tints the largest mip of the demo texture within it
+const TexturePacker::Mode OBJECT_TEXTURE_PACKING = TexturePacker::ARRAY; // --texture-packing array|atlas|none
+const GLenum TEXTURE_REPORT_FORMATS[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+	GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_RGB8_ETC2 };
+
+// startup settings
+const std::chrono::steady_clock::time_point PROCESS_START = std::chrono::steady_clock::now(); // epoch of the startup report
+const char* SHADER_NAMES[SHADER_COUNT] = { "reflection", "plain", "texture", "shadow", "surface", "depth", "vtfeedback",
+	"reflection", "plain", "texture", "depth", "cull", "hiz" }; // Resource/<name>.vs and .fs
+const char* SHADER_DEFINES[SHADER_COUNT] = { NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+	"INSTANCED", "INSTANCED", "INSTANCED", "INSTANCED", NULL, NULL }; // compiles a variant of the sources
+
+// environment lighting settings
+const unsigned int SH_SIZE = 32; // cubemap is downsampled to at most this face size before SH projection
 
 // camera settings
 const glm::vec3 CAMERA_POS = glm::vec3(0.0f, 0.0f, 3.0f);
@@ -63,36 +229,297 @@ const float SURFACE_Y = -RADIUS * SPHERE_SCALE;
 const glm::vec3 TRANSLATE_SURFACE = glm::vec3(0.0f, SURFACE_Y - 0.01f, 0.0f);
 const glm::vec3 SCALE_SURFACE = glm::vec3(2.0f, 2.0f, 2.0f);
 
-int main() {
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// shadow settings
+const bool USE_SHADOW_MAP = true; // false falls back to the projected shadow baked into the plane texture
+const unsigned int SHADOW_TEX_SIZE = 1024;
+const unsigned int SHADOW_MAP_SIZE = 2048;
+const bool SHADOW_PERSPECTIVE = true; // perspective fit for the point light, false for orthographic
+const int PCF_RADIUS = 1; // 0 takes a single hardware-filtered tap, n takes (2n+1)^2 taps
+const int SHADOW_BENCH_CASTERS[] = { 1, 10, 100, 1000 };
+
+// instancing settings
+const int INSTANCING_MIN_RUN = 2; // shorter runs of draws sharing a mesh are drawn one by one, --no-instancing draws all of them so
+const int INSTANCING_BENCH_OBJECTS[] = { 1, 10, 100, 1000, 10000, 100000 };
+const unsigned int INSTANCING_BENCH_EPOCH = 2; // subdivisions of the --instancing-bench sphere, 192 vertices
+const int INSTANCING_BENCH_WARMUP = 2; // untimed frames before each count and mode
+const int INSTANCING_BENCH_FRAMES = 11; // timed per count and mode, the median is reported
+
+// gpu culling settings
+const int CULLING_BENCH_OBJECTS[] = { 1000, 10000, 100000 }; // --culling-bench spreads them over a grid wider than the view
+const float CULLING_BENCH_EXTENT = 12.0f; // side of the grid on the plane
+
+// hi-z occlusion culling settings
+const int HIZ_SCALE = 4; // --hiz draws the occluders and builds the depth pyramid at 1/4 of the view's size
+const int HIZ_BENCH_OBJECTS[] = { 1000, 5000, 20000 }; // spheres of --hiz-bench behind its occluder plane
+const int HIZ_BENCH_LAYERS = 4; // grids of spheres one behind the other
+const float HIZ_BENCH_EXTENT = 6.0f; // side of each grid
+const int HIZ_BENCH_FRAMES = 10; // timed per count and mode, after one frame building the first pyramid
+
+// profiling settings
+const unsigned int GPU_TIMER_LATENCY = 4; // frames between issuing a timer query and reading it back
+const unsigned int GPU_TIMER_WINDOW = 240; // samples kept per pass for the rolling statistics
+const unsigned int GPU_TIMER_LOG_FRAMES = 120; // log the pass timings every n frames, 0 disables
+
+// headless and benchmark settings
+const double FIXED_TIMESTEP = 1.0 / 60.0; // simulated seconds per frame, so headless and benchmark runs are reproducible
+const char* HEADLESS_OUTPUT = "headless.ppm";
+const unsigned int BENCH_WARMUP_FRAMES = 30;
+const unsigned int BENCH_FRAMES = 300;
+const char* BENCH_OUTPUT = "bench.json"; // a .csv extension writes CSV instead
+
+// software rasterizer settings
+const char* SOFTWARE_OUTPUT = "software.ppm";
+const unsigned int SOFTWARE_BENCH_FRAMES = 10; // frames timed per thread count
+
+// golden image settings, the GL frames wait a few frames for the SH readback
+const char* GOLDEN_DIR = "golden";
+const GoldenCase GOLDEN_CASES[] = {
+	{ "default", false, { EPOCH, SCR_WIDTH, 1 }, 8, NULL, 40.0, 0.98 },
+	{ "animated", false, { EPOCH, SCR_WIDTH, 1 }, 60, NULL, 40.0, 0.98 },
+	{ "objects", false, { 5, 256, 26 }, 8, NULL, 40.0, 0.98 },
+	{ "software", true, { EPOCH, SCR_WIDTH, 1 }, 1, NULL, 40.0, 0.98 },
+	{ "software-objects", true, { 5, 256, 26 }, 1, NULL, 40.0, 0.98 },
+	// the software path against the GL one, it has no shadow map filtering or SH ambient
+	{ "software-vs-gl", true, { EPOCH, SCR_WIDTH, 1 }, 1, "default", 24.0, 0.90 },
+};
+
+// vertex data, position and normal for the cube, position for the plane
+const float CUBE_VERTICES[] = {
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	 0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	 0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+
+	 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+	 0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	 0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+	 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	 0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	 0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
+};
+
+const float SURFACE_VERTICES[] = {
+	 1.0f,  0.0f,  1.0f,
+	 1.0f,  0.0f, -1.0f,
+	-1.0f,  0.0f, -1.0f,
+	-1.0f,  0.0f, -1.0f,
+	-1.0f,  0.0f,  1.0f,
+	 1.0f,  0.0f,  1.0f,
+};
+
+int main(int argc, char* argv[]) {
+	SceneSettings settings = { argList(argc, argv, "--epoch", EPOCH)[0], argList(argc, argv, "--env-size", SCR_WIDTH)[0],
+		std::max(1u, argList(argc, argv, "--objects", 1)[0]) };
+	// JPEGs with restart markers are decoded on every core
+	stbi_set_jpeg_threads((int)std::max(1u, std::thread::hardware_concurrency()));
+	// the software rasterizer and the JPEG benchmark need no GL context at all
+	if (hasArg(argc, argv, "--software") || hasArg(argc, argv, "--software-bench"))
+		return softwareRender(settings, argc, argv);
+	if (hasArg(argc, argv, "--jpeg-bench"))
+		return jpegBenchmark(argc, argv);
+
+	int result = startup(settings, argc, argv);
+#ifndef HEADLESS
+	glfwTerminate();
+#endif
+	return result;
+}
+
+// what runScene needs besides the per-run GL objects, prepared once by startup() and shared by every run
+struct SceneAssets {
+	Shader shaders[SHADER_COUNT];
+	JobPool mipmapJobs; // builds the mip chains of the loader's workers, outlives them
+	TextureLoader textureLoader;
+	TextureResidency residency; // owns texture
+	unsigned int texture;
+	std::vector<float> sphereVertices;
+	unsigned int sphereEpoch; // the subdivisions sphereVertices was built with
+	double firstFrameMs; // since PROCESS_START, negative until the first frame is done
+
+	SceneAssets() : textureLoader(TEXTURE_UPLOAD_BYTES), residency(textureLoader, TEXTURE_BUDGET_MB << 20), texture(0), sphereEpoch(0),
+		firstFrameMs(-1.0) {
+		textureLoader.mipmaps = MipmapGenerator(MIPMAP_FILTER, MIPMAP_SRGB, &mipmapJobs);
+	}
+
+	// the context has to be current
+	~SceneAssets() {
+		for (int i = 0; i < SHADER_COUNT; ++i)
+			if (shaders[i].ID)
+				glDeleteProgram(shaders[i].ID);
+	}
+};
+
+// creates the context and the scene assets as a task graph, so the shader files are read, the sphere is
+// subdivided and the texture is decoded on worker threads while the main thread creates the context and
+// compiles each shader as soon as its source is in. Prints the critical path, --startup-report prints every
+// task. Then runs the golden test, the benchmark or the scene.
+int startup(const SceneSettings& settings, int argc, char* argv[]) {
+	Window* window = NULL;
+#ifdef HEADLESS
+	// no window: the scene is rendered offscreen, --frames <n> sets the frame count and --output <file>
+	// where the last frame is written
+	std::unique_ptr<HeadlessContext> headless;
+#endif
+	// declared after the context so it is destroyed while the context is still there
+	SceneAssets assets;
+	ShaderSource sources[SHADER_COUNT];
+	bool contextReady = false;
+
+	TaskGraph graph(0, PROCESS_START);
+	int context = graph.add("create context", [&]() {
+#ifdef HEADLESS
+		headless.reset(new HeadlessContext(SCR_WIDTH, SCR_HEIGHT));
+		if (headless->valid())
+			window = headless.get();
+#else
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
 
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "BUAA CG", NULL, NULL);
-	if (window == NULL) {
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "BUAA CG", NULL, NULL);
+		if (window == NULL) {
+			std::cout << "Failed to create GLFW window" << std::endl;
+			return;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+#endif
+	}, {}, true);
+	int loadGL = graph.add("load GL", [&]() {
+		if (!window)
+			return;
+#ifdef HEADLESS
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress)) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return;
+		}
+		contextReady = headless->createFramebuffer();
+#else
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return;
+		}
+		contextReady = true;
+#endif
+	}, { context }, true);
+	graph.add("request texture", [&]() {
+		// loaded on a worker thread from the KTX cache (or decoded and uploaded through a PBO), the sphere shows
+		// a grey placeholder until then
+		if (!contextReady)
+			return;
+		const char* formatArg = argValue(argc, argv, "--texture-format");
+		GLenum format = formatArg ? TextureCache::parse(formatArg) : TEXTURE_FORMAT;
+		if (format && !TextureCache::supported(format)) {
+			std::cout << "ERROR::TEXTURE:: " << TextureCache::name(format) << " is not supported, loading the texture uncompressed" << std::endl;
+			format = 0;
+		}
+		assets.residency.budget = (size_t)argList(argc, argv, "--texture-budget", TEXTURE_BUDGET_MB)[0] << 20;
+		assets.texture = assets.residency.request("Resource/name.jpg", GL_REPEAT, GL_LINEAR, true, true, format);
+	}, { loadGL }, true);
+	for (int i = 0; i < SHADER_COUNT; ++i) {
+		std::string name = SHADER_NAMES[i];
+		std::string variant = SHADER_DEFINES[i] ? name + " " + SHADER_DEFINES[i] : name;
+		int read = graph.add("read " + variant, [&, i, name]() {
+			// the culling pass drops instances in a geometry shader and captures what it emits
+			sources[i] = ShaderSource(("Resource/" + name + ".vs").c_str(), ("Resource/" + name + ".fs").c_str(),
+				i == CULL_SHADER ? ("Resource/" + name + ".gs").c_str() : nullptr);
+			if (i == CULL_SHADER)
+				sources[i].feedback = GpuInstanceCuller::varyings();
+			if (SHADER_DEFINES[i])
+				sources[i].define(SHADER_DEFINES[i]);
+		});
+		graph.add("compile " + variant, [&, i]() {
+			if (contextReady)
+				assets.shaders[i].compile(sources[i]);
+		}, { loadGL, read }, true);
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	graph.add("build sphere", [&]() {
+		assets.sphereVertices = buildSphere(settings.epoch);
+		assets.sphereEpoch = settings.epoch;
+	});
+	// the loader needs the GL thread to map its buffers, so the decode can start while shaders still compile
+	graph.idle = [&]() {
+		if (contextReady)
+			assets.textureLoader.update();
+	};
+	graph.run();
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		std::cout << "Failed to initialize GLAD" << std::endl;
+	graph.report(std::cout, hasArg(argc, argv, "--startup-report"));
+	if (!contextReady)
 		return -1;
+
+	int result;
+	if (hasArg(argc, argv, "--texture-report")) {
+		result = textureReport();
+	} else if (hasArg(argc, argv, "--mipmap-bench")) {
+		result = mipmapBenchmark(argc, argv);
+	} else if (hasArg(argc, argv, "--residency-bench")) {
+		result = residencyBenchmark(argc, argv);
+	} else if (hasArg(argc, argv, "--golden") || hasArg(argc, argv, "--update-golden")) {
+		result = goldenTest(window, assets, argc, argv);
+	} else if (hasArg(argc, argv, "--bench")) {
+		result = benchmark(window, assets, argc, argv);
+	} else {
+		result = runScene(window, assets, settings, argc, argv, NULL);
 	}
+	return result;
+}
+
+// sets up the scene and runs the render loop, until the window is closed or the frame count is reached
+int runScene(Window* window, SceneAssets& assets, const SceneSettings& settings, int argc, char* argv[], BenchResult* bench) {
+#ifdef HEADLESS
+	// no window: --frames <n> sets the frame count and --output <file> where the last frame is written
+	const char* framesArg = argValue(argc, argv, "--frames");
+	int headlessFrames = framesArg ? std::max(1, atoi(framesArg)) : 1;
+	const char* outputPath = argValue(argc, argv, "--output");
+	if (!outputPath)
+		outputPath = HEADLESS_OUTPUT;
+#endif
 
 	glEnable(GL_DEPTH_TEST);
 
-	Shader reflectShader("Resource/reflection.vs", "Resource/reflection.fs");
-	Shader plainShader("Resource/plain.vs", "Resource/plain.fs");
-	Shader textShader("Resource/texture.vs", "Resource/texture.fs");
-	Shader shadowShader("Resource/shadow.vs", "Resource/shadow.fs");
+	Shader& reflectShader = assets.shaders[REFLECT_SHADER];
+	Shader& plainShader = assets.shaders[PLAIN_SHADER];
+	Shader& textShader = assets.shaders[TEXTURE_SHADER];
+	Shader& shadowShader = assets.shaders[SHADOW_SHADER];
+	Shader& surfaceShader = assets.shaders[SURFACE_SHADER];
+	Shader& depthShader = assets.shaders[DEPTH_SHADER];
+	Shader& instancedDepthShader = assets.shaders[INSTANCED_DEPTH_SHADER];
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes for patagram
 	// ------------------------------------------------------------------
@@ -100,44 +527,7 @@ int main() {
 	unsigned int innerIndices[3 * ANGLE_NUM];
 	unsigned int outerIndices[3 * ANGLE_NUM];
 
-	// origin point
-	gramVertices[0] = 0;
-	gramVertices[1] = 0;
-	gramVertices[2] = 0;
-
-	// outer vertices
-	float* outer = gramVertices + 3 + 3 * ANGLE_NUM;
-	for (int i = 0; i < ANGLE_NUM; ++i) {
-		float radian = (0.5f + (float)i / ANGLE_NUM * 2) * PAI;
-		outer[3 * i] = RADIUS * std::cos(radian);
-		outer[3 * i + 1] = RADIUS * std::sin(radian);
-		outer[3 * i + 2] = 0;
-	}
-
-	// calculate inner vertices using outers
-	float* inner = gramVertices + 3;
-
-	// another way to calculate inners
-	float radian = PAI * (1 - 2.0f / ANGLE_NUM);
-	float innerRadius = std::sin(radian - PAI / 2) * RADIUS / std::sin(PAI - radian / 2);
-	for (int i = 0; i < ANGLE_NUM; ++i) {
-		float radian = (0.5f - 1.0f / ANGLE_NUM + (float)i / ANGLE_NUM * 2) * PAI;
-		inner[3 * i] = innerRadius * std::cos(radian);
-		inner[3 * i + 1] = innerRadius * std::sin(radian);
-		inner[3 * i + 2] = 0;
-	}
-
-	// calculate triangle index
-	for (int i = 0; i < ANGLE_NUM; ++i) {
-		// i-th outer triangle include: i-th outer vertex, i-th inner vertex, i+1-th inner vertex
-		outerIndices[3 * i] = ANGLE_NUM + 1 + i;
-		outerIndices[3 * i + 1] = 1 + i;
-		outerIndices[3 * i + 2] = 1 + (i + 1) % ANGLE_NUM;
-		// i-th inner triangle include: origin point, i-th inner vertex, i+1-th inner vertex
-		innerIndices[3 * i] = 0;
-		innerIndices[3 * i + 1] = 1 + i;
-		innerIndices[3 * i + 2] = 1 + (i + 1) % ANGLE_NUM;
-	}
+	buildGram(gramVertices, innerIndices, outerIndices);
 
 	unsigned int gramVBOs[2], gramVAOs[2], gramEBOs[2];
 	glGenVertexArrays(2, gramVAOs);
@@ -160,50 +550,6 @@ int main() {
 
 	// set up vertex data (and buffer(s)) and configure vertex attributes for cube
 	// ------------------------------------------------------------------
-	float cubeVertices[] = {
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-
-		 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		 0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-	};
-
 	unsigned int cubeVBO, cubeVAO;
 	glGenVertexArrays(1, &cubeVAO);
 	glGenBuffers(1, &cubeVBO);
@@ -211,7 +557,7 @@ int main() {
 	glBindVertexArray(cubeVAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
 
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
@@ -220,98 +566,20 @@ int main() {
 
 	// set up sphere and surface data
 	// ------------------------------
-	float vertices[] = {
-		0.0f, 0.0f, RADIUS,
-		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
-		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-
-		0.0f, 0.0f, RADIUS,
-		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
-		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-
-		0.0f, 0.0f, RADIUS,
-		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-
-		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
-		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
-	};
-
-	float surfaceVertices[] = {
-		 1.0f,  0.0f,  1.0f,
-		 1.0f,  0.0f, -1.0f,
-		-1.0f,  0.0f, -1.0f,
-		-1.0f,  0.0f, -1.0f,
-		-1.0f,  0.0f,  1.0f,
-		 1.0f,  0.0f,  1.0f,
-	};
-
-
-	const unsigned int vertexSize = sizeof(vertices) / 3 / sizeof(float) * pow(4, EPOCH);
-	float* finalVertices = new float[vertexSize * (long long)3];
-	float* textCoords = new float[vertexSize * (long long)2];
-	float* normals = new float[vertexSize * (long long)3];
-
-	memcpy(finalVertices, vertices, sizeof(vertices));
-
-	for (int size = sizeof(vertices) / sizeof(float); size < vertexSize * (long long)3; size *= 4) {
-		for (int j = 0; j < size; j += 9) {
-			float* v0 = finalVertices + size - j - 9;
-			float* v1 = v0 + 3;
-			float* v2 = v1 + 3;
-			float v01[] = { v0[0] + v1[0], v0[1] + v1[1], v0[2] + v1[2] };
-			float v02[] = { v0[0] + v2[0], v0[1] + v2[1], v0[2] + v2[2] };
-			float v12[] = { v2[0] + v1[0], v2[1] + v1[1], v2[2] + v1[2] };
-			norm(v01, RADIUS);
-			norm(v02, RADIUS);
-			norm(v12, RADIUS);
-			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 9, v0, v01, v02);
-			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 18, v1, v01, v12);
-			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 27, v2, v02, v12);
-			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 36, v01, v02, v12);
-		}
-	}
-
-	for (int i = 0; i < vertexSize; ++i) {
-		float* v = finalVertices + (long long)3 * i;
-		float x = acos(v[0] / RADIUS) / (2 * PAI);
-		float y = acos(v[1] / RADIUS / sin(2 * PAI * x)) / (2 * PAI);
-		textCoords[2 * i] = -x * REPEAT;
-		textCoords[2 * i + 1] = -y * REPEAT;
-	}
-
-	for (int i = 0; i < vertexSize * 3; i += 9) {
-		float* v[] = { finalVertices + i, finalVertices + i + 3, finalVertices + i + 6 };
-		float normal[3];
-		for (int j = 0; j < 3; ++j) {
-			normal[j] = 0;
-			for (int k1 = 0; k1 < 3; ++k1) {
-				normal[j] += v[k1][(j + 1) % 3] * v[(k1 + 1) % 3][(j + 2) % 3] - v[(k1 + 1) % 3][(j + 1) % 3] * v[k1][(j + 2) % 3];
-			}
-		}
-		norm(normal, 1.0f);
-		if (normal[0] * v[0][0] + normal[1] * v[0][1] + normal[2] * v[0][2] < 0) {
-			normal[0] = -normal[0];
-			normal[1] = -normal[1];
-			normal[2] = -normal[2];
-		}
-		copyTri(normals + i, normal, normal, normal);
-	}
-
-	float* tmp = new float[vertexSize * (long long)8];
-	for (int i = 0; i < vertexSize; ++i) {
-		memcpy(tmp + (long long)8 * i, finalVertices + (long long)3 * i, 3 * sizeof(float));
-		memcpy(tmp + (long long)8 * i + 3, textCoords + (long long)2 * i, 2 * sizeof(float));
-		memcpy(tmp + (long long)8 * i + 5, normals + (long long)3 * i, 3 * sizeof(float));
+	// startup built the sphere for the first settings, a benchmark sweep may ask for others
+	if (assets.sphereEpoch != settings.epoch) {
+		assets.sphereVertices = buildSphere(settings.epoch);
+		assets.sphereEpoch = settings.epoch;
 	}
+	const std::vector<float>& sphereVertices = assets.sphereVertices;
+	const unsigned int vertexSize = (unsigned int)(sphereVertices.size() / 8);
 
 	unsigned int sphereVBO, sphereVAO;
 	glGenVertexArrays(1, &sphereVAO);
 	glGenBuffers(1, &sphereVBO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexSize * (long long)8 * sizeof(float), tmp, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
 
 	glBindVertexArray(sphereVAO);
 
@@ -325,12 +593,12 @@ int main() {
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
-	unsigned int surfaceVAO;
+	unsigned int surfaceVBO, surfaceVAO;
 	glGenVertexArrays(1, &surfaceVAO);
-	glGenBuffers(1, &sphereVBO);
+	glGenBuffers(1, &surfaceVBO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(surfaceVertices), surfaceVertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, surfaceVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(SURFACE_VERTICES), SURFACE_VERTICES, GL_STATIC_DRAW);
 
 	glBindVertexArray(surfaceVAO);
 
@@ -338,92 +606,266 @@ int main() {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
-	delete[] finalVertices, textCoords, tmp;
-
-	unsigned int texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data = stbi_load("Resource/name.jpg", &width, &height, &nrChannels, 0);
-	if (data) {
-		// note that the awesomeface.png has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	} else {
-		std::cout << "Failed to load texture" << std::endl;
+	TextureLoader& textureLoader = assets.textureLoader;
+	unsigned int texture = assets.texture;
+	// --virtual-texture [image] samples the spheres through a virtual texture of the image (the demo texture by default)
+	std::unique_ptr<VirtualTexture> virtualTexture;
+	if (hasArg(argc, argv, "--virtual-texture")) {
+		const char* image = argValue(argc, argv, "--virtual-texture");
+		virtualTexture.reset(new VirtualTexture(VIRTUAL_TEXTURE_SLOTS, VIRTUAL_PAGES_PER_FRAME, VIRTUAL_FEEDBACK_SCALE));
+		if (!virtualTexture->open(image && image[0] != '-' ? image : std::string("Resource/") + IMG_PATH, true, textureLoader.mipmaps))
+			virtualTexture.reset();
 	}
-	stbi_image_free(data);
-
+	// --object-textures <n> gives the extra spheres n differently tinted textures, packed into one texture array or
+	// atlas by --texture-packing, or bound one by one with "none"
+	unsigned int objectImages = argList(argc, argv, "--object-textures", 0)[0];
+	const char* packingArg = argValue(argc, argv, "--texture-packing");
+	bool packObjects = !packingArg || std::string(packingArg) != "none";
+	TexturePacker objectPacker;
+	std::vector<unsigned int> objectTextures;
+	if (objectImages) {
+		int size;
+		std::vector<std::vector<unsigned char> > images = buildObjectImages(objectImages, textureLoader.mipmaps, size);
+		if (packObjects) {
+			std::vector<TexturePacker::Image> source;
+			for (size_t i = 0; i < images.size(); ++i)
+				source.push_back({ images[i].data(), size, size });
+			TexturePacker::Mode mode = !packingArg ? OBJECT_TEXTURE_PACKING : std::string(packingArg) == "atlas" ? TexturePacker::ATLAS : TexturePacker::ARRAY;
+			objectPacker.pack(source, mode, textureLoader.mipmaps);
+		}
+		// unpacked, or more than the packer's texture can hold
+		if (!objectPacker.images) {
+			std::vector<unsigned char> chain(MipmapGenerator::chainBytes(size, size, 4));
+			for (size_t i = 0; i < images.size(); ++i) {
+				unsigned int object;
+				glGenTextures(1, &object);
+				glBindTexture(GL_TEXTURE_2D, object);
+				textureLoader.mipmaps.generate(images[i].data(), size, size, 4, chain.data());
+				const unsigned char* level = images[i].data();
+				for (int l = 0, w = size; l < MipmapGenerator::levels(size, size); ++l, w = std::max(1, w / 2)) {
+					glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, w, w, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+					level = (l == 0 ? chain.data() : level + (size_t)w * w * 4);
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				objectTextures.push_back(object);
+			}
+		}
+		if (objectPacker.images)
+			objectPacker.report(std::cout);
+		else
+			std::cout << "object textures: " << objectImages << " textures of " << size << "x" << size << ", bound one by one" << std::endl;
+	}
+	// distinct object images the last frame drew, each would be a bind of its own without packing
+	int objectImagesDrawn = 0;
 	
 	unsigned int cubemapTexture;
 	glGenTextures(1, &cubemapTexture);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 	for (int i = 0; i < 6; i++) {
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL
+			0, GL_RGB, settings.envSize, settings.envSize, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL
 		);
 	}
 
-	unsigned int framebuffer[6];
-	glGenFramebuffers(6, framebuffer);
-
-	for (int i = 0; i < 6; i++) {
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer[i]);
-		// glBindTexture(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemapTexture);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemapTexture, 0);
-		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-			std::cout << i << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-	}
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-	std::vector<glm::mat4> views{
-		glm::lookAt(glm::vec3(3.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(-3.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
-		glm::lookAt(glm::vec3(0.0f, -3.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, -3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+	SHIrradiance shIrradiance(cubemapTexture, SH_SIZE);
+	PlanarShadow planarShadow(SHADOW_TEX_SIZE);
+	ShadowMap shadowMap(SHADOW_MAP_SIZE, SHADOW_PERSPECTIVE);
+	std::vector<ShadowCaster> shadowCasters{
+		{ glm::mat4(1.0f), sphereVAO, vertexSize, RADIUS },
+	};
+
+	// world matrices are recomputed each frame for the nodes that moved
+	TransformHierarchy scene;
+	SceneNodes nodes = buildScene(scene, settings.objects);
+	scene.update();
+	for (size_t i = 0; i < nodes.objects.size(); ++i)
+		shadowCasters.push_back({ scene.world(nodes.objects[i]), sphereVAO, vertexSize, RADIUS });
+	// the environment is static, so the cubemap is re-rendered only when marked dirty
+	bool envDirty = true;
+	// the SH readback waits for the sphere to be on screen, so it is tracked apart from the faces
+	bool irradianceDirty = true;
+
+	std::vector<glm::mat4> views = environmentViews();
+	const char* faceNames[] = { "+X", "-X", "+Y", "-Y", "+Z", "-Z" };
+
+	glm::mat4 surfaceModel = scene.world(nodes.surface);
+
+#ifdef HEADLESS
+	// the benchmarks draw straight to the bound framebuffer, headless that is the frame graph's backbuffer
+	glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+#endif
+	// deletes the scene's buffers and textures, after the render loop or instead of it when a benchmark ran
+	auto release = [&]() {
+		if (!objectTextures.empty())
+			glDeleteTextures((GLsizei)objectTextures.size(), objectTextures.data());
+		glDeleteVertexArrays(1, &cubeVAO);
+		glDeleteBuffers(1, &cubeVBO);
+		glDeleteVertexArrays(2, gramVAOs);
+		glDeleteBuffers(2, gramVBOs);
+		glDeleteBuffers(2, gramEBOs);
+		glDeleteVertexArrays(1, &sphereVAO);
+		glDeleteBuffers(1, &sphereVBO);
+		glDeleteVertexArrays(1, &surfaceVAO);
+		glDeleteBuffers(1, &surfaceVBO);
+		glDeleteTextures(1, &cubemapTexture);
+	};
+	bool benchmark = true;
+	if (hasArg(argc, argv, "--shadow-bench"))
+		shadowBenchmark(shadowMap, depthShader, shadowShader, sphereVAO, vertexSize);
+	else if (hasArg(argc, argv, "--instancing-bench"))
+		instancingBenchmark(textShader, assets.shaders[INSTANCED_TEXTURE_SHADER], shadowMap, depthShader, instancedDepthShader);
+	else if (hasArg(argc, argv, "--culling-bench"))
+		cullingBenchmark(textShader, assets.shaders[INSTANCED_TEXTURE_SHADER], assets.shaders[CULL_SHADER], shadowMap);
+	else if (hasArg(argc, argv, "--hiz-bench"))
+		occlusionBenchmark(textShader, assets.shaders[INSTANCED_TEXTURE_SHADER], plainShader, depthShader, assets.shaders[HIZ_SHADER], shadowMap);
+	else
+		benchmark = false;
+	if (benchmark) {
+		release();
+		return 0;
+	}
+	bool dumpGraph = hasArg(argc, argv, "--dump-graph");
+
+	FrameGraph graph;
+	// every pass is bracketed with GPU timestamps, --gpu-timings <file> writes the statistics as JSON on exit
+	// a benchmark keeps the GPU time of every measured frame
+	unsigned int warmupFrames = bench ? argList(argc, argv, "--warmup", BENCH_WARMUP_FRAMES)[0] : 0;
+	unsigned int measuredFrames = bench ? argList(argc, argv, "--bench-frames", BENCH_FRAMES)[0] : 0;
+	GpuTimer gpuTimer(GPU_TIMER_LATENCY, glm::max(GPU_TIMER_WINDOW, measuredFrames));
+	const char* gpuTimingsPath = argValue(argc, argv, "--gpu-timings");
+	graph.onPassBegin = [&](const std::string& name) { gpuTimer.begin(name); };
+	graph.onPassEnd = [&](const std::string& name) { gpuTimer.end(name); };
+	unsigned long long frame = 0;
+	// draws are recorded on the job pool, one queue and list per view, and replayed by the GL thread
+	JobPool jobs;
+	GLCommandBackend backend;
+	RenderQueue envQueues[6];
+	CommandList envLists[6];
+	RenderQueue mainQueue;
+	CommandList mainList;
+	// runs of draws sharing a mesh become instanced draws of the INSTANCED variants
+	bool instancing = !hasArg(argc, argv, "--no-instancing");
+	mainQueue.minInstances = instancing ? INSTANCING_MIN_RUN : 0;
+	mainQueue.setInstancedProgram(reflectShader.ID, assets.shaders[INSTANCED_REFLECT_SHADER].ID);
+	mainQueue.setInstancedProgram(plainShader.ID, assets.shaders[INSTANCED_PLAIN_SHADER].ID);
+	mainQueue.setInstancedProgram(textShader.ID, assets.shaders[INSTANCED_TEXTURE_SHADER].ID);
+	// --gpu-culling submits the spheres unculled and lets the GPU drop the instances outside the view
+	bool gpuCulling = instancing && hasArg(argc, argv, "--gpu-culling");
+	GpuInstanceCuller culler(assets.shaders[CULL_SHADER].ID);
+	mainQueue.gpuCulling = gpuCulling;
+	if (gpuCulling)
+		backend.culler = &culler;
+	// --hiz skips the spheres hidden behind the cube and the sphere in the last depth pyramid read back
+	std::unique_ptr<HiZBuffer> hiz;
+	if (hasArg(argc, argv, "--hiz"))
+		hiz.reset(new HiZBuffer(SCR_WIDTH / HIZ_SCALE, SCR_HEIGHT / HIZ_SCALE));
+	// packed, the object draws bind one texture for all their images
+	auto reportObjectBinds = [&]() {
+		int binds = objectPacker.images ? std::min(objectImagesDrawn, 1) : objectImagesDrawn;
+		std::cout << "object textures: " << objectImagesDrawn << " images drawn with " << binds << " texture binds";
+		if (objectPacker.images)
+			std::cout << ", " << objectImagesDrawn - binds << " binds saved per frame";
+		std::cout << " (" << mainQueue.sorted.textures << " draw binds in the main view)" << std::endl;
 	};
 
+	// a fixed number of frames at a fixed time step for benchmarks and headless runs, 0 runs until the window is closed
+	unsigned long long frameLimit = warmupFrames + measuredFrames;
+#ifdef HEADLESS
+	if (!frameLimit)
+		frameLimit = headlessFrames;
+#endif
+	bool fixedStep = frameLimit != 0;
+	// reproducible runs wait for their textures instead of starting with placeholders
+	if (fixedStep)
+		textureLoader.finish();
+	auto frameStart = std::chrono::steady_clock::now();
+
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window)) {
+	while (!frameLimit || frame < frameLimit) {
+#ifndef HEADLESS
+		if (glfwWindowShouldClose(window))
+			break;
+		double time = fixedStep ? frame * FIXED_TIMESTEP : glfwGetTime();
+
 		// input
 		// -----
 		processInput(window);
+#else
+		double time = frame * FIXED_TIMESTEP;
+#endif
+
+		textureLoader.update();
+		std::vector<TextureLoader::StreamTiming> streamed = textureLoader.timings();
+		if (!streamed.empty()) {
+			StreamFormat restore(std::cout);
+			for (size_t i = 0; i < streamed.size(); ++i)
+				std::cout << "texture " << streamed[i].path << " (" << streamed[i].width << "x" << streamed[i].height << "): first levels after "
+					<< std::fixed << std::setprecision(2) << streamed[i].firstMs << " ms, full resolution after " << streamed[i].fullMs << " ms over "
+					<< streamed[i].updates << " updates" << std::endl;
+		}
 
 		// render
 		// ------
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clear the depth buffer now!
-		glm::mat4 view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
-		glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 model = glm::mat4(1.0f);
-
-		// render gram
-		// -----------
-		plainShader.use();
-		
-		plainShader.setMat4("projection", projection);
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first	
-		model = glm::translate(model, TRANSLATE_PANTAGRAM);
-		model = glm::scale(model, SCALE_PANTAGRAM);
-		// model = glm::rotate(model, 1.0f, glm::vec3(1.0f, 0.0f, 0.0f));
-		plainShader.setMat4("model", model);
-		
+		animateScene(scene, nodes, time);
+		scene.update();
+		SceneTransforms transforms = sceneTransforms(scene, nodes);
+		const glm::mat4& view = transforms.view;
+		const glm::mat4& projection = transforms.projection;
+		const glm::mat4& gramModel = transforms.gram;
+		const glm::mat4& cubeModel = transforms.cube;
+		const glm::mat4& sphereModel = transforms.sphere;
+		const glm::mat4& lightModel = transforms.light;
+
+		// normalized view depth of an object's origin, for front-to-back sorting
+		auto viewDepth = [&](const glm::mat4& model) {
+			return (-(view * model[3]).z - 0.1f) / (100.0f - 0.1f);
+		};
+
+		// the environment only has consumers while the reflective cube or the SH-lit sphere is on screen
+		glm::mat4 viewProjection = projection * view;
+		bool cubeVisible = sphereInFrustum(viewProjection, TRANSLATE_CUBE, SCALE_CUBE.x * SQRT3 / 2);
+		bool sphereVisible = sphereInFrustum(viewProjection, TRANSLATE_SPHERE, RADIUS * SPHERE_SCALE);
+
+		// the texture streams in by the largest on-screen diameter in pixels of the spheres sampling it
+		auto screenSize = [&](const glm::vec3& center, float radius) {
+			float distance = glm::max(-(view * glm::vec4(center, 1.0f)).z, radius);
+			return projection[1][1] * radius / distance * SCR_HEIGHT;
+		};
+		std::vector<glm::mat4> texturedModels;
+		if (sphereVisible)
+			texturedModels.push_back(sphereModel);
+		for (size_t i = 0; i < nodes.objects.size() && !objectImages; ++i) {
+			const glm::mat4& model = scene.world(nodes.objects[i]);
+			if (sphereInFrustum(viewProjection, glm::vec3(model[3]), RADIUS * model[0][0]))
+				texturedModels.push_back(model);
+		}
+		float texturePriority = 0.0f;
+		for (size_t i = 0; i < texturedModels.size(); ++i)
+			texturePriority = glm::max(texturePriority, screenSize(glm::vec3(texturedModels[i][3]), RADIUS * glm::length(glm::vec3(texturedModels[i][0]))));
+		textureLoader.prioritize(texture, texturePriority);
+
+		graph.reset();
+#ifdef HEADLESS
+		int framebufferWidth = window->width, framebufferHeight = window->height;
+		int backbuffer = graph.importBackbuffer("backbuffer", framebufferWidth, framebufferHeight, window->fbo);
+#else
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		int backbuffer = graph.importBackbuffer("backbuffer", framebufferWidth, framebufferHeight);
+#endif
+		int environment = graph.importTexture("environment", cubemapTexture, GL_TEXTURE_CUBE_MAP, settings.envSize, settings.envSize);
+		int shadows = USE_SHADOW_MAP ? graph.importTexture("shadow map", shadowMap.texture, GL_TEXTURE_2D, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE)
+			: graph.importTexture("planar shadow", planarShadow.texture, GL_TEXTURE_2D, SHADOW_TEX_SIZE, SHADOW_TEX_SIZE);
+		FrameGraph::TextureDesc envDepthDesc = { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, (int)settings.envSize, (int)settings.envSize };
+
 		/*
 		float colours[][4] = {
 			{ 1.0f, 1.0f, 1.0f, 1.0f },
@@ -443,161 +885,1572 @@ int main() {
 			{ 1.0f, 1.0f, 1.0f, 1.0f },
 		};
 
-		for (int i = 0; i < 6; ++i) {
-			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer[i]);
-			// glEnable(GL_DEPTH_TEST); // enable depth testing (is disabled for rendering screen-space quad)
-
-			// make sure we clear the framebuffer's content
-			glClearColor(colours[i][0], colours[i][1], colours[i][2], colours[i][3]);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			plainShader.setMat4("view", views[i]);
-			plainShader.setVec3("colour", CORE_COLOR);
-			glBindVertexArray(gramVAOs[0]);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glDrawElements(GL_TRIANGLES, sizeof(innerIndices) / sizeof(unsigned int), GL_UNSIGNED_INT, 0);
-			// then we draw the second triangle using the data from the second VAO
-			// when we draw the second triangle we want to use a different shader program so we switch to the shader program with our yellow fragment shader.
-			plainShader.setVec3("colour", LINE_COLOR);
-			glBindVertexArray(gramVAOs[1]);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			glLineWidth(LINE_WIDTH);
-			glDrawElements(GL_TRIANGLES, sizeof(outerIndices) / sizeof(unsigned int), GL_UNSIGNED_INT, 0);
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		// glDisable(GL_DEPTH_TEST); // disable depth test so screen-space quad isn't discarded due to depth test.
-		// clear all relevant buffers
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // set clear color to white (not really necessery actually, since we won't be able to see behind the quad anyways)
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		plainShader.setMat4("view", view);
-		plainShader.setVec3("colour", CORE_COLOR);
-		glBindVertexArray(gramVAOs[0]);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glDrawElements(GL_TRIANGLES, sizeof(innerIndices) / sizeof(unsigned int), GL_UNSIGNED_INT, 0);
-		// then we draw the second triangle using the data from the second VAO
-		// when we draw the second triangle we want to use a different shader program so we switch to the shader program with our yellow fragment shader.
-		plainShader.setVec3("colour", LINE_COLOR);
-		glBindVertexArray(gramVAOs[1]);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glLineWidth(LINE_WIDTH);
-		glDrawElements(GL_TRIANGLES, sizeof(outerIndices) / sizeof(unsigned int), GL_UNSIGNED_INT, 0);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-		// render cube
-		// -----------
-		// activate shader
-		reflectShader.use();
-		reflectShader.setVec3("colour", CUBE_COLOR);
-		reflectShader.setVec3("cameraPos", CAMERA_POS);
-		reflectShader.setMat4("view", view);
-		reflectShader.setMat4("projection", projection);
-
-		// create transformations
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first	
-		model = glm::translate(model, TRANSLATE_CUBE);
-		model = glm::scale(model, SCALE_CUBE);
-		model = glm::rotate(model, (float)(glfwGetTime() / 10), glm::vec3(0.5f, 1.0f, 0.0f));
-		
-		// retrieve the matrix uniform locations
-		// pass them to the shaders (3 different ways)
-		// note: currently we set the projection matrix each frame, but since the projection matrix rarely changes it's often best practice to set it outside the main loop only once.
-		reflectShader.setMat4("model", model);
-
-		// render box
-		glBindVertexArray(cubeVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);		
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		// render sphere
-		// -------------
-		textShader.use();
-		textShader.setVec3("lightColor", LIGHT_COLOR);
-		textShader.setVec3("lightPos", LIGHT_POS);
-		textShader.setVec3("viewPos", CAMERA_POS);
-		textShader.setVec3("colour", SPHERE_COLOR);
-		textShader.setInt("texture", 0);
-
-		// view/projection transformations
-		textShader.setMat4("projection", projection);
-		textShader.setMat4("view", view);
-
-		// world transformation
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, TRANSLATE_SPHERE);
-		model = glm::scale(model, SCALE_SPHERE);
-		textShader.setMat4("model", model);
-
-		// render the cube
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(sphereVAO);
-		glDrawArrays(GL_TRIANGLES, 0, vertexSize);
+		// the star is submitted the same way into every view, filled first and outlined second
+		auto submitGram = [&](RenderQueue& queue) {
+			DrawItem fill = { plainShader.ID, gramVAOs[0], GL_TRIANGLES, (int)(sizeof(innerIndices) / sizeof(unsigned int)), true,
+				GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH, gramModel, CORE_COLOR };
+			DrawItem outline = { plainShader.ID, gramVAOs[1], GL_TRIANGLES, (int)(sizeof(outerIndices) / sizeof(unsigned int)), true,
+				GL_TEXTURE_2D, 0, GL_LINE, LINE_WIDTH, gramModel, LINE_COLOR };
+			queue.submit(0, false, viewDepth(gramModel), fill);
+			queue.submit(0, false, viewDepth(gramModel), outline);
+		};
 
-		shadowShader.use();
-		shadowShader.setMat4("projection", projection);
-		shadowShader.setMat4("view", view);
-		shadowShader.setMat4("model", model);
-		shadowShader.setFloat("surfaceY", SURFACE_Y);
-		shadowShader.setVec3("lightPos", LIGHT_POS);
-		glBindVertexArray(sphereVAO);
-		glDrawArrays(GL_TRIANGLES, 0, vertexSize);
+		// the light frustum is fitted up front, the recorded receiver setups read lightSpace
+		shadowCasters[0].model = sphereModel;
+		if (USE_SHADOW_MAP)
+			shadowMap.fit(LIGHT_POS, shadowCasters);
+
+		// record gram into the six faces of the environment cubemap
+		// -----------------------------------------------------------
+		std::vector<std::function<void()> > recordJobs;
+		if (envDirty) {
+			for (int i = 0; i < 6; ++i) {
+				recordJobs.push_back([&, i]() {
+					RenderQueue& queue = envQueues[i];
+					queue.clear();
+					queue.setViewProjection(projection * views[i]);
+					submitGram(queue);
+					envLists[i].reset();
+					queue.record(envLists[i]);
+				});
+			}
+		}
 
-		plainShader.use();
-		plainShader.setVec3("colour", LIGHT_COLOR);
-		plainShader.setMat4("projection", projection);
-		plainShader.setMat4("view", view);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, LIGHT_POS);
-		model = glm::scale(model, glm::vec3(0.05f));
-		plainShader.setMat4("model", model);
+		// record gram, cube, sphere, light and plane
+		// ------------------------------------------
+		recordJobs.push_back([&]() {
+			// uniforms shared by all draws of a program, recorded once when the queue switches to it
+			mainQueue.clear();
+			mainQueue.setViewProjection(viewProjection);
+			mainQueue.setProgramSetup(reflectShader.ID, [&](CommandList& list) {
+				list.setVec3("cameraPos", CAMERA_POS);
+			});
+			mainQueue.setProgramSetup(textShader.ID, [&](CommandList& list) {
+				list.setVec3("lightColor", LIGHT_COLOR);
+				list.setVec3("lightPos", LIGHT_POS);
+				list.setVec3("viewPos", CAMERA_POS);
+				list.setInt("ourTexture", 0);
+				list.setInt("useSH", shIrradiance.ready);
+				if (shIrradiance.ready)
+					list.setVec3Array("shCoeffs", shIrradiance.coeffs, 9);
+				list.setInt("useShadowMap", USE_SHADOW_MAP);
+				shadowMap.bind(list, 1, PCF_RADIUS);
+				if (virtualTexture)
+					virtualTexture->bind(list, 2);
+				else
+					list.setInt("useVirtualTexture", 0);
+				// samplers of different types may not share a unit, even unused ones
+				if (objectPacker.images) {
+					objectPacker.bind(list, 3);
+				} else {
+					list.setInt("ourTextures", 3);
+					list.setInt("atlasRects", 4);
+				}
+			});
+			mainQueue.setProgramSetup(surfaceShader.ID, [&](CommandList& list) {
+				list.setInt("shadowTexture", 0);
+				list.setInt("useShadowMap", USE_SHADOW_MAP);
+				shadowMap.bind(list, 1, PCF_RADIUS);
+			});
+
+			submitGram(mainQueue);
+			if (cubeVisible) {
+				DrawItem cube = { reflectShader.ID, cubeVAO, GL_TRIANGLES, 36, false, GL_TEXTURE_CUBE_MAP, cubemapTexture, GL_FILL, LINE_WIDTH, cubeModel, CUBE_COLOR };
+				mainQueue.submit(0, false, viewDepth(cubeModel), cube);
+			}
+			DrawItem sphere = { textShader.ID, sphereVAO, GL_TRIANGLES, (int)vertexSize, false, GL_TEXTURE_2D,
+				virtualTexture ? virtualTexture->atlas : assets.residency.use(texture), GL_FILL, LINE_WIDTH, sphereModel, SPHERE_COLOR, 0,
+				gpuCulling ? RADIUS : 0.0f };
+			mainQueue.submit(0, false, viewDepth(sphereModel), sphere);
+			std::vector<bool> imageDrawn(objectImages);
+			objectImagesDrawn = 0;
+			if (hiz)
+				hiz->beginFrame();
+			for (size_t i = 0; i < nodes.objects.size(); ++i) {
+				const glm::mat4& model = scene.world(nodes.objects[i]);
+				if (!gpuCulling && !sphereInFrustum(viewProjection, glm::vec3(model[3]), RADIUS * model[0][0]))
+					continue;
+				if (hiz && hiz->occludes(glm::vec3(model[3]), RADIUS * model[0][0]))
+					continue;
+				DrawItem object = sphere;
+				object.model = model;
+				if (objectImages) {
+					unsigned int image = (unsigned int)i % objectImages;
+					object.texture = objectPacker.images ? objectPacker.drawTexture() : objectTextures[image];
+					object.layer = objectPacker.images ? 1 + image : 0;
+					if (!imageDrawn[image]) {
+						imageDrawn[image] = true;
+						++objectImagesDrawn;
+					}
+				}
+				mainQueue.submit(0, false, viewDepth(object.model), object);
+			}
+			DrawItem light = { plainShader.ID, sphereVAO, GL_TRIANGLES, (int)vertexSize, false, GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH, lightModel, LIGHT_COLOR };
+			mainQueue.submit(0, false, viewDepth(lightModel), light);
+			DrawItem surface = { surfaceShader.ID, surfaceVAO, GL_TRIANGLES, (int)(sizeof(SURFACE_VERTICES) / sizeof(float) / 3), false,
+				GL_TEXTURE_2D, planarShadow.texture, GL_FILL, LINE_WIDTH, surfaceModel, LIGHT_COLOR };
+			mainQueue.submit(0, false, viewDepth(surfaceModel), surface);
+			mainList.reset();
+			mainQueue.record(mainList);
+		});
+		jobs.run(recordJobs);
+
+		// render gram into the six faces of the environment cubemap
+		// -----------------------------------------------------------
+		bool envRendered = false;
+		if (envDirty) {
+			irradianceDirty = true;
+			for (int i = 0; i < 6; ++i) {
+				// one transient depth buffer per face, the graph aliases them onto a single texture
+				int envDepth = graph.createTexture(std::string("environment depth ") + faceNames[i], envDepthDesc);
+				graph.addPass(std::string("environment ") + faceNames[i], [&](FrameGraph::PassBuilder& pass) {
+					pass.writeColor(environment, i);
+					pass.writeDepth(envDepth);
+					pass.clearColor(glm::vec4(colours[i][0], colours[i][1], colours[i][2], colours[i][3]));
+					pass.clearDepth();
+				}, [&, i]() {
+					backend.replay(envLists[i]);
+					envRendered = true;
+				});
+			}
+		}
+		if (irradianceDirty && sphereVisible) {
+			graph.addPass("irradiance readback", [&](FrameGraph::PassBuilder& pass) {
+				pass.read(environment);
+				pass.sideEffect();
+			}, [&]() {
+				shIrradiance.request();
+				irradianceDirty = false;
+			});
+		}
 
-		glBindVertexArray(sphereVAO);
-		glDrawArrays(GL_TRIANGLES, 0, vertexSize);
+		// shadows are only redrawn when the light or a caster has moved
+		graph.addPass("shadow", [&](FrameGraph::PassBuilder& pass) {
+			pass.write(shadows);
+		}, [&]() {
+			if (USE_SHADOW_MAP) {
+				shadowMap.render(depthShader, LIGHT_POS, shadowCasters, instancing ? &instancedDepthShader : nullptr);
+			} else {
+				planarShadow.update(shadowShader, LIGHT_POS, sphereModel, surfaceModel, SURFACE_Y, sphereVAO, vertexSize);
+			}
+		});
+
+		// depth of the large occluders, reduced into the pyramid the next frame's spheres are tested against
+		if (hiz) {
+			int pyramid = graph.importTexture("hi-z pyramid", hiz->texture(), GL_TEXTURE_2D, SCR_WIDTH / HIZ_SCALE, SCR_HEIGHT / HIZ_SCALE);
+			graph.addPass("hi-z", [&](FrameGraph::PassBuilder& pass) {
+				pass.write(pyramid);
+				pass.sideEffect();
+			}, [&]() {
+				std::vector<Occluder> occluders;
+				occluders.push_back({ cubeModel, cubeVAO, 36 });
+				occluders.push_back({ sphereModel, sphereVAO, vertexSize });
+				hiz->render(depthShader, assets.shaders[HIZ_SHADER], viewProjection, occluders);
+			});
+		}
 
-		plainShader.use();
-		plainShader.setVec3("colour", LIGHT_COLOR);
-		plainShader.setMat4("projection", projection);
-		plainShader.setMat4("view", view);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, SURFACE_Y - 0.01f, 0.0f));
-		model = glm::scale(model, SCALE_SURFACE);
-		plainShader.setMat4("model", model);
+		// the pages the spheres sample, read back for the next frame's virtual texture update
+		if (virtualTexture && !texturedModels.empty()) {
+			int feedback = graph.importTexture("virtual texture feedback", virtualTexture->feedback(), GL_TEXTURE_2D,
+				framebufferWidth / VIRTUAL_FEEDBACK_SCALE, framebufferHeight / VIRTUAL_FEEDBACK_SCALE);
+			graph.addPass("virtual texture feedback", [&](FrameGraph::PassBuilder& pass) {
+				pass.write(feedback);
+				pass.sideEffect();
+			}, [&]() {
+				virtualTexture->renderFeedback(assets.shaders[VT_FEEDBACK_SHADER], view, projection, framebufferWidth, framebufferHeight,
+					texturedModels, sphereVAO, vertexSize);
+			});
+		}
 
-		glBindVertexArray(surfaceVAO);
-		glDrawArrays(GL_TRIANGLES, 0, sizeof(surfaceVertices) / sizeof(float) / 3);
+		graph.addPass("main view", [&](FrameGraph::PassBuilder& pass) {
+			if (cubeVisible)
+				pass.read(environment);
+			pass.read(shadows);
+			pass.writeColor(backbuffer);
+			pass.writeDepth(backbuffer);
+			pass.clearColor(glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+			pass.clearDepth();
+		}, [&]() {
+			backend.replay(mainList);
+		});
+
+		graph.compile();
+		gpuTimer.beginFrame();
+		culler.beginFrame();
+		if (bench)
+			gpuTimer.begin("frame");
+		graph.execute();
+		if (bench)
+			gpuTimer.end("frame");
+		gpuTimer.endFrame();
+		assets.residency.update();
+		if (virtualTexture)
+			virtualTexture->update();
+		if (hiz)
+			hiz->update();
+		++frame;
+		if (!bench && GPU_TIMER_LOG_FRAMES && frame % GPU_TIMER_LOG_FRAMES == 0) {
+			gpuTimer.log(std::cout);
+			scene.report(std::cout);
+			if (gpuCulling)
+				culler.report(std::cout);
+			if (hiz)
+				hiz->report(std::cout);
+			assets.residency.report(std::cout);
+			if (virtualTexture)
+				virtualTexture->report(std::cout);
+			if (objectImages)
+				reportObjectBinds();
+#ifndef HEADLESS
+			std::ostringstream title;
+			title << "BUAA CG - GPU " << std::fixed << std::setprecision(2) << gpuTimer.totalMs() << " ms";
+			glfwSetWindowTitle(window, title.str().c_str());
+#endif
+		}
+		if (envRendered)
+			envDirty = false;
+		shIrradiance.poll();
+		if (dumpGraph) {
+			graph.dump(std::cout);
+			std::cout << "render queue: " << mainQueue.sorted.draws << " draws in " << mainQueue.sorted.calls << " draw calls, program/texture/vao changes "
+				<< mainQueue.submitted.programs << "/" << mainQueue.submitted.textures << "/" << mainQueue.submitted.vaos << " in submission order, "
+				<< mainQueue.sorted.programs << "/" << mainQueue.sorted.textures << "/" << mainQueue.sorted.vaos << " sorted" << std::endl;
+			std::cout << "command lists: " << mainList.size() << " commands (" << mainList.bytes() << " bytes) for the main view, recorded on "
+				<< jobs.threads() << " threads" << std::endl;
+			dumpGraph = false;
+		}
 
+#ifndef HEADLESS
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+#endif
+
+		// frame to frame time on the CPU, including the swap
+		auto frameEnd = std::chrono::steady_clock::now();
+		if (bench && frame > warmupFrames)
+			bench->cpuMs.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+		frameStart = frameEnd;
+		if (assets.firstFrameMs < 0.0) {
+			glFinish();
+			assets.firstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - PROCESS_START).count();
+			StreamFormat restore(std::cout);
+			std::cout << "first frame " << std::fixed << std::setprecision(2) << assets.firstFrameMs << " ms after start" << std::endl;
+		}
+	}
+	// unless the log just printed it
+	if (!bench && (!GPU_TIMER_LOG_FRAMES || frame % GPU_TIMER_LOG_FRAMES)) {
+		scene.report(std::cout);
+		if (gpuCulling)
+			culler.report(std::cout);
+		if (hiz)
+			hiz->report(std::cout);
+		if (virtualTexture)
+			virtualTexture->report(std::cout);
+		if (objectImages)
+			reportObjectBinds();
 	}
+	if (bench) {
+		// the last timer queries are still in flight
+		glFinish();
+		gpuTimer.beginFrame();
+		std::vector<double> gpuMs = gpuTimer.samples("frame");
+		bench->gpuMs.assign(gpuMs.end() - glm::min(gpuMs.size(), (size_t)measuredFrames), gpuMs.end());
+	}
+#ifdef HEADLESS
+	else
+		window->save(outputPath);
+#endif
 
-	glDeleteVertexArrays(1, &cubeVAO);
-	glDeleteBuffers(1, &cubeVBO);
+	if (gpuTimingsPath) {
+		std::ofstream out(gpuTimingsPath);
+		if (out)
+			gpuTimer.dump(out);
+		else
+			std::cout << "ERROR::GPU_TIMER::FILE_NOT_SUCCESFULLY_WRITTEN " << gpuTimingsPath << std::endl;
+	}
 
-	glfwTerminate();
+	release();
 	return 0;
 }
 
-void processInput(GLFWwindow* window) {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, true);
-}
+// renders the first frame of the scene on the CPU. --software writes it to --output with the first --threads
+// value (all cores by default), --software-bench times it for every --threads value (powers of two up to
+// all cores by default). The plane takes the projected shadows of shadow.vs instead of the shadow map and
+// the sphere has no SH ambient.
+int softwareRender(const SceneSettings& settings, int argc, char* argv[]) {
+	float gramVertices[2 * 3 * ANGLE_NUM + 3];
+	unsigned int innerIndices[3 * ANGLE_NUM];
+	unsigned int outerIndices[3 * ANGLE_NUM];
+	buildGram(gramVertices, innerIndices, outerIndices);
+	std::vector<float> sphereVertices = buildSphere(settings.epoch);
+	const int vertexSize = (int)(sphereVertices.size() / 8);
+	std::vector<glm::mat4> views = environmentViews();
+	TransformHierarchy scene;
+	SceneNodes nodes = buildScene(scene, settings.objects);
+	animateScene(scene, nodes, 0.0);
+	scene.update();
+	SceneTransforms transforms = sceneTransforms(scene, nodes);
+
+	SoftTexture texture;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* data = stbi_load("Resource/name.jpg", &texture.width, &texture.height, &texture.channels, 0);
+	if (data)
+		texture.texels.assign(data, data + (size_t)texture.width * texture.height * texture.channels);
+	else
+		std::cout << "Failed to load texture" << std::endl;
+	stbi_image_free(data);
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
-}
+	SoftCubemap environment;
+	environment.resize(settings.envSize);
+	SoftTarget frame(SCR_WIDTH, SCR_HEIGHT);
+
+	// one shader object per draw, the rasterizer shades fragments after all draws are submitted
+	SoftPlainShader gramFill, gramOutline, light, surface;
+	gramFill.colour = CORE_COLOR;
+	gramOutline.colour = LINE_COLOR;
+	light.colour = LIGHT_COLOR;
+	surface.colour = LIGHT_COLOR;
+	SoftReflectionShader cube;
+	cube.skybox = &environment;
+	cube.cameraPos = CAMERA_POS;
+	std::vector<glm::mat4> sphereModels(1, transforms.sphere);
+	for (size_t i = 0; i < nodes.objects.size(); ++i)
+		sphereModels.push_back(scene.world(nodes.objects[i]));
+	std::vector<SoftTextureShader> spheres(sphereModels.size());
+	std::vector<SoftShadowShader> shadows(sphereModels.size());
+	for (size_t i = 0; i < sphereModels.size(); ++i) {
+		spheres[i].model = shadows[i].model = sphereModels[i];
+		spheres[i].view = shadows[i].view = transforms.view;
+		spheres[i].projection = shadows[i].projection = transforms.projection;
+		spheres[i].lightPos = shadows[i].lightPos = LIGHT_POS;
+		spheres[i].viewPos = CAMERA_POS;
+		spheres[i].lightColor = LIGHT_COLOR;
+		spheres[i].colour = SPHERE_COLOR;
+		spheres[i].texture = &texture;
+		shadows[i].surfaceY = SURFACE_Y;
+		spheres[i].prepare();
+		shadows[i].prepare();
+	}
 
-void norm(float* v, float mod) {
-	float omod = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
-	float scale = mod / omod;
-	v[0] *= scale;
-	v[1] *= scale;
-	v[2] *= scale;
+	auto drawGram = [&](SoftRasterizer& rast, const glm::mat4& view) {
+		gramFill.model = gramOutline.model = transforms.gram;
+		gramFill.view = gramOutline.view = view;
+		gramFill.projection = gramOutline.projection = transforms.projection;
+		gramFill.prepare();
+		gramOutline.prepare();
+		rast.draw(gramFill, gramVertices, 3, ANGLE_NUM + 1, innerIndices, 3 * ANGLE_NUM);
+		rast.draw(gramOutline, gramVertices, 3, 2 * ANGLE_NUM + 1, outerIndices, 3 * ANGLE_NUM, true, LINE_WIDTH);
+	};
+	// draws the environment faces and the main view, returns the triangles rasterized
+	auto renderFrame = [&](SoftRasterizer& rast) {
+		long long triangles = 0;
+		for (int i = 0; i < 6; ++i) {
+			rast.begin(environment.faces[i], glm::vec4(1.0f));
+			drawGram(rast, views[i]);
+			rast.end();
+			triangles += rast.stats.triangles;
+		}
+
+		rast.begin(frame, glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+		drawGram(rast, transforms.view);
+		cube.model = transforms.cube;
+		cube.view = transforms.view;
+		cube.projection = transforms.projection;
+		cube.prepare();
+		rast.draw(cube, CUBE_VERTICES, 6, 36, NULL, 0);
+		for (size_t i = 0; i < spheres.size(); ++i)
+			rast.draw(spheres[i], sphereVertices.data(), 8, vertexSize, NULL, 0);
+		light.model = transforms.light;
+		light.view = transforms.view;
+		light.projection = transforms.projection;
+		light.prepare();
+		rast.draw(light, sphereVertices.data(), 8, vertexSize, NULL, 0);
+		surface.model = transforms.surface;
+		surface.view = transforms.view;
+		surface.projection = transforms.projection;
+		surface.prepare();
+		rast.draw(surface, SURFACE_VERTICES, 3, (int)(sizeof(SURFACE_VERTICES) / sizeof(float) / 3), NULL, 0);
+		// the shadows lie 0.01 above the plane, so they win the depth test against it
+		for (size_t i = 0; i < shadows.size(); ++i)
+			rast.draw(shadows[i], sphereVertices.data(), 8, vertexSize, NULL, 0);
+		rast.end();
+		return triangles + rast.stats.triangles;
+	};
+
+	bool bench = hasArg(argc, argv, "--software-bench");
+	std::vector<unsigned int> threadCounts;
+	if (argValue(argc, argv, "--threads")) {
+		threadCounts = argList(argc, argv, "--threads", 0);
+	} else {
+		unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int n = 1; n < cores && bench; n *= 2)
+			threadCounts.push_back(n);
+		threadCounts.push_back(cores);
+	}
+	if (!bench)
+		threadCounts.resize(1);
+	unsigned int frames = bench ? std::max(1u, argList(argc, argv, "--bench-frames", SOFTWARE_BENCH_FRAMES)[0]) : 1;
+
+	std::cout << "software rasterizer: " << SCR_WIDTH << "x" << SCR_HEIGHT << ", environment " << settings.envSize
+		<< ", epoch " << settings.epoch << ", " << settings.objects << " objects, " << frames << " frames per run" << std::endl;
+	std::cout << "threads  frame ms  Mtriangles/s" << std::endl;
+	for (size_t i = 0; i < threadCounts.size(); ++i) {
+		JobPool jobs(threadCounts[i]);
+		SoftRasterizer rast(jobs);
+		long long triangles = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int f = 0; f < frames; ++f)
+			triangles += renderFrame(rast);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		StreamFormat restore(std::cout);
+		std::cout << std::setw(7) << jobs.threads() << std::fixed << std::setprecision(2) << std::setw(10) << ms / frames
+			<< std::setw(14) << triangles / (ms * 1e3) << std::endl;
+	}
+
+	if (!bench) {
+		const char* outputPath = argValue(argc, argv, "--output");
+		if (!frame.save(outputPath ? outputPath : SOFTWARE_OUTPUT))
+			return -1;
+	}
+	return 0;
 }
 
-void copyTri(float* dst, float* v0, float* v1, float* v2) {
-	memcpy(dst, v0, 3 * sizeof(float));
-	memcpy(dst + 3, v1, 3 * sizeof(float));
-	memcpy(dst + 6, v2, 3 * sizeof(float));
+// renders every GOLDEN_CASES frame and compares it with <dir>/<golden>.png, dir is --golden-dir (default
+// GOLDEN_DIR) and must exist, --golden-cases <name,...> runs only the named cases. A failing case leaves
+// <name>.actual.png and <name>.diff.png next to the goldens, --update-golden stores the renders as the new
+// goldens instead. Returns non-zero if any case fails.
+int goldenTest(Window* window, SceneAssets& assets, int argc, char* argv[]) {
+	const char* dir = argValue(argc, argv, "--golden-dir");
+	if (!dir)
+		dir = GOLDEN_DIR;
+	bool update = hasArg(argc, argv, "--update-golden");
+	const char* casesArg = argValue(argc, argv, "--golden-cases");
+	std::string cases = casesArg ? std::string(",") + casesArg + "," : "";
+	int failed = 0, passed = 0;
+	for (size_t i = 0; i < sizeof(GOLDEN_CASES) / sizeof(GoldenCase); ++i) {
+		const GoldenCase& test = GOLDEN_CASES[i];
+		if (casesArg && cases.find(std::string(",") + test.name + ",") == std::string::npos)
+			continue;
+		std::string prefix = std::string(dir) + "/" + test.name;
+		std::string render = prefix + ".ppm";
+		std::vector<std::string> args{ argv[0], "--frames", std::to_string(test.frames), "--output", render };
+		std::vector<char*> caseArgv;
+		for (size_t a = 0; a < args.size(); ++a)
+			caseArgv.push_back(&args[a][0]);
+
+		int result;
+		if (test.software) {
+			result = softwareRender(test.settings, (int)caseArgv.size(), caseArgv.data());
+		} else {
+#ifdef HEADLESS
+			result = runScene(window, assets, test.settings, (int)caseArgv.size(), caseArgv.data(), NULL);
+#else
+			// a window keeps rendering until it is closed, the GL cases need the HEADLESS build
+			std::cout << "golden " << test.name << ": skipped, needs the HEADLESS build" << std::endl;
+			continue;
+#endif
+		}
+		Image actual;
+		if (result != 0 || !actual.load(render.c_str())) {
+			std::cout << "ERROR::GOLDEN:: " << test.name << " did not render" << std::endl;
+			++failed;
+			continue;
+		}
+		std::remove(render.c_str());
+
+		std::string goldenPath = std::string(dir) + "/" + (test.golden ? test.golden : test.name) + ".png";
+		if (update && !test.golden) {
+			if (!actual.savePng(goldenPath.c_str()))
+				++failed;
+			continue;
+		}
+		Image golden;
+		if (!golden.load(goldenPath.c_str())) {
+			std::cout << "golden " << test.name << ": FAIL, no golden at " << goldenPath << std::endl;
+			actual.savePng((prefix + ".actual.png").c_str());
+			++failed;
+			continue;
+		}
+		if (golden.width != actual.width || golden.height != actual.height) {
+			std::cout << "golden " << test.name << ": FAIL, " << actual.width << "x" << actual.height << " against a "
+				<< golden.width << "x" << golden.height << " golden" << std::endl;
+			actual.savePng((prefix + ".actual.png").c_str());
+			++failed;
+			continue;
+		}
+		double psnr = Image::psnr(actual, golden), ssim = Image::ssim(actual, golden);
+		bool pass = psnr >= test.minPsnr && ssim >= test.minSsim;
+		{
+			StreamFormat restore(std::cout);
+			std::cout << "golden " << test.name << ": " << (pass ? "PASS" : "FAIL") << std::fixed << std::setprecision(2)
+				<< ", psnr " << psnr << " dB (min " << test.minPsnr << "), ssim " << std::setprecision(4) << ssim
+				<< " (min " << test.minSsim << ")" << std::endl;
+		}
+		if (pass) {
+			++passed;
+		} else {
+			actual.savePng((prefix + ".actual.png").c_str());
+			Image::diff(actual, golden).savePng((prefix + ".diff.png").c_str());
+			++failed;
+		}
+	}
+	if (update)
+		std::cout << "golden images written to " << dir << std::endl;
+	else
+		std::cout << "golden: " << passed << " passed, " << failed << " failed" << std::endl;
+	return failed ? 1 : 0;
+}
+
+// loads the sphere texture from the JPEG (decode, glTexImage2D, glGenerateMipmap) and from the KTX cache in
+// every TEXTURE_REPORT_FORMATS format the context supports, and prints the time of the first run (transcoding
+// into the cache), of a later run (mapping the cache, warm in the page cache), the texture memory of the mip
+// chain and the PSNR of level 0 against the JPEG. Uncompressed RGB is counted at 4 bytes per texel, the way
+// drivers store it.
+int textureReport() {
+	std::string image = std::string("Resource/") + IMG_PATH;
+	auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	auto start = std::chrono::steady_clock::now();
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* data = stbi_load(image.c_str(), &width, &height, &channels, 3);
+	if (!data) {
+		std::cout << "Failed to load texture " << image << std::endl;
+		glDeleteTextures(1, &texture);
+		return 1;
+	}
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glFinish();
+	double jpegMs = elapsedMs(start);
+	Image reference(width, height);
+	reference.pixels.assign(data, data + (size_t)width * height * 3);
+	stbi_image_free(data);
+	size_t rgbBytes = 0;
+	for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+		rgbBytes += (size_t)w * h * 4;
+		if (w == 1 && h == 1)
+			break;
+	}
+
+	// level 0 is read back by drawing its texels into a framebuffer, glGetTexImage cannot decode every
+	// format on every driver
+	ShaderSource fetchSource;
+	fetchSource.vertexCode = "#version 330 core\n"
+		"void main() { gl_Position = vec4(vec2(gl_VertexID & 1, gl_VertexID >> 1) * 4.0 - 1.0, 0.0, 1.0); }\n";
+	fetchSource.fragmentCode = "#version 330 core\n"
+		"uniform sampler2D image;\n"
+		"out vec4 FragColor;\n"
+		"void main() { FragColor = texelFetch(image, ivec2(gl_FragCoord.xy), 0); }\n";
+	Shader fetch(fetchSource);
+	unsigned int vao, fbo, colour;
+	glGenVertexArrays(1, &vao);
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(1, &colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour);
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	auto readBack = [&]() {
+		Image out(width, height);
+		fetch.use();
+		glBindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, out.pixels.data());
+		return out;
+	};
+	std::cout << image << " " << width << "x" << height << ", full mip chain, psnr of level 0 against the JPEG" << std::endl;
+	std::cout << "format  first run ms  load ms  texture KB  saved  psnr dB" << std::endl;
+	StreamFormat restore(std::cout);
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(6) << "jpeg" << std::right << std::setw(14) << "-" << std::setw(9) << jpegMs
+		<< std::setw(12) << rgbBytes / 1024 << std::setw(7) << "-" << std::setw(9) << "-" << std::endl;
+	for (size_t i = 0; i < sizeof(TEXTURE_REPORT_FORMATS) / sizeof(GLenum); ++i) {
+		GLenum format = TEXTURE_REPORT_FORMATS[i];
+		if (!TextureCache::supported(format)) {
+			std::cout << std::left << std::setw(6) << TextureCache::name(format) << std::right << "  not supported by this context" << std::endl;
+			continue;
+		}
+		std::string cache = TextureCache::path(image, format, true);
+		start = std::chrono::steady_clock::now();
+		if (!TextureCache::build(image, cache, format, true))
+			continue;
+		double buildMs = elapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		KtxFile file;
+		if (!file.open(cache))
+			continue;
+		file.upload((int)file.levels.size());
+		glFinish();
+		double loadMs = elapsedMs(start);
+		size_t bytes = 0;
+		for (size_t level = 0; level < file.levels.size(); ++level) {
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint)level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += size;
+		}
+		file.close();
+		Image decoded = readBack();
+
+		std::cout << std::left << std::setw(6) << TextureCache::name(format) << std::right << std::setw(14) << buildMs
+			<< std::setw(9) << loadMs << std::setw(12) << bytes / 1024 << std::setw(6) << 100.0 * (1.0 - (double)bytes / rgbBytes) << "%"
+			<< std::setw(9) << Image::psnr(reference, decoded) << std::endl;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &colour);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteProgram(fetch.ID);
+	glDeleteTextures(1, &texture);
+	return 0;
+}
+
+// times the CPU mip chain of the demo texture and of a --mipmap-size square (MIPMAP_BENCH_SIZE by default, the
+// demo texture tiled) for every filter and instruction set, on one thread and on the job pool, against
+// glGenerateMipmap of the same image
+int mipmapBenchmark(int argc, char* argv[]) {
+	std::string image = std::string("Resource/") + IMG_PATH;
+	int width, height, channels;
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* data = stbi_load(image.c_str(), &width, &height, &channels, 4);
+	if (!data) {
+		std::cout << "Failed to load texture " << image << std::endl;
+		return 1;
+	}
+	std::vector<unsigned char> demo(data, data + (size_t)width * height * 4);
+	stbi_image_free(data);
+
+	JobPool jobs;
+	auto fastestMs = [](const std::function<void()>& run) {
+		double best = 0.0;
+		for (int i = 0; i < MIPMAP_BENCH_RUNS; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = i == 0 ? ms : std::min(best, ms);
+		}
+		return best;
+	};
+	auto row = [](const std::string& name, unsigned int threads, double ms, int w, int h) {
+		std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(8) << threads << std::setw(11) << ms
+			<< std::setw(11) << (double)w * h / ms / 1000.0 << std::endl;
+	};
+
+	std::vector<unsigned int> sizes = argList(argc, argv, "--mipmap-size", MIPMAP_BENCH_SIZE);
+	sizes.insert(sizes.begin(), 0);
+	StreamFormat restore(std::cout);
+	std::cout << std::fixed << std::setprecision(2);
+	for (size_t s = 0; s < sizes.size(); ++s) {
+		int w = sizes[s] ? (int)sizes[s] : width, h = sizes[s] ? (int)sizes[s] : height;
+		std::vector<unsigned char> tiled;
+		const unsigned char* pixels = demo.data();
+		if (sizes[s]) {
+			tiled.resize((size_t)w * h * 4);
+			for (int y = 0; y < h; ++y)
+				for (int x = 0; x < w; ++x)
+					memcpy(&tiled[((size_t)y * w + x) * 4], &demo[((size_t)(y % height) * width + x % width) * 4], 4);
+			pixels = tiled.data();
+		}
+		std::vector<unsigned char> chain(MipmapGenerator::chainBytes(w, h, 4));
+		std::cout << (sizes[s] ? "tiled " : image + " ") << w << "x" << h << " RGBA, " << MipmapGenerator::levels(w, h) << " levels" << std::endl;
+		std::cout << "  filter               threads         ms  Mtexel/s" << std::endl;
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		glFinish();
+		row("glGenerateMipmap", 1, fastestMs([]() {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glFinish();
+		}), w, h);
+		glDeleteTextures(1, &texture);
+
+		const MipmapGenerator::Filter filters[] = { MipmapGenerator::BOX, MipmapGenerator::BOX, MipmapGenerator::KAISER, MipmapGenerator::KAISER };
+		const bool srgb[] = { false, true, false, true };
+		for (int f = 0; f < 4; ++f) {
+			for (int isa = MipmapGenerator::SCALAR; isa <= MipmapGenerator::bestIsa(); ++isa) {
+				for (int pooled = 0; pooled < (jobs.threads() > 1 ? 2 : 1); ++pooled) {
+					MipmapGenerator generator(filters[f], srgb[f], pooled ? &jobs : NULL);
+					generator.isa = (MipmapGenerator::Isa)isa;
+					std::string name = std::string(filters[f] == MipmapGenerator::BOX ? "box" : "kaiser") + (srgb[f] ? " srgb " : " ")
+						+ MipmapGenerator::name(generator.isa);
+					row(name, pooled ? jobs.threads() : 1, fastestMs([&]() { generator.generate(pixels, w, h, 4, chain.data()); }), w, h);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// requests --residency-textures copies of the demo texture without loading them, then for --bench-frames frames uses a
+// window of RESIDENCY_BENCH_VISIBLE of them that moves by one texture per frame, under --texture-budget MB. Prints
+// the residency counters as it goes, the peak against the budget, the CPU time of the loader and the manager and
+// how long the streamed (re)loads took to their first levels and to full resolution.
+int residencyBenchmark(int argc, char* argv[]) {
+	unsigned int count = std::max(1u, argList(argc, argv, "--residency-textures", RESIDENCY_BENCH_TEXTURES)[0]);
+	unsigned int frames = argList(argc, argv, "--bench-frames", RESIDENCY_BENCH_FRAMES)[0];
+	size_t budget = (size_t)argList(argc, argv, "--texture-budget", RESIDENCY_BENCH_BUDGET_MB)[0] << 20;
+	GLenum format = TextureCache::supported(TEXTURE_FORMAT) ? TEXTURE_FORMAT : 0;
+	std::string image = std::string("Resource/") + IMG_PATH;
+
+	JobPool mipmapJobs;
+	TextureLoader loader(TEXTURE_UPLOAD_BYTES);
+	loader.mipmaps = MipmapGenerator(MIPMAP_FILTER, MIPMAP_SRGB, &mipmapJobs);
+	TextureResidency residency(loader, budget);
+	std::vector<unsigned int> textures;
+	for (unsigned int i = 0; i < count; ++i)
+		textures.push_back(residency.request(image, GL_REPEAT, GL_LINEAR, true, true, format, false));
+	std::cout << count << " textures of " << image << " (" << TextureCache::name(format) << "), " << RESIDENCY_BENCH_VISIBLE
+		<< " used per frame, budget " << (budget >> 20) << " MB" << std::endl;
+	// the first load transcodes a missing or stale cache, it is not timed
+	residency.use(textures[0]);
+	residency.update();
+	loader.finish();
+	loader.timings();
+
+	size_t peak = 0;
+	unsigned int overBudget = 0;
+	unsigned int streams = 0;
+	double firstMs = 0.0, fullMs = 0.0;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frames; ++frame) {
+		for (unsigned int i = 0; i < RESIDENCY_BENCH_VISIBLE; ++i)
+			residency.use(textures[(frame + i) % count]);
+		loader.update();
+		residency.update();
+		std::vector<TextureLoader::StreamTiming> streamed = loader.timings();
+		for (size_t i = 0; i < streamed.size(); ++i, ++streams) {
+			firstMs += streamed[i].firstMs;
+			fullMs += streamed[i].fullMs;
+		}
+		TextureResidency::Counters counters = residency.counters();
+		peak = std::max(peak, counters.residentBytes);
+		if (counters.residentBytes > budget)
+			++overBudget;
+		if ((frame + 1) % 100 == 0) {
+			std::cout << "frame " << frame + 1 << " ";
+			residency.report(std::cout);
+		}
+	}
+	glFinish();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	residency.report(std::cout);
+	StreamFormat restore(std::cout);
+	std::cout << "peak " << (peak >> 10) << " KB of " << (budget >> 10) << " KB, " << overBudget << " frames over budget, "
+		<< std::fixed << std::setprecision(3) << ms / std::max(1u, frames) << " ms per frame" << std::endl;
+	if (streams)
+		std::cout << streams << " streamed loads, first levels after " << firstMs / streams << " ms, full resolution after "
+			<< fullMs / streams << " ms on average" << std::endl;
+	return 0;
+}
+
+// decode throughput of the demo texture and of any JPEGs listed after --jpeg-bench, from memory to RGBA: SSE2
+// kernels on one thread (the reference), AVX2 kernels on one thread, and AVX2 with --jpeg-threads threads (every
+// core by default), which only helps JPEGs with restart markers. Every output is checked against the reference.
+int jpegBenchmark(int argc, char* argv[]) {
+	std::vector<std::string> files(1, std::string("Resource/") + IMG_PATH);
+	for (int i = 1; i < argc; ++i)
+		if (std::string(argv[i]) == "--jpeg-bench")
+			for (int j = i + 1; j < argc && std::string(argv[j]).compare(0, 2, "--") != 0; ++j)
+				files.push_back(argv[j]);
+	int threads = (int)argList(argc, argv, "--jpeg-threads", std::max(1u, std::thread::hardware_concurrency()))[0];
+
+	int result = 0;
+	StreamFormat restore(std::cout);
+	std::cout << std::fixed << std::setprecision(2);
+	for (size_t f = 0; f < files.size(); ++f) {
+		std::ifstream stream(files[f].c_str(), std::ios::binary);
+		std::vector<unsigned char> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		int width, height, channels;
+		if (file.empty() || !stbi_info_from_memory(file.data(), (int)file.size(), &width, &height, &channels)) {
+			std::cout << "Failed to load texture " << files[f] << std::endl;
+			result = 1;
+			continue;
+		}
+		std::cout << files[f] << " " << width << "x" << height << ", " << file.size() / 1024 << " KB" << std::endl;
+		std::cout << "  kernels   threads         ms      MB/s  Mpixel/s" << std::endl;
+
+		std::vector<unsigned char> reference;
+		const bool avx2[] = { false, true, true };
+		const int configThreads[] = { 1, 1, threads };
+		for (int c = 0; c < 3; ++c) {
+			if (c == 2 && threads == 1)
+				break;
+			// only this thread's decodes, a texture loader thread keeps the process-wide settings
+			stbi_set_jpeg_avx2_thread(avx2[c]);
+			stbi_set_jpeg_threads_thread(configThreads[c]);
+			double best = 0.0;
+			bool identical = true;
+			for (int run = 0; run < JPEG_BENCH_RUNS; ++run) {
+				auto start = std::chrono::steady_clock::now();
+				unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &channels, 4);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (!data) {
+					std::cout << "ERROR::JPEG::DECODE_FAILED " << stbi_failure_reason() << std::endl;
+					identical = false;
+					break;
+				}
+				size_t bytes = (size_t)width * height * 4;
+				if (reference.empty())
+					reference.assign(data, data + bytes);
+				else if (run == 0)
+					identical = memcmp(reference.data(), data, bytes) == 0;
+				stbi_image_free(data);
+				best = run == 0 ? ms : std::min(best, ms);
+			}
+			std::cout << "  " << std::left << std::setw(8) << (avx2[c] ? "avx2" : "sse2") << std::right << std::setw(9) << configThreads[c]
+				<< std::setw(11) << best << std::setw(10) << file.size() / best / 1000.0 << std::setw(10) << (double)width * height / best / 1000.0
+				<< (identical ? "" : "  DIFFERS FROM SSE2") << std::endl;
+			if (!identical)
+				result = 1;
+		}
+	}
+	return result;
+}
+
+#ifndef HEADLESS
+void processInput(GLFWwindow* window) {
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, true);
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+	glViewport(0, 0, width, height);
+}
+#endif
+
+// the static part of the scene; the extra spheres rest on a grid over the back of the plane, shrunk so they do not overlap
+SceneNodes buildScene(TransformHierarchy& scene, unsigned int objects) {
+	SceneNodes nodes;
+	nodes.gram = scene.add(-1, TRANSLATE_PANTAGRAM, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), SCALE_PANTAGRAM);
+	nodes.cube = scene.add(-1, TRANSLATE_CUBE, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), SCALE_CUBE);
+	nodes.cubeSpin = scene.add(nodes.cube);
+	nodes.sphere = scene.add(-1, TRANSLATE_SPHERE, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), SCALE_SPHERE);
+	nodes.light = scene.add(-1, LIGHT_POS, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.05f));
+	nodes.surface = scene.add(-1, TRANSLATE_SURFACE, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), SCALE_SURFACE);
+
+	int side = objects > 1 ? (int)std::ceil(std::sqrt((float)(objects - 1))) : 1;
+	for (int i = 0; i + 1 < (int)objects; ++i) {
+		float scale = glm::min(SPHERE_SCALE, 0.5f / (RADIUS * side));
+		glm::vec3 pos((i % side + 0.5f) / side * 3.6f - 1.8f, SURFACE_Y + RADIUS * scale,
+			-0.6f - (i / side + 0.5f) / side * 1.2f);
+		nodes.objects.push_back(scene.add(-1, pos, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(scale)));
+	}
+	return nodes;
+}
+
+// only the cube moves
+void animateScene(TransformHierarchy& scene, const SceneNodes& nodes, double time) {
+	scene.setRotation(nodes.cubeSpin, glm::angleAxis((float)(time / 10), glm::normalize(glm::vec3(0.5f, 1.0f, 0.0f))));
+}
+
+// view and projection with the world matrices of the last update
+SceneTransforms sceneTransforms(const TransformHierarchy& scene, const SceneNodes& nodes) {
+	SceneTransforms t;
+	t.view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
+	t.projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	t.gram = scene.world(nodes.gram);
+	t.cube = scene.world(nodes.cubeSpin);
+	t.sphere = scene.world(nodes.sphere);
+	t.light = scene.world(nodes.light);
+	t.surface = scene.world(nodes.surface);
+	return t;
+}
+
+// cameras of the six environment cubemap faces, in GL face order
+std::vector<glm::mat4> environmentViews() {
+	return std::vector<glm::mat4>{
+		glm::lookAt(glm::vec3(3.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+		glm::lookAt(glm::vec3(-3.0f, 0.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+		glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)),
+		glm::lookAt(glm::vec3(0.0f, -3.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+		glm::lookAt(glm::vec3(0.0f, 0.0f, -3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+	};
+}
+
+// count copies of the demo texture at its largest mip within OBJECT_TEXTURE_SIZE, each tinted with its own hue
+std::vector<std::vector<unsigned char> > buildObjectImages(unsigned int count, const MipmapGenerator& mipmaps, int& size) {
+	int width, height, channels;
+	std::string path = std::string("Resource/") + IMG_PATH;
+	stbi_set_flip_vertically_on_load_thread(true);
+	unsigned char* rgba = stbi_load(path.c_str(), &width, &height, &channels, 4);
+	if (!rgba) {
+		std::cout << "Failed to load texture " << path << std::endl;
+		size = 1;
+		return std::vector<std::vector<unsigned char> >(count, std::vector<unsigned char>(4, 255));
+	}
+	// square like the sphere's texture, a non-square one is cropped
+	int side = std::min(width, height);
+	std::vector<unsigned char> square((size_t)side * side * 4);
+	for (int y = 0; y < side; ++y)
+		memcpy(&square[(size_t)y * side * 4], rgba + (size_t)y * width * 4, (size_t)side * 4);
+	stbi_image_free(rgba);
+	std::vector<unsigned char> chain(MipmapGenerator::chainBytes(side, side, 4));
+	mipmaps.generate(square.data(), side, side, 4, chain.data());
+	const unsigned char* level = square.data();
+	size = side;
+	while (size > OBJECT_TEXTURE_SIZE) {
+		level = (level == square.data() ? chain.data() : level + (size_t)size * size * 4);
+		size = std::max(1, size / 2);
+	}
+
+	std::vector<std::vector<unsigned char> > images(count, std::vector<unsigned char>(level, level + (size_t)size * size * 4));
+	for (unsigned int i = 0; i < count; ++i) {
+		float hue = 2.0f * PAI * i / count;
+		glm::vec3 tint = 0.6f + 0.4f * glm::cos(glm::vec3(hue, hue - 2.0f * PAI / 3.0f, hue - 4.0f * PAI / 3.0f));
+		for (size_t t = 0; t < images[i].size(); t += 4)
+			for (int c = 0; c < 3; ++c)
+				images[i][t + c] = (unsigned char)(images[i][t + c] * tint[c] + 0.5f);
+	}
+	return images;
+}
+
+// star with the origin, ANGLE_NUM inner and ANGLE_NUM outer vertices, the inner pentagon and outer triangles index them
+void buildGram(float* gramVertices, unsigned int* innerIndices, unsigned int* outerIndices) {
+	// origin point
+	gramVertices[0] = 0;
+	gramVertices[1] = 0;
+	gramVertices[2] = 0;
+
+	// outer vertices
+	float* outer = gramVertices + 3 + 3 * ANGLE_NUM;
+	for (int i = 0; i < ANGLE_NUM; ++i) {
+		float radian = (0.5f + (float)i / ANGLE_NUM * 2) * PAI;
+		outer[3 * i] = RADIUS * std::cos(radian);
+		outer[3 * i + 1] = RADIUS * std::sin(radian);
+		outer[3 * i + 2] = 0;
+	}
+
+	// calculate inner vertices using outers
+	float* inner = gramVertices + 3;
+
+	// another way to calculate inners
+	float radian = PAI * (1 - 2.0f / ANGLE_NUM);
+	float innerRadius = std::sin(radian - PAI / 2) * RADIUS / std::sin(PAI - radian / 2);
+	for (int i = 0; i < ANGLE_NUM; ++i) {
+		float radian = (0.5f - 1.0f / ANGLE_NUM + (float)i / ANGLE_NUM * 2) * PAI;
+		inner[3 * i] = innerRadius * std::cos(radian);
+		inner[3 * i + 1] = innerRadius * std::sin(radian);
+		inner[3 * i + 2] = 0;
+	}
+
+	// calculate triangle index
+	for (int i = 0; i < ANGLE_NUM; ++i) {
+		// i-th outer triangle include: i-th outer vertex, i-th inner vertex, i+1-th inner vertex
+		outerIndices[3 * i] = ANGLE_NUM + 1 + i;
+		outerIndices[3 * i + 1] = 1 + i;
+		outerIndices[3 * i + 2] = 1 + (i + 1) % ANGLE_NUM;
+		// i-th inner triangle include: origin point, i-th inner vertex, i+1-th inner vertex
+		innerIndices[3 * i] = 0;
+		innerIndices[3 * i + 1] = 1 + i;
+		innerIndices[3 * i + 2] = 1 + (i + 1) % ANGLE_NUM;
+	}
+}
+
+// subdivides a tetrahedron epoch times onto the sphere, interleaved position (3), texture coordinate (2) and normal (3)
+std::vector<float> buildSphere(unsigned int epoch) {
+	float vertices[] = {
+		0.0f, 0.0f, RADIUS,
+		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
+		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+
+		0.0f, 0.0f, RADIUS,
+		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
+		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+
+		0.0f, 0.0f, RADIUS,
+		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+
+		0.0f, 2 * SQRT2 / 3 * RADIUS, -RADIUS / 3,
+		SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+		-SQRT2 * SQRT3 / 3 * RADIUS, -SQRT2 / 3 * RADIUS, -RADIUS / 3,
+	};
+
+	const unsigned int vertexSize = sizeof(vertices) / 3 / sizeof(float) * pow(4, epoch);
+	float* finalVertices = new float[vertexSize * (long long)3];
+	float* textCoords = new float[vertexSize * (long long)2];
+	float* normals = new float[vertexSize * (long long)3];
+
+	memcpy(finalVertices, vertices, sizeof(vertices));
+
+	for (int size = sizeof(vertices) / sizeof(float); size < vertexSize * (long long)3; size *= 4) {
+		for (int j = 0; j < size; j += 9) {
+			float* v0 = finalVertices + size - j - 9;
+			float* v1 = v0 + 3;
+			float* v2 = v1 + 3;
+			float v01[] = { v0[0] + v1[0], v0[1] + v1[1], v0[2] + v1[2] };
+			float v02[] = { v0[0] + v2[0], v0[1] + v2[1], v0[2] + v2[2] };
+			float v12[] = { v2[0] + v1[0], v2[1] + v1[1], v2[2] + v1[2] };
+			norm(v01, RADIUS);
+			norm(v02, RADIUS);
+			norm(v12, RADIUS);
+			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 9, v0, v01, v02);
+			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 18, v1, v01, v12);
+			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 27, v2, v02, v12);
+			copyTri(finalVertices + size * (long long)4 - (long long)4 * j - 36, v01, v02, v12);
+		}
+	}
+
+	for (unsigned int i = 0; i < vertexSize; ++i) {
+		float* v = finalVertices + (long long)3 * i;
+		float x = acos(v[0] / RADIUS) / (2 * PAI);
+		float y = acos(v[1] / RADIUS / sin(2 * PAI * x)) / (2 * PAI);
+		textCoords[2 * i] = -x * REPEAT;
+		textCoords[2 * i + 1] = -y * REPEAT;
+	}
+
+	for (unsigned int i = 0; i < vertexSize * 3; i += 9) {
+		float* v[] = { finalVertices + i, finalVertices + i + 3, finalVertices + i + 6 };
+		float normal[3];
+		for (int j = 0; j < 3; ++j) {
+			normal[j] = 0;
+			for (int k1 = 0; k1 < 3; ++k1) {
+				normal[j] += v[k1][(j + 1) % 3] * v[(k1 + 1) % 3][(j + 2) % 3] - v[(k1 + 1) % 3][(j + 1) % 3] * v[k1][(j + 2) % 3];
+			}
+		}
+		norm(normal, 1.0f);
+		if (normal[0] * v[0][0] + normal[1] * v[0][1] + normal[2] * v[0][2] < 0) {
+			normal[0] = -normal[0];
+			normal[1] = -normal[1];
+			normal[2] = -normal[2];
+		}
+		copyTri(normals + i, normal, normal, normal);
+	}
+
+	std::vector<float> interleaved(vertexSize * (size_t)8);
+	float* tmp = interleaved.data();
+	for (unsigned int i = 0; i < vertexSize; ++i) {
+		memcpy(tmp + (long long)8 * i, finalVertices + (long long)3 * i, 3 * sizeof(float));
+		memcpy(tmp + (long long)8 * i + 3, textCoords + (long long)2 * i, 2 * sizeof(float));
+		memcpy(tmp + (long long)8 * i + 5, normals + (long long)3 * i, 3 * sizeof(float));
+	}
+
+	delete[] finalVertices;
+	delete[] textCoords;
+	delete[] normals;
+	return interleaved;
+}
+
+void norm(float* v, float mod) {
+	float omod = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	float scale = mod / omod;
+	v[0] *= scale;
+	v[1] *= scale;
+	v[2] *= scale;
+}
+
+void copyTri(float* dst, float* v0, float* v1, float* v2) {
+	memcpy(dst, v0, 3 * sizeof(float));
+	memcpy(dst + 3, v1, 3 * sizeof(float));
+	memcpy(dst + 6, v2, 3 * sizeof(float));
+}
+
+bool hasArg(int argc, char* argv[], const char* name) {
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == name)
+			return true;
+	}
+	return false;
+}
+
+const char* argValue(int argc, char* argv[], const char* name) {
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (std::string(argv[i]) == name)
+			return argv[i + 1];
+	}
+	return NULL;
+}
+
+// comma separated values of an argument, e.g. --epoch 5,6,7
+std::vector<unsigned int> argList(int argc, char* argv[], const char* name, unsigned int fallback) {
+	std::vector<unsigned int> values;
+	const char* value = argValue(argc, argv, name);
+	if (value) {
+		std::stringstream stream(value);
+		std::string item;
+		while (std::getline(stream, item, ','))
+			if (!item.empty())
+				values.push_back((unsigned int)atoi(item.c_str()));
+	}
+	if (values.empty())
+		values.push_back(fallback);
+	return values;
+}
+
+bool sphereInFrustum(const glm::mat4& viewProjection, const glm::vec3& center, float radius) {
+	glm::vec4 planes[6];
+	frustumPlanes(viewProjection, planes);
+	for (int i = 0; i < 6; ++i) {
+		float len = glm::length(glm::vec3(planes[i]));
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius * len)
+			return false;
+	}
+	return true;
+}
+
+void shadowBenchmark(ShadowMap& shadowMap, Shader& depthShader, Shader& shadowShader, unsigned int vao, unsigned int count) {
+	// times one depth pass over n casters against n projected draws onto the plane, both synchronized with glFinish
+	const int REPEAT_TIMES = 10;
+	glm::mat4 view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	std::cout << "casters\tshadow map (ms)\tplanar (ms)" << std::endl;
+	for (int n : SHADOW_BENCH_CASTERS) {
+		// casters spread over a grid on the plane, shrunk so they do not overlap
+		int side = (int)std::ceil(std::sqrt((float)n));
+		float scale = SPHERE_SCALE / side;
+		std::vector<ShadowCaster> casters;
+		for (int i = 0; i < n; ++i) {
+			glm::vec3 pos((i % side + 0.5f) / side * 3.0f - 1.5f, SURFACE_Y + RADIUS * scale, (i / side + 0.5f) / side * 3.0f - 1.5f);
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, pos);
+			model = glm::scale(model, glm::vec3(scale));
+			casters.push_back({ model, vao, count, RADIUS });
+		}
+
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < REPEAT_TIMES; ++r) {
+			shadowMap.invalidate();
+			shadowMap.render(depthShader, LIGHT_POS, casters);
+		}
+		glFinish();
+		auto mapEnd = std::chrono::steady_clock::now();
+
+		shadowShader.use();
+		shadowShader.setMat4("projection", projection);
+		shadowShader.setMat4("view", view);
+		shadowShader.setFloat("surfaceY", SURFACE_Y);
+		shadowShader.setVec3("lightPos", LIGHT_POS);
+		glBindVertexArray(vao);
+		for (int r = 0; r < REPEAT_TIMES; ++r) {
+			for (int i = 0; i < n; ++i) {
+				shadowShader.setMat4("model", casters[i].model);
+				glDrawArrays(GL_TRIANGLES, 0, count);
+			}
+		}
+		glFinish();
+		auto planarEnd = std::chrono::steady_clock::now();
+
+		std::cout << n << "\t" << std::chrono::duration<double, std::milli>(mapEnd - start).count() / REPEAT_TIMES
+			<< "\t" << std::chrono::duration<double, std::milli>(planarEnd - mapEnd).count() / REPEAT_TIMES << std::endl;
+	}
+}
+
+void instancingBenchmark(Shader& textShader, Shader& instancedTextShader, ShadowMap& shadowMap, Shader& depthShader, Shader& instancedDepthShader) {
+	// n textured spheres through the render queue and the depth pass, one draw per sphere against instanced
+	// draws; every frame records, replays and waits for the GPU with glFinish
+	std::vector<float> vertices = buildSphere(INSTANCING_BENCH_EPOCH);
+	unsigned int count = (unsigned int)(vertices.size() / 8);
+	unsigned int vbo;
+	unsigned int vao = benchSphereArray(vertices, vbo);
+
+	glm::mat4 view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	RenderQueue queue;
+	queue.setViewProjection(projection * view);
+	queue.setInstancedProgram(textShader.ID, instancedTextShader.ID);
+	queue.setProgramSetup(textShader.ID, [&](CommandList& list) {
+		benchTextSetup(list, shadowMap);
+	});
+	CommandList list;
+	GLCommandBackend backend;
+
+	std::cout << "sphere of " << count << " vertices, median of " << INSTANCING_BENCH_FRAMES << " frames after " << INSTANCING_BENCH_WARMUP
+		<< " warm-up frames per count and mode" << std::endl;
+	std::cout << "objects\tdraw calls\tone by one (ms)\tinstanced (ms)\tdepth one by one (ms)\tdepth instanced (ms)" << std::endl;
+	for (int n : INSTANCING_BENCH_OBJECTS) {
+		// spheres spread over a grid on the plane, shrunk so they do not overlap
+		int side = (int)std::ceil(std::sqrt((float)n));
+		float scale = SPHERE_SCALE / side;
+		std::vector<ShadowCaster> casters;
+		for (int i = 0; i < n; ++i) {
+			glm::vec3 pos((i % side + 0.5f) / side * 3.0f - 1.5f, SURFACE_Y + RADIUS * scale, (i / side + 0.5f) / side * 3.0f - 1.5f);
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, pos);
+			model = glm::scale(model, glm::vec3(scale));
+			casters.push_back({ model, vao, count, RADIUS });
+		}
+
+		double ms[4];
+		int calls[2];
+		for (int mode = 0; mode < 2; ++mode) {
+			queue.minInstances = mode ? INSTANCING_MIN_RUN : 0;
+			ms[mode] = benchMedianMs(INSTANCING_BENCH_WARMUP, INSTANCING_BENCH_FRAMES, [&]() {
+				queue.clear();
+				for (int i = 0; i < n; ++i) {
+					DrawItem sphere = { textShader.ID, vao, GL_TRIANGLES, (int)count, false, GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH,
+						casters[i].model, SPHERE_COLOR, 0 };
+					queue.submit(0, false, 0.5f, sphere);
+				}
+				list.reset();
+				queue.record(list);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				backend.replay(list);
+			});
+			calls[mode] = queue.sorted.calls;
+			ms[2 + mode] = benchMedianMs(INSTANCING_BENCH_WARMUP, INSTANCING_BENCH_FRAMES, [&]() {
+				shadowMap.invalidate();
+				shadowMap.render(depthShader, LIGHT_POS, casters, mode ? &instancedDepthShader : nullptr);
+			});
+		}
+		StreamFormat restore(std::cout);
+		std::cout << n << "\t" << calls[0] << " -> " << calls[1] << std::fixed << std::setprecision(2) << "\t" << ms[0] << "\t" << ms[1]
+			<< "\t" << ms[2] << "\t" << ms[3] << std::endl;
+	}
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+}
+
+void cullingBenchmark(Shader& textShader, Shader& instancedTextShader, Shader& cullShader, ShadowMap& shadowMap) {
+	// n instanced spheres on a grid wider than the view, frustum culled on the CPU before submission against
+	// submitted whole and culled on the GPU at replay; every frame records, replays and waits with glFinish
+	std::vector<float> vertices = buildSphere(INSTANCING_BENCH_EPOCH);
+	unsigned int count = (unsigned int)(vertices.size() / 8);
+	unsigned int vbo;
+	unsigned int vao = benchSphereArray(vertices, vbo);
+
+	glm::mat4 view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	glm::mat4 viewProjection = projection * view;
+	RenderQueue queue;
+	queue.setViewProjection(viewProjection);
+	queue.setInstancedProgram(textShader.ID, instancedTextShader.ID);
+	queue.setProgramSetup(textShader.ID, [&](CommandList& list) {
+		benchTextSetup(list, shadowMap);
+	});
+	CommandList list;
+	GLCommandBackend backend;
+	GpuInstanceCuller culler(cullShader.ID);
+
+	std::cout << "sphere of " << count << " vertices, median of " << INSTANCING_BENCH_FRAMES << " frames after " << INSTANCING_BENCH_WARMUP
+		<< " warm-up frames per count and mode" << std::endl;
+	std::cout << "objects	visible cpu/gpu	cpu culling (ms)	frame cpu culled (ms)	frame gpu culled (ms)" << std::endl;
+	for (int n : CULLING_BENCH_OBJECTS) {
+		int side = (int)std::ceil(std::sqrt((float)n));
+		float scale = SPHERE_SCALE * CULLING_BENCH_EXTENT / 3.0f / side;
+		std::vector<glm::mat4> models;
+		for (int i = 0; i < n; ++i) {
+			glm::vec3 pos(((i % side + 0.5f) / side - 0.5f) * CULLING_BENCH_EXTENT, SURFACE_Y + RADIUS * scale,
+				((i / side + 0.5f) / side - 0.75f) * CULLING_BENCH_EXTENT);
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, pos);
+			model = glm::scale(model, glm::vec3(scale));
+			models.push_back(model);
+		}
+
+		double ms[3] = { 0.0, 0.0, 0.0 };
+		int visible[2] = { 0, 0 };
+		for (int mode = 0; mode < 2; ++mode) {
+			queue.gpuCulling = mode == 1;
+			backend.culler = mode ? &culler : nullptr;
+			double cullMs = 0.0;
+			ms[1 + mode] = benchMedianMs(INSTANCING_BENCH_WARMUP, INSTANCING_BENCH_FRAMES, [&]() {
+				culler.beginFrame();
+				queue.clear();
+				auto cullStart = std::chrono::steady_clock::now();
+				for (int i = 0; i < n; ++i) {
+					if (!mode && !sphereInFrustum(viewProjection, glm::vec3(models[i][3]), RADIUS * models[i][0][0]))
+						continue;
+					DrawItem sphere = { textShader.ID, vao, GL_TRIANGLES, (int)count, false, GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH,
+						models[i], SPHERE_COLOR, 0, RADIUS };
+					queue.submit(0, false, 0.5f, sphere);
+				}
+				cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+				list.reset();
+				queue.record(list);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				backend.replay(list);
+			});
+			if (mode) {
+				visible[1] = culler.visible;
+			} else {
+				visible[0] = queue.sorted.draws;
+				ms[0] = cullMs / (INSTANCING_BENCH_WARMUP + INSTANCING_BENCH_FRAMES);
+			}
+		}
+		StreamFormat restore(std::cout);
+		std::cout << n << "\t" << visible[0] << "/" << visible[1] << std::fixed << std::setprecision(2) << "\t" << ms[0]
+			<< "\t" << ms[1] << "\t" << ms[2] << std::endl;
+	}
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+}
+
+void occlusionBenchmark(Shader& textShader, Shader& instancedTextShader, Shader& plainShader, Shader& depthShader, Shader& hizShader, ShadowMap& shadowMap) {
+	// layers of spheres behind a plane hiding most of the view, frustum culled and drawn instanced with and
+	// without the hi-z test; what the test decides is checked against an occlusion query per sphere, drawn
+	// against the plane's depth at full resolution
+	std::vector<float> vertices = buildSphere(INSTANCING_BENCH_EPOCH);
+	unsigned int count = (unsigned int)(vertices.size() / 8);
+	unsigned int vbo;
+	unsigned int vao = benchSphereArray(vertices, vbo);
+	const float QUAD_VERTICES[] = { -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f, -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f };
+	unsigned int quadVBO, quadVAO;
+	glGenVertexArrays(1, &quadVAO);
+	glGenBuffers(1, &quadVBO);
+	glBindVertexArray(quadVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_VERTICES), QUAD_VERTICES, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+
+	// the plane leaves a strip on the right of the view open
+	glm::mat4 planeModel = glm::mat4(1.0f);
+	planeModel = glm::translate(planeModel, glm::vec3(-0.4f, 0.0f, -1.0f));
+	planeModel = glm::scale(planeModel, glm::vec3(1.6f, 2.0f, 1.0f));
+	std::vector<Occluder> occluders(1, Occluder{ planeModel, quadVAO, 6 });
+	DrawItem plane = { plainShader.ID, quadVAO, GL_TRIANGLES, 6, false, GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH, planeModel, CORE_COLOR };
+
+	glm::mat4 view = glm::lookAt(CAMERA_POS, CAMERA_POS + CAMERA_FRONT, CAMERA_UP);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	glm::mat4 viewProjection = projection * view;
+	RenderQueue queue;
+	queue.setViewProjection(viewProjection);
+	queue.setInstancedProgram(textShader.ID, instancedTextShader.ID);
+	queue.setProgramSetup(textShader.ID, [&](CommandList& list) {
+		benchTextSetup(list, shadowMap);
+	});
+	CommandList list;
+	GLCommandBackend backend;
+
+	std::cout << "sphere of " << count << " vertices, " << HIZ_BENCH_FRAMES << " frames per count" << std::endl;
+	std::cout << "objects\tin frustum\thidden\thi-z occluded\tfalse positives\twrongly culled\tframe (ms)\tframe hi-z (ms)" << std::endl;
+	for (int n : HIZ_BENCH_OBJECTS) {
+		int side = (int)std::ceil(std::sqrt((float)n / HIZ_BENCH_LAYERS));
+		float scale = 0.4f * HIZ_BENCH_EXTENT / side / RADIUS;
+		std::vector<glm::mat4> models;
+		for (int i = 0; i < n; ++i) {
+			int cell = i % (side * side);
+			glm::vec3 pos(((cell % side + 0.5f) / side - 0.5f) * HIZ_BENCH_EXTENT, ((cell / side + 0.5f) / side - 0.5f) * HIZ_BENCH_EXTENT,
+				-2.5f - (float)(i / (side * side)));
+			glm::mat4 model = glm::mat4(1.0f);
+			model = glm::translate(model, pos);
+			model = glm::scale(model, glm::vec3(scale));
+			models.push_back(model);
+		}
+		std::vector<int> inFrustum;
+		for (int i = 0; i < n; ++i)
+			if (sphereInFrustum(viewProjection, glm::vec3(models[i][3]), RADIUS * scale))
+				inFrustum.push_back(i);
+
+		// the first frame of the hi-z run only builds the pyramid the others test against
+		HiZBuffer hiz(SCR_WIDTH / HIZ_SCALE, SCR_HEIGHT / HIZ_SCALE);
+		double ms[2];
+		for (int mode = 0; mode < 2; ++mode) {
+			auto start = std::chrono::steady_clock::now();
+			for (int frame = -1; frame < HIZ_BENCH_FRAMES; ++frame) {
+				if (frame == 0) {
+					glFinish();
+					start = std::chrono::steady_clock::now();
+				}
+				if (mode) {
+					hiz.update();
+					hiz.beginFrame();
+				}
+				queue.clear();
+				queue.submit(0, false, 0.0f, plane);
+				for (size_t k = 0; k < inFrustum.size(); ++k) {
+					const glm::mat4& model = models[inFrustum[k]];
+					if (mode && hiz.occludes(glm::vec3(model[3]), RADIUS * scale))
+						continue;
+					DrawItem sphere = { textShader.ID, vao, GL_TRIANGLES, (int)count, false, GL_TEXTURE_2D, 0, GL_FILL, LINE_WIDTH,
+						model, SPHERE_COLOR };
+					queue.submit(0, false, 0.5f, sphere);
+				}
+				list.reset();
+				queue.record(list);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				backend.replay(list);
+				if (mode)
+					hiz.render(depthShader, hizShader, viewProjection, occluders);
+				glFinish();
+			}
+			ms[mode] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / HIZ_BENCH_FRAMES;
+		}
+
+		// a sphere is hidden when none of its samples passes the depth test against the plane
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		plainShader.use();
+		plainShader.setVec3("colour", CORE_COLOR);
+		plainShader.setMat4("mvp", viewProjection * planeModel);
+		glBindVertexArray(quadVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+		glDepthMask(GL_FALSE);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		std::vector<unsigned int> queries(inFrustum.size());
+		if (!queries.empty())
+			glGenQueries((GLsizei)queries.size(), queries.data());
+		glBindVertexArray(vao);
+		for (size_t k = 0; k < inFrustum.size(); ++k) {
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[k]);
+			plainShader.setMat4("mvp", viewProjection * models[inFrustum[k]]);
+			glDrawArrays(GL_TRIANGLES, 0, count);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+		}
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		int hidden = 0, falsePositives = 0, wronglyCulled = 0;
+		hiz.beginFrame();
+		for (size_t k = 0; k < inFrustum.size(); ++k) {
+			GLuint passed = 0;
+			glGetQueryObjectuiv(queries[k], GL_QUERY_RESULT, &passed);
+			bool occluded = hiz.occludes(glm::vec3(models[inFrustum[k]][3]), RADIUS * scale);
+			if (!passed)
+				++hidden;
+			if (!passed && !occluded)
+				++falsePositives;
+			if (passed && occluded)
+				++wronglyCulled;
+		}
+		if (!queries.empty())
+			glDeleteQueries((GLsizei)queries.size(), queries.data());
+		StreamFormat restore(std::cout);
+		std::cout << n << "\t" << inFrustum.size() << "\t" << hidden << "\t" << hiz.occluded << "\t" << falsePositives << "\t" << wronglyCulled
+			<< std::fixed << std::setprecision(2) << "\t" << ms[0] << "\t" << ms[1] << std::endl;
+	}
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &quadVAO);
+	glDeleteBuffers(1, &quadVBO);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vbo);
+}
+
+// position, texture coordinate and normal of buildSphere() in a vertex array
+unsigned int benchSphereArray(const std::vector<float>& vertices, unsigned int& vbo) {
+	unsigned int vao;
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+	return vao;
+}
+
+// the texture shader's uniforms in the benchmarks, plain texturing lit by the light with the shadow map
+void benchTextSetup(CommandList& list, ShadowMap& shadowMap) {
+	list.setVec3("lightColor", LIGHT_COLOR);
+	list.setVec3("lightPos", LIGHT_POS);
+	list.setVec3("viewPos", CAMERA_POS);
+	list.setInt("ourTexture", 0);
+	list.setInt("useSH", 0);
+	list.setInt("useShadowMap", 1);
+	shadowMap.bind(list, 1, 0);
+	list.setInt("useVirtualTexture", 0);
+	list.setInt("texturePacking", 0);
+	list.setInt("ourTextures", 3);
+	list.setInt("atlasRects", 4);
+}
+
+// median milliseconds of `frames` calls of `frame` after `warmup` untimed ones, each waited for with glFinish
+double benchMedianMs(int warmup, int frames, const std::function<void()>& frame) {
+	std::vector<double> ms;
+	for (int i = -warmup; i < frames; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		frame();
+		glFinish();
+		if (i >= 0)
+			ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(ms.begin(), ms.end());
+	return percentile(ms, 50.0);
+}
+
+int benchmark(Window* window, SceneAssets& assets, int argc, char* argv[]) {
+	// every combination of the swept settings runs the same fixed-step frames with vsync off
+	std::vector<unsigned int> epochs = argList(argc, argv, "--epoch", EPOCH);
+	std::vector<unsigned int> envSizes = argList(argc, argv, "--env-size", SCR_WIDTH);
+	std::vector<unsigned int> objects = argList(argc, argv, "--objects", 1);
+	const char* outputPath = argValue(argc, argv, "--bench-output");
+	if (!outputPath)
+		outputPath = BENCH_OUTPUT;
+#ifndef HEADLESS
+	glfwSwapInterval(0);
+#endif
+
+	std::vector<BenchResult> results;
+	for (size_t e = 0; e < epochs.size(); ++e) {
+		for (size_t s = 0; s < envSizes.size(); ++s) {
+			for (size_t o = 0; o < objects.size(); ++o) {
+				BenchResult result;
+				result.settings = { epochs[e], envSizes[s], glm::max(objects[o], 1u) };
+				runScene(window, assets, result.settings, argc, argv, &result);
+				results.push_back(result);
+			}
+		}
+	}
+
+	std::string path(outputPath);
+	bool csv = path.size() >= 4 && path.substr(path.size() - 4) == ".csv";
+	std::ofstream out(outputPath);
+	if (!out)
+		std::cout << "ERROR::BENCH::FILE_NOT_SUCCESFULLY_WRITTEN " << outputPath << std::endl;
+	const char* names[] = { "cpu", "gpu" };
+	if (csv) {
+		out << "epoch,env_size,objects,frames";
+		for (int k = 0; k < 2; ++k)
+			out << "," << names[k] << "_avg_ms," << names[k] << "_p50_ms," << names[k] << "_p95_ms," << names[k] << "_p99_ms," << names[k] << "_max_ms";
+		out << std::endl;
+	} else {
+		out << "[";
+	}
+	std::cout << "epoch\tenv\tobjects\tcpu avg/p50/p95/p99/max (ms)\tgpu avg/p50/p95/p99/max (ms)" << std::endl;
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult& r = results[i];
+		if (csv)
+			out << r.settings.epoch << "," << r.settings.envSize << "," << r.settings.objects << "," << r.cpuMs.size();
+		else
+			out << (i ? ",\n" : "\n") << "  { \"epoch\": " << r.settings.epoch << ", \"env_size\": " << r.settings.envSize
+				<< ", \"objects\": " << r.settings.objects << ", \"frames\": " << r.cpuMs.size();
+		std::cout << r.settings.epoch << "\t" << r.settings.envSize << "\t" << r.settings.objects;
+		for (int k = 0; k < 2; ++k) {
+			std::vector<double> sorted = k == 0 ? r.cpuMs : r.gpuMs;
+			std::sort(sorted.begin(), sorted.end());
+			double sum = 0.0;
+			for (size_t j = 0; j < sorted.size(); ++j)
+				sum += sorted[j];
+			double stats[] = { sorted.empty() ? 0.0 : sum / sorted.size(), percentile(sorted, 50), percentile(sorted, 95),
+				percentile(sorted, 99), sorted.empty() ? 0.0 : sorted.back() };
+			const char* keys[] = { "avg", "p50", "p95", "p99", "max" };
+			StreamFormat restore(std::cout);
+			std::cout << "\t";
+			for (int j = 0; j < 5; ++j) {
+				if (csv)
+					out << "," << stats[j];
+				else
+					out << ", \"" << names[k] << "_" << keys[j] << "_ms\": " << stats[j];
+				std::cout << (j ? "/" : "") << std::fixed << std::setprecision(2) << stats[j];
+			}
+		}
+		out << (csv ? "\n" : " }");
+		std::cout << std::endl;
+	}
+	if (!csv)
+		out << "\n]" << std::endl;
+	return 0;
 }
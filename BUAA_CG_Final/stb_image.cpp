@@ -1,2 +1,3 @@
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_JPEG_THREADS
 #include "stb_image.h"
\ No newline at end of file
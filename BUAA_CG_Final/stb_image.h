@@ -233,6 +233,13 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// This copy also has AVX2 versions of the JPEG IDCT, YCbCr->RGB (4-channel
+// output) and 2x2 chroma upsampling. They are picked at run time when the CPU
+// has AVX2 and produce the same bytes as the SSE2 loops; define STBI_NO_AVX2
+// to leave them out. With STBI_JPEG_THREADS defined, baseline JPEGs that use
+// restart intervals are entropy-decoded on several threads, see
+// stbi_set_jpeg_threads().
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -475,6 +482,18 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 // calling it will fail to link if your compiler doesn't
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// use the AVX2 JPEG kernels when the CPU has them (the default), or keep to SSE2
+STBIDEF void stbi_set_jpeg_avx2(int flag_true_if_should_use);
+
+// decode baseline JPEGs with restart intervals on up to this many threads
+// (default 1); only has an effect with STBI_JPEG_THREADS defined
+STBIDEF void stbi_set_jpeg_threads(int count);
+
+// as the two above, but only for JPEGs decoded on the calling thread; like
+// stbi_set_flip_vertically_on_load_thread these need thread-local variables
+STBIDEF void stbi_set_jpeg_avx2_thread(int flag_true_if_should_use);
+STBIDEF void stbi_set_jpeg_threads_thread(int count);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -719,6 +738,48 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 JPEG kernels, compiled for the avx2 target only and picked at run time
+#if defined(STBI_SSE2) && !defined(STBI_NO_JPEG) && !defined(STBI_NO_AVX2)
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || (!defined(_MSC_VER) && (defined(__clang__) || __GNUC__ >= 5))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   // the OS has to save the ymm registers too
+   if (((info[2] >> 27) & 1) == 0 || (_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+static int stbi__avx2_available(void)
+{
+   return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif
+#endif
+
+#if defined(STBI_JPEG_THREADS) && !defined(STBI_NO_JPEG)
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#define STBI__JPEG_MAX_THREADS 64
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -1046,6 +1107,42 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_avx2_global = 1;
+static int stbi__jpeg_threads_global = 1;
+
+STBIDEF void stbi_set_jpeg_avx2(int flag_true_if_should_use)
+{
+   stbi__jpeg_avx2_global = flag_true_if_should_use;
+}
+
+STBIDEF void stbi_set_jpeg_threads(int count)
+{
+   stbi__jpeg_threads_global = count < 1 ? 1 : count;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_avx2     stbi__jpeg_avx2_global
+#define stbi__jpeg_threads  stbi__jpeg_threads_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_avx2_local, stbi__jpeg_avx2_set;
+static STBI_THREAD_LOCAL int stbi__jpeg_threads_local, stbi__jpeg_threads_set;
+
+STBIDEF void stbi_set_jpeg_avx2_thread(int flag_true_if_should_use)
+{
+   stbi__jpeg_avx2_local = flag_true_if_should_use;
+   stbi__jpeg_avx2_set = 1;
+}
+
+STBIDEF void stbi_set_jpeg_threads_thread(int count)
+{
+   stbi__jpeg_threads_local = count < 1 ? 1 : count;
+   stbi__jpeg_threads_set = 1;
+}
+
+#define stbi__jpeg_avx2     (stbi__jpeg_avx2_set ? stbi__jpeg_avx2_local : stbi__jpeg_avx2_global)
+#define stbi__jpeg_threads  (stbi__jpeg_threads_set ? stbi__jpeg_threads_local : stbi__jpeg_threads_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -2587,6 +2684,158 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above. a row of eight 32-bit intermediates
+// fits one register, so each wide op is issued once instead of twice; the
+// math and rounding are the same, so is the output.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // interleave x/y, then out0 = c0 dot (x,y), out1 = c1 dot (x,y), 32-bit
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose, as in the sse2 version
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack and 8bit 8x8 transpose
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2831,10 +3080,234 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+#ifdef STBI_JPEG_THREADS
+// baseline scans with restart markers, decoded by several threads. the
+// intervals are independent (the entropy decoder and the dc predictions are
+// reset at every marker) and each one covers a fixed run of MCUs, so once the
+// scan is in memory and the markers are found every thread can decode its own
+// run of intervals, i.e. its own band of MCU rows, straight into the
+// component buffers.
+
+// decodes MCUs [first, first+count) of the scan from j's stream
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+   int m,k,x,y;
+   STBI_SIMD_ALIGN(short, data[64]);
+   for (m=first; m < first+count; ++m) {
+      if (z->scan_n == 1) {
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3;
+         int i = m % w, j = m / w;
+         int ha = z->img_comp[n].ha;
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+         z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+      } else {
+         int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x)*8;
+                  int y2 = (j*z->img_comp[n].v + y)*8;
+                  int ha = z->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   stbi_uc *data;    // entropy-coded bytes as stored, markers included
+   int len, cap;
+   int *starts;      // offset of each restart interval in data
+   int intervals, max_intervals;
+} stbi__jpeg_scan;
+
+static int stbi__jpeg_scan_append(stbi__jpeg_scan *scan, stbi_uc const *bytes, int n)
+{
+   if (scan->len + n > scan->cap) {
+      int cap = scan->cap ? scan->cap : 1 << 16;
+      stbi_uc *data;
+      while (cap < scan->len + n) {
+         if (cap > (1 << 30)) return 0;
+         cap *= 2;
+      }
+      data = (stbi_uc *) STBI_REALLOC_SIZED(scan->data, scan->cap, cap);
+      if (!data) return 0;
+      scan->data = data;
+      scan->cap = cap;
+   }
+   memcpy(scan->data + scan->len, bytes, n);
+   scan->len += n;
+   return 1;
+}
+
+// reads the rest of the scan up to and including the marker that ends it,
+// noting where every interval starts. leaves that marker in z->marker the
+// way the serial decoder does.
+static int stbi__jpeg_read_scan(stbi__jpeg *z, stbi__jpeg_scan *scan)
+{
+   stbi__context *s = z->s;
+   scan->starts[scan->intervals++] = 0;
+   for (;;) {
+      stbi_uc c;
+      // copy up to the next 0xff straight from the buffered input
+      stbi_uc *p = s->img_buffer;
+      stbi_uc *ff = (stbi_uc *) memchr(p, 0xff, s->img_buffer_end - p);
+      int n = (int) ((ff ? ff : s->img_buffer_end) - p);
+      if (!stbi__jpeg_scan_append(scan, p, n)) return stbi__err("outofmem", "Out of memory");
+      s->img_buffer += n;
+      if (!ff) {
+         if (!s->read_from_callbacks) return 1; // eof, the serial decoder reads zeros past it too
+         stbi__refill_buffer(s);
+         continue;
+      }
+      // 0xff: stuffed zero, fill bytes, a restart marker or the end of the scan
+      c = stbi__get8(s);
+      if (!stbi__jpeg_scan_append(scan, &c, 1)) return stbi__err("outofmem", "Out of memory");
+      do {
+         c = stbi__get8(s);
+         if (!stbi__jpeg_scan_append(scan, &c, 1)) return stbi__err("outofmem", "Out of memory");
+      } while (c == 0xff);
+      if (c == 0) continue;
+      if (STBI__RESTART(c)) {
+         if (scan->intervals < scan->max_intervals)
+            scan->starts[scan->intervals++] = scan->len;
+         continue;
+      }
+      z->marker = c;
+      return 1;
+   }
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__jpeg_scan *scan;
+   int mcus;         // in the scan
+   int first, last;  // intervals of this job
+   int ok;
+} stbi__jpeg_job;
+
+static void stbi__jpeg_run_job(stbi__jpeg_job *job)
+{
+   // a private decoder over the scan in memory, tables shared by copy
+   stbi__jpeg *j = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   stbi__context s;
+   int r;
+   job->ok = j != NULL;
+   if (!j) return;
+   *j = *job->z;
+   j->s = &s;
+   for (r=job->first; r < job->last && job->ok; ++r) {
+      int first = r * j->restart_interval;
+      int count = job->mcus - first < j->restart_interval ? job->mcus - first : j->restart_interval;
+      stbi__start_mem(&s, job->scan->data + job->scan->starts[r], job->scan->len - job->scan->starts[r]);
+      stbi__jpeg_reset(j);
+      job->ok = stbi__jpeg_decode_mcus(j, first, count);
+      // an interval that does not end right at its marker stops the serial
+      // decoder, which then fails on that marker; fail the same way
+      if (job->ok && r+1 < job->scan->intervals) {
+         if (j->code_bits < 24) stbi__grow_buffer_unsafe(j);
+         job->ok = STBI__RESTART(j->marker);
+      }
+   }
+   STBI_FREE(j);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI stbi__jpeg_job_thread(LPVOID job)
+{
+   stbi__jpeg_run_job((stbi__jpeg_job *) job);
+   return 0;
+}
+#else
+static void *stbi__jpeg_job_thread(void *job)
+{
+   stbi__jpeg_run_job((stbi__jpeg_job *) job);
+   return NULL;
+}
+#endif
+
+static int stbi__parse_entropy_coded_data_threaded(stbi__jpeg *z, int threads)
+{
+   stbi__jpeg_job jobs[STBI__JPEG_MAX_THREADS];
+#ifdef _WIN32
+   HANDLE handles[STBI__JPEG_MAX_THREADS];
+#else
+   pthread_t handles[STBI__JPEG_MAX_THREADS];
+   int started[STBI__JPEG_MAX_THREADS];
+#endif
+   stbi__jpeg_scan scan;
+   int mcus, t, ok = 1;
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      mcus = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      mcus = z->img_mcu_x * z->img_mcu_y;
+   }
+   memset(&scan, 0, sizeof(scan));
+   scan.max_intervals = (mcus + z->restart_interval - 1) / z->restart_interval;
+   scan.starts = (int *) stbi__malloc_mad2(scan.max_intervals, sizeof(int), 0);
+   if (!scan.starts) return stbi__err("outofmem", "Out of memory");
+   if (!stbi__jpeg_read_scan(z, &scan)) {
+      STBI_FREE(scan.starts);
+      STBI_FREE(scan.data);
+      return 0;
+   }
+
+   // contiguous runs of intervals, the calling thread takes the first one.
+   // a truncated scan decodes the intervals it has, as the serial path does
+   if (threads > scan.intervals) threads = scan.intervals;
+   if (threads > STBI__JPEG_MAX_THREADS) threads = STBI__JPEG_MAX_THREADS;
+   for (t=0; t < threads; ++t) {
+      jobs[t].z = z;
+      jobs[t].scan = &scan;
+      jobs[t].mcus = mcus;
+      jobs[t].first = scan.intervals * t / threads;
+      jobs[t].last = scan.intervals * (t+1) / threads;
+      jobs[t].ok = 0;
+   }
+   for (t=1; t < threads; ++t) {
+#ifdef _WIN32
+      handles[t] = CreateThread(NULL, 0, stbi__jpeg_job_thread, &jobs[t], 0, NULL);
+      if (!handles[t]) stbi__jpeg_run_job(&jobs[t]);
+#else
+      started[t] = pthread_create(&handles[t], NULL, stbi__jpeg_job_thread, &jobs[t]) == 0;
+      if (!started[t]) stbi__jpeg_run_job(&jobs[t]);
+#endif
+   }
+   stbi__jpeg_run_job(&jobs[0]);
+   for (t=0; t < threads; ++t) {
+#ifdef _WIN32
+      if (t && handles[t]) {
+         WaitForSingleObject(handles[t], INFINITE);
+         CloseHandle(handles[t]);
+      }
+#else
+      if (t && started[t]) pthread_join(handles[t], NULL);
+#endif
+      ok = ok && jobs[t].ok;
+   }
+   STBI_FREE(scan.starts);
+   STBI_FREE(scan.data);
+   return ok ? 1 : stbi__err("bad restart interval", "Corrupt JPEG");
+}
+#endif // STBI_JPEG_THREADS
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+#ifdef STBI_JPEG_THREADS
+      if (z->restart_interval && stbi__jpeg_threads > 1)
+         return stbi__parse_entropy_coded_data_threaded(z, stbi__jpeg_threads);
+#endif
       if (z->scan_n == 1) {
          int i,j;
          STBI_SIMD_ALIGN(short, data[64]);
@@ -3499,6 +3972,72 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// the sse2 loop above on 16 pixels at a time. both 128-bit lanes are shifted
+// by one pixel with a cross-lane alignr, the interleave needs no fix-up.
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff);
+
+      // prev/next: current row shifted by one pixel across the lanes, with
+      // the neighbours of the group filled in
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal pass, polyphase as in the sse2 version
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, undo scaling, pack and write
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3673,6 +4212,68 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// the sse2 step == 4 loop above on 16 pixels at a time, the rest is left to it
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load, unpack to short with y in the high byte over a bias of 128
+         // and cr, cb shifted left by 8, as the sse2 unpacks do
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip); // -128
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave channels within each lane, so o0 has
+         // pixels 0-3 and 8-11, o1 pixels 4-7 and 12-15
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store with the lanes put back in order
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3688,6 +4289,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__jpeg_avx2 && stbi__avx2_available()) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
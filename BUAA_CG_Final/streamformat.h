@@ -0,0 +1,26 @@
+#ifndef STREAM_FORMAT_H
+#define STREAM_FORMAT_H
+
+#include <ios>
+#include <ostream>
+
+// Saves the flags, precision and fill of a stream and puts them back when it goes out of scope, so a
+// report can switch to fixed-point output without changing what the caller prints afterwards.
+class StreamFormat {
+public:
+	explicit StreamFormat(std::ostream& stream) : stream(stream), saved(NULL) {
+		saved.copyfmt(stream);
+	}
+
+	~StreamFormat() {
+		stream.copyfmt(saved);
+	}
+
+private:
+	std::ostream& stream;
+	std::ios saved;
+
+	StreamFormat(const StreamFormat&);
+	StreamFormat& operator=(const StreamFormat&);
+};
+#endif
@@ -0,0 +1,193 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include "streamformat.h"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+// One-shot dependency graph for startup work. A task starts as soon as all of its dependencies are done:
+// worker tasks on a thread of the graph, main-thread tasks (anything touching the window or the GL context)
+// on the thread that called run(). Start and end times are kept so report() can print the timeline and the
+// critical path, measured from `epoch`.
+class TaskGraph {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// called on the main thread about every millisecond while it has nothing to run, e.g. to pump streaming work
+	std::function<void()> idle;
+
+	TaskGraph(unsigned int threads = 0, Clock::time_point epoch = Clock::now()) : threads(threads), epoch(epoch), remaining(0) {
+		if (this->threads == 0)
+			this->threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// dependencies must have been added before
+	int add(const std::string& name, const std::function<void()>& work, const std::vector<int>& dependencies = std::vector<int>(),
+		bool mainThread = false) {
+		Task task;
+		task.name = name;
+		task.work = work;
+		task.dependencies = dependencies;
+		task.mainThread = mainThread;
+		task.waiting = (int)dependencies.size();
+		int index = (int)tasks.size();
+		for (size_t i = 0; i < dependencies.size(); ++i)
+			tasks[dependencies[i]].dependents.push_back(index);
+		tasks.push_back(task);
+		return index;
+	}
+
+	// runs every task and returns when all are done
+	void run() {
+		remaining = (int)tasks.size();
+		for (size_t i = 0; i < tasks.size(); ++i)
+			if (tasks[i].waiting == 0)
+				(tasks[i].mainThread ? mainQueue : workerQueue).push_back((int)i);
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < threads; ++i)
+			workers.push_back(std::thread(&TaskGraph::work, this, false));
+		work(true);
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+	}
+
+	// milliseconds from the epoch until the last task finished
+	double totalMs() const {
+		double end = 0.0;
+		for (size_t i = 0; i < tasks.size(); ++i)
+			end = std::max(end, tasks[i].endMs);
+		return end;
+	}
+
+	// the chain of tasks that ended last, each one waited on whichever finished latest of its dependencies and,
+	// for main-thread tasks, the main-thread task that ran before it
+	std::vector<int> criticalPath() const {
+		std::vector<int> path;
+		int task = -1;
+		for (size_t i = 0; i < tasks.size(); ++i)
+			if (task < 0 || tasks[i].endMs > tasks[task].endMs)
+				task = (int)i;
+		while (task >= 0) {
+			path.insert(path.begin(), task);
+			int latest = -1;
+			for (size_t i = 0; i < tasks[task].dependencies.size(); ++i) {
+				int dependency = tasks[task].dependencies[i];
+				if (latest < 0 || tasks[dependency].endMs > tasks[latest].endMs)
+					latest = dependency;
+			}
+			int previous = tasks[task].mainThread ? previousOnMain(task) : -1;
+			if (previous >= 0 && (latest < 0 || tasks[previous].endMs > tasks[latest].endMs))
+				latest = previous;
+			task = latest;
+		}
+		return path;
+	}
+
+	// the critical path, with timeline one line per task in start order before it
+	void report(std::ostream& out, bool timeline = true) const {
+		std::vector<int> order(tasks.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = (int)i;
+		std::sort(order.begin(), order.end(), [this](int a, int b) { return tasks[a].startMs < tasks[b].startMs; });
+		StreamFormat restore(out);
+		out << std::fixed << std::setprecision(2);
+		for (size_t i = 0; timeline && i < order.size(); ++i) {
+			const Task& task = tasks[order[i]];
+			out << "  " << std::left << std::setw(24) << task.name << std::right << std::setw(8) << task.startMs << " -> "
+				<< std::setw(8) << task.endMs << " ms  (" << task.endMs - task.startMs << " ms on " << (task.mainThread ? "main" : "worker") << ")" << std::endl;
+		}
+		std::vector<int> path = criticalPath();
+		out << "startup critical path " << totalMs() << " ms:";
+		for (size_t i = 0; i < path.size(); ++i)
+			out << (i ? " -> " : " ") << tasks[path[i]].name << " (" << tasks[path[i]].endMs - tasks[path[i]].startMs << ")";
+		out << std::endl;
+	}
+
+private:
+	struct Task {
+		std::string name;
+		std::function<void()> work;
+		std::vector<int> dependencies;
+		std::vector<int> dependents;
+		bool mainThread;
+		int waiting;
+		double startMs;
+		double endMs;
+		Task() : mainThread(false), waiting(0), startMs(0.0), endMs(0.0) {}
+	};
+
+	std::vector<Task> tasks;
+	unsigned int threads;
+	Clock::time_point epoch;
+	std::deque<int> mainQueue;
+	std::deque<int> workerQueue;
+	int remaining;
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	// the main-thread task that finished last before `task` started, -1 if it was the first
+	int previousOnMain(int task) const {
+		int previous = -1;
+		for (size_t i = 0; i < tasks.size(); ++i) {
+			if ((int)i == task || !tasks[i].mainThread || tasks[i].endMs > tasks[task].startMs)
+				continue;
+			if (previous < 0 || tasks[i].endMs > tasks[previous].endMs)
+				previous = (int)i;
+		}
+		return previous;
+	}
+
+	double now() const {
+		return std::chrono::duration<double, std::milli>(Clock::now() - epoch).count();
+	}
+
+	void work(bool mainThread) {
+		std::deque<int>& queue = mainThread ? mainQueue : workerQueue;
+		for (;;) {
+			int index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (remaining != 0 && queue.empty()) {
+					if (mainThread && idle) {
+						if (wake.wait_for(lock, std::chrono::milliseconds(1)) == std::cv_status::timeout) {
+							lock.unlock();
+							idle();
+							lock.lock();
+						}
+					} else {
+						wake.wait(lock);
+					}
+				}
+				if (queue.empty())
+					return;
+				index = queue.front();
+				queue.pop_front();
+			}
+			Task& task = tasks[index];
+			task.startMs = now();
+			task.work();
+			task.endMs = now();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--remaining;
+				for (size_t i = 0; i < task.dependents.size(); ++i) {
+					Task& dependent = tasks[task.dependents[i]];
+					if (--dependent.waiting == 0)
+						(dependent.mainThread ? mainQueue : workerQueue).push_back(task.dependents[i]);
+				}
+			}
+			wake.notify_all();
+		}
+	}
+};
+#endif
@@ -0,0 +1,298 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "blockcompress.h"
+#include "mipmap.h"
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// A KTX 1.1 file holding one compressed 2D texture and its mip chain. open() maps the file read-only, so the
+// levels are paged in straight from the page cache into glCompressedTexImage2D without a copy.
+class KtxFile {
+public:
+	GLenum format;
+	int width;
+	int height;
+	std::vector<const unsigned char*> levels;
+	std::vector<size_t> levelBytes;
+
+	KtxFile() : format(0), width(0), height(0), data(NULL), size(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#endif
+	}
+
+	~KtxFile() {
+		close();
+	}
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t)fileSize.QuadPart;
+		mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			size = (size_t)info.st_size;
+			void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			data = mapped == MAP_FAILED ? NULL : (const unsigned char*)mapped;
+		}
+		::close(fd);
+#endif
+		if (!data || !parse()) {
+			std::cout << "ERROR::KTX::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap((void*)data, size);
+#endif
+		data = NULL;
+		size = 0;
+		levels.clear();
+		levelBytes.clear();
+	}
+
+	bool valid() const {
+		return data != NULL;
+	}
+
+	// of all levels
+	size_t bytes() const {
+		size_t total = 0;
+		for (size_t i = 0; i < levelBytes.size(); ++i)
+			total += levelBytes[i];
+		return total;
+	}
+
+	// specifies the first `count` levels of the bound GL_TEXTURE_2D from client memory, no unpack buffer may be bound
+	void upload(int count) const {
+		for (int i = 0; i < count && i < (int)levels.size(); ++i)
+			uploadLevel(i);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, std::max(0, std::min(count, (int)levels.size()) - 1));
+	}
+
+	// one level, as upload() does
+	void uploadLevel(int level) const {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, std::max(1, width >> level), std::max(1, height >> level), 0,
+			(GLsizei)levelBytes[level], levels[level]);
+	}
+
+	static bool write(const std::string& path, GLenum format, int width, int height, const std::vector<std::vector<unsigned char> >& levels) {
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file) {
+			std::cout << "ERROR::KTX::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+			return false;
+		}
+		bool alpha = format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+		const unsigned int header[13] = {
+			0x04030201, // endianness
+			0, 1, 0, // glType, glTypeSize, glFormat: compressed
+			format, alpha ? (unsigned int)GL_RGBA : (unsigned int)GL_RGB,
+			(unsigned int)width, (unsigned int)height, 0, // depth
+			0, 1, // array elements, faces
+			(unsigned int)levels.size(),
+			0, // key/value bytes
+		};
+		fwrite(identifier(), 1, 12, file);
+		fwrite(header, sizeof(unsigned int), 13, file);
+		// block sizes are multiples of 4, so there is never any mip padding
+		for (size_t i = 0; i < levels.size(); ++i) {
+			unsigned int imageSize = (unsigned int)levels[i].size();
+			fwrite(&imageSize, sizeof(imageSize), 1, file);
+			fwrite(levels[i].data(), 1, levels[i].size(), file);
+		}
+		bool ok = ferror(file) == 0;
+		fclose(file);
+		if (!ok)
+			std::cout << "ERROR::KTX::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+		return ok;
+	}
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	static const unsigned char* identifier() {
+		static const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+		return IDENTIFIER;
+	}
+
+	KtxFile(const KtxFile&);
+	KtxFile& operator=(const KtxFile&);
+
+	// only what write() produces: little endian, one 2D face, a known block format
+	bool parse() {
+		if (size < 64 || memcmp(data, identifier(), 12) != 0)
+			return false;
+		unsigned int header[13];
+		memcpy(header, data + 12, sizeof(header));
+		if (header[0] != 0x04030201 || header[1] != 0 || header[9] > 0 || header[10] != 1 || header[11] == 0
+			|| BlockCompressor::blockBytes(header[4]) == 0)
+			return false;
+		format = header[4];
+		width = (int)header[6];
+		height = (int)header[7];
+		size_t offset = 64 + header[12];
+		int w = width, h = height;
+		for (unsigned int i = 0; i < header[11]; ++i) {
+			unsigned int imageSize;
+			if (offset + 4 > size)
+				return false;
+			memcpy(&imageSize, data + offset, 4);
+			offset += 4;
+			if (imageSize != BlockCompressor::levelBytes(format, w, h) || offset + imageSize > size)
+				return false;
+			levels.push_back(data + offset);
+			levelBytes.push_back(imageSize);
+			offset += (imageSize + 3) & ~3u;
+			w = std::max(1, w / 2);
+			h = std::max(1, h / 2);
+		}
+		return true;
+	}
+};
+
+// First-run transcoder for image files: decodes with stb_image, builds the mip chain on the CPU, compresses
+// every level and stores it as <image>.<format>.ktx next to the image (.flip.ktx when flipped on load).
+// Later runs map that file instead, until the image is newer than it.
+class TextureCache {
+public:
+	// the cache file of an image
+	static std::string path(const std::string& image, GLenum format, bool flip) {
+		return image + "." + name(format) + (flip ? ".flip.ktx" : ".ktx");
+	}
+
+	// maps the cache of the image into `file`, transcoding it first if it is missing or stale
+	static bool load(KtxFile& file, const std::string& image, GLenum format, bool flip, const MipmapGenerator& mipmaps = MipmapGenerator()) {
+		std::string cache = path(image, format, flip);
+		struct stat imageInfo, cacheInfo;
+		bool fresh = stat(cache.c_str(), &cacheInfo) == 0 && (stat(image.c_str(), &imageInfo) != 0 || cacheInfo.st_mtime >= imageInfo.st_mtime);
+		if (fresh && file.open(cache) && file.format == format)
+			return true;
+		return build(image, cache, format, flip, mipmaps) && file.open(cache);
+	}
+
+	static bool build(const std::string& image, const std::string& cache, GLenum format, bool flip, const MipmapGenerator& mipmaps = MipmapGenerator()) {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load_thread(flip);
+		unsigned char* rgba = stbi_load(image.c_str(), &width, &height, &channels, 4);
+		if (!rgba) {
+			std::cout << "Failed to load texture " << image << std::endl;
+			return false;
+		}
+		std::vector<unsigned char> chain(MipmapGenerator::chainBytes(width, height, 4));
+		mipmaps.generate(rgba, width, height, 4, chain.data());
+		std::vector<std::vector<unsigned char> > levels;
+		const unsigned char* level = rgba;
+		for (int w = width, h = height, i = 0; i < MipmapGenerator::levels(width, height); ++i) {
+			levels.push_back(BlockCompressor::compress(format, level, w, h));
+			level = (i == 0 ? chain.data() : level + (size_t)w * h * 4);
+			w = std::max(1, w / 2);
+			h = std::max(1, h / 2);
+		}
+		stbi_image_free(rgba);
+		return KtxFile::write(cache, format, width, height, levels);
+	}
+
+	// whether the current context samples the format, by its extension or the compressed format list
+	static bool supported(GLenum format) {
+		const char* extension = NULL;
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			extension = "GL_EXT_texture_compression_s3tc";
+			break;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			extension = "GL_ARB_texture_compression_bptc";
+			break;
+		case GL_COMPRESSED_RGB8_ETC2:
+			extension = "GL_ARB_ES3_compatibility";
+			break;
+		default:
+			return false;
+		}
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i)
+			if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extension) == 0)
+				return true;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+		std::vector<GLint> formats(count);
+		if (count)
+			glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+		return std::find(formats.begin(), formats.end(), (GLint)format) != formats.end();
+	}
+
+	static const char* name(GLenum format) {
+		switch (format) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			return "bc1";
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			return "bc3";
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return "bc7";
+		case GL_COMPRESSED_RGB8_ETC2:
+			return "etc2";
+		default:
+			return "rgb";
+		}
+	}
+
+	// inverse of name(), 0 (uncompressed) for anything else
+	static GLenum parse(const std::string& name) {
+		const GLenum formats[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_RGB8_ETC2 };
+		for (size_t i = 0; i < sizeof(formats) / sizeof(GLenum); ++i)
+			if (name == TextureCache::name(formats[i]))
+				return formats[i];
+		return 0;
+	}
+};
+#endif
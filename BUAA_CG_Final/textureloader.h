@@ -0,0 +1,493 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "texturecache.h"
+#include "mipmap.h"
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+// Loads image files into 2D textures without stalling the GL thread. request() returns the texture at once,
+// holding a 1x1 placeholder texel until the image arrives. Worker threads read the image size, decode the image
+// into system memory (stb_image allocates its own output) and copy it into a pixel unpack buffer that update()
+// has mapped for them, followed by the mip chain built on the CPU; update() then specifies the levels from the
+// PBO, fences them and deletes the PBO once the fence has signalled. Call update() once per frame on the GL
+// thread, it uploads at most bytesPerFrame (but always at least one image).
+// A compressed request maps the image's KTX cache on the worker instead (transcoding it on the first run) and
+// update() specifies the levels straight from the mapping. With mips it streams: the levels up to streamTail texels
+// on a side go in at once, then one larger level per update, highest priority first, each one blended in over
+// streamFade updates with GL_TEXTURE_MIN_LOD while GL_TEXTURE_BASE_LEVEL keeps sampling off the missing levels.
+class TextureLoader {
+public:
+	// what a finished load put into its texture, levels is 0 when the load failed and the texture was left alone
+	struct Loaded {
+		unsigned int texture;
+		int width, height;
+		int channels; // of uncompressed levels
+		GLenum compressed;
+		int levels;
+	};
+
+	// how long a streamed texture took from load() to its first levels and to full resolution
+	struct StreamTiming {
+		std::string path;
+		unsigned int texture;
+		int width, height;
+		double firstMs;
+		double fullMs;
+		int updates; // that specified a level after the first ones
+	};
+
+	// filters the mip chains of uncompressed uploads and of new caches, set it before the first request
+	MipmapGenerator mipmaps;
+	// called by update() when a load has specified its levels (or failed)
+	std::function<void(const Loaded&)> loaded;
+	// texels on a side of the largest level a streamed texture starts with, 0 specifies compressed chains at once
+	int streamTail;
+	// updates over which each streamed level is blended in
+	int streamFade;
+
+	TextureLoader(size_t bytesPerFrame = 4 << 20, unsigned int threads = 1) : streamTail(64), streamFade(4), bytesPerFrame(bytesPerFrame),
+		quit(false) {
+		for (unsigned int i = 0; i < threads; ++i)
+			workers.push_back(std::thread(&TextureLoader::work, this));
+	}
+
+	~TextureLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+		for (size_t i = 0; i < uploads.size(); ++i) {
+			release(*uploads[i]);
+			delete uploads[i];
+		}
+	}
+
+	// the texture is owned by the caller, wrap and filter are set right away, flip matches stbi_set_flip_vertically_on_load,
+	// compressed is a block format of BlockCompressor or 0, it falls back to uncompressed if the cache fails. With mipmaps
+	// the minification filter also blends between levels, which is what the streamed levels fade in through
+	unsigned int request(const std::string& path, GLint wrap, GLint filter, bool mipmaps, bool flip, GLenum compressed = 0) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter(filter, mipmaps));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		placeholder();
+		load(texture, path, mipmaps, flip, compressed);
+		return texture;
+	}
+
+	// GL_NEAREST or GL_LINEAR, blending between levels if the texture has mips
+	static GLint minFilter(GLint filter, bool mipmaps) {
+		if (!mipmaps)
+			return filter;
+		return filter == GL_NEAREST ? GL_NEAREST_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+	}
+
+	// loads the image into an existing texture, which keeps what it holds until the new levels are specified.
+	// A texture that still holds the levels from `resident` on (of the same image) only streams the ones above
+	void load(unsigned int texture, const std::string& path, bool mipmaps, bool flip, GLenum compressed = 0, int resident = -1) {
+		Upload* upload = new Upload();
+		upload->path = path;
+		upload->mipmaps = mipmaps;
+		upload->flip = flip;
+		upload->compressed = compressed;
+		upload->texture = texture;
+		upload->resident = resident;
+		upload->requested = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto priority = priorities.find(texture);
+			if (priority != priorities.end())
+				upload->priority = priority->second;
+			uploads.push_back(upload);
+			tasks.push_back(upload);
+		}
+		wake.notify_one();
+	}
+
+	// drops the loads into the texture, e.g. before it is deleted, without calling loaded
+	void cancel(unsigned int texture) {
+		std::lock_guard<std::mutex> lock(mutex);
+		priorities.erase(texture);
+		for (size_t i = 0; i < uploads.size(); ++i)
+			if (uploads[i]->texture == texture)
+				uploads[i]->cancelled = true;
+	}
+
+	// the larger, the sooner the texture's levels stream in, e.g. the screen-space size in pixels of what uses it
+	void prioritize(unsigned int texture, float priority) {
+		std::lock_guard<std::mutex> lock(mutex);
+		priorities[texture] = priority;
+		for (size_t i = 0; i < uploads.size(); ++i)
+			if (uploads[i]->texture == texture)
+				uploads[i]->priority = priority;
+	}
+
+	// of the streams that finished since the last call
+	std::vector<StreamTiming> timings() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<StreamTiming> result;
+		result.swap(finishedTimings);
+		return result;
+	}
+
+	// the grey 1x1 texel of textures whose image has not arrived, as the only level of the bound GL_TEXTURE_2D
+	static void placeholder() {
+		const unsigned char texel[] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	// maps buffers for sized images, uploads decoded ones and retires finished ones
+	void update() {
+		size_t uploaded = 0;
+		bool queued = false;
+		std::vector<Loaded> finished;
+		std::vector<Upload*> streaming;
+		std::unique_lock<std::mutex> lock(mutex);
+		for (size_t i = 0; i < uploads.size(); ++i) {
+			Upload& upload = *uploads[i];
+			if (upload.cancelled && upload.state != REQUESTED && upload.state != MAPPED) {
+				// the workers are done with it
+				release(upload);
+				upload.ktx.close();
+				upload.state = DONE;
+				continue;
+			}
+			switch (upload.state) {
+			case SIZED:
+				glGenBuffers(1, &upload.pbo);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, upload.bytes(), NULL, GL_STREAM_DRAW);
+				upload.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, upload.bytes(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+				if (!upload.mapped) {
+					std::cout << "ERROR::TEXTURE_LOADER:: Failed to map the upload buffer for " << upload.path << std::endl;
+					upload.state = FAILED;
+					break;
+				}
+				upload.state = MAPPED;
+				tasks.push_back(&upload);
+				queued = true;
+				break;
+			case DECODED:
+				if (upload.compressed && upload.mipmaps && streamTail > 0) {
+					// the tail is small, it goes in whatever was uploaded already
+					uploaded += beginStream(upload);
+					if (upload.state == DONE)
+						finished.push_back(finishStream(upload));
+					break;
+				}
+				if (uploaded && uploaded + upload.bytes() > bytesPerFrame)
+					break;
+				uploaded += upload.bytes();
+				finished.push_back(specify(upload));
+				break;
+			case UPLOADED:
+				if (glClientWaitSync(upload.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+					break;
+				release(upload);
+				upload.state = DONE;
+				break;
+			case STREAMING:
+				streaming.push_back(&upload);
+				break;
+			case FAILED: {
+				// keeps the placeholder
+				release(upload);
+				Loaded failed = { upload.texture, 0, 0, 0, 0, 0 };
+				finished.push_back(failed);
+				upload.state = DONE;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		// one level per stream and update, highest priority first, within the same byte budget
+		std::stable_sort(streaming.begin(), streaming.end(), [](const Upload* a, const Upload* b) { return a->priority > b->priority; });
+		for (size_t i = 0; i < streaming.size(); ++i) {
+			Upload& upload = *streaming[i];
+			glBindTexture(GL_TEXTURE_2D, upload.texture);
+			if (upload.fade > 0) {
+				--upload.fade;
+				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, (float)upload.fade / streamFade);
+				if (upload.fade > 0)
+					continue;
+			}
+			if (upload.next < 0) {
+				finished.push_back(finishStream(upload));
+				continue;
+			}
+			size_t bytes = upload.ktx.levelBytes[upload.next];
+			if (uploaded && uploaded + bytes > bytesPerFrame)
+				continue;
+			uploaded += bytes;
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			upload.ktx.uploadLevel(upload.next);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.next);
+			++upload.updates;
+			if (upload.next-- == 0)
+				upload.fullMs = sinceRequest(upload);
+			// sampled from the level above until the fade lets it through
+			if (streamFade > 0) {
+				upload.fade = streamFade;
+				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 1.0f);
+			} else if (upload.next < 0) {
+				finished.push_back(finishStream(upload));
+			}
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		// done uploads are forgotten, so reloading textures over and over does not pile them up
+		for (size_t i = 0; i < uploads.size(); ++i) {
+			if (uploads[i]->state == DONE) {
+				delete uploads[i];
+				uploads.erase(uploads.begin() + i--);
+			}
+		}
+		lock.unlock();
+		if (queued)
+			wake.notify_all();
+		for (size_t i = 0; loaded && i < finished.size(); ++i)
+			loaded(finished[i]);
+	}
+
+	// blocks until every requested texture holds its image, for runs that have to be reproducible
+	void finish() {
+		while (pending()) {
+			update();
+			std::this_thread::yield();
+		}
+	}
+
+	// textures still showing their placeholder
+	int pending() {
+		std::lock_guard<std::mutex> lock(mutex);
+		int count = 0;
+		for (size_t i = 0; i < uploads.size(); ++i)
+			if (uploads[i]->state != DONE && uploads[i]->state != FAILED && !uploads[i]->cancelled)
+				++count;
+		return count;
+	}
+
+private:
+	enum State {
+		REQUESTED, // waiting for a worker to read the size
+		SIZED, // waiting for update() to map a buffer
+		MAPPED, // waiting for a worker to decode into the buffer
+		DECODED, // waiting for update() to upload
+		UPLOADED, // waiting for the fence
+		STREAMING, // compressed, specifying one level per update
+		DONE,
+		FAILED,
+	};
+
+	struct Upload {
+		std::string path;
+		bool mipmaps;
+		bool flip;
+		GLenum compressed;
+		KtxFile ktx;
+		unsigned int texture;
+		unsigned int pbo;
+		void* mapped;
+		GLsync fence;
+		int width, height, channels;
+		State state;
+		bool cancelled;
+		float priority;
+		int resident; // first level the texture already holds, -1 for none
+		int next; // level the stream specifies next, -1 when done
+		int fade; // updates left to blend the last level in
+		int updates;
+		std::chrono::steady_clock::time_point requested;
+		double firstMs;
+		double fullMs;
+
+		Upload() : compressed(0), texture(0), pbo(0), mapped(NULL), fence(0), width(0), height(0), channels(0), state(REQUESTED),
+			cancelled(false), priority(0.0f), resident(-1), next(-1), fade(0), updates(0), firstMs(0.0), fullMs(0.0) {}
+
+		size_t bytes() const {
+			if (compressed)
+				return ktx.bytes();
+			return (size_t)width * height * channels + (mipmaps ? MipmapGenerator::chainBytes(width, height, channels) : 0);
+		}
+	};
+
+	size_t bytesPerFrame;
+	std::vector<Upload*> uploads;
+	std::unordered_map<unsigned int, float> priorities;
+	std::vector<StreamTiming> finishedTimings;
+	std::deque<Upload*> tasks;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit;
+
+	void work() {
+		for (;;) {
+			Upload* upload;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return quit || !tasks.empty(); });
+				if (quit)
+					return;
+				upload = tasks.front();
+				tasks.pop_front();
+			}
+			// the state of a task is only touched by this worker until it is handed back below
+			State next;
+			if (upload->state == REQUESTED && upload->compressed) {
+				next = TextureCache::load(upload->ktx, upload->path, upload->compressed, upload->flip, mipmaps) ? DECODED : REQUESTED;
+				if (next == REQUESTED) {
+					std::cout << "ERROR::TEXTURE_LOADER:: No " << TextureCache::name(upload->compressed) << " cache for " << upload->path
+						<< ", loading it uncompressed" << std::endl;
+					upload->compressed = 0;
+					std::lock_guard<std::mutex> lock(mutex);
+					tasks.push_back(upload);
+					continue;
+				}
+			} else if (upload->state == REQUESTED) {
+				next = stbi_info(upload->path.c_str(), &upload->width, &upload->height, &upload->channels) ? SIZED : FAILED;
+				if (next == FAILED)
+					std::cout << "Failed to load texture " << upload->path << std::endl;
+				// grey images are expanded to RGB(A) so they do not sample as red
+				if (upload->channels < 3)
+					upload->channels += 2;
+				// mip chains take the four channel SIMD path, drivers keep RGB8 as RGBA8 anyway
+				if (upload->mipmaps)
+					upload->channels = 4;
+			} else {
+				int width, height, channels;
+				stbi_set_flip_vertically_on_load_thread(upload->flip);
+				unsigned char* data = stbi_load(upload->path.c_str(), &width, &height, &channels, upload->channels);
+				next = data && width == upload->width && height == upload->height ? DECODED : FAILED;
+				if (next == DECODED) {
+					size_t level0 = (size_t)width * height * upload->channels;
+					memcpy(upload->mapped, data, level0);
+					// built in system memory and copied, reading the levels back from a write-combined mapping would crawl
+					if (upload->mipmaps) {
+						std::vector<unsigned char> chain(MipmapGenerator::chainBytes(width, height, upload->channels));
+						mipmaps.generate(data, width, height, upload->channels, chain.data());
+						memcpy((unsigned char*)upload->mapped + level0, chain.data(), chain.size());
+					}
+				}
+				else
+					std::cout << "Failed to load texture " << upload->path << std::endl;
+				stbi_image_free(data);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			upload->state = next;
+		}
+	}
+
+	// sources the texture from the unmapped PBO, the copy out of the buffer runs asynchronously
+	Loaded specify(Upload& upload) {
+		glBindTexture(GL_TEXTURE_2D, upload.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		if (upload.compressed) {
+			// glCompressedTexImage2D copies client memory before it returns, so the file can be unmapped right away
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			int levels = upload.mipmaps ? (int)upload.ktx.levels.size() : 1;
+			upload.ktx.upload(levels);
+			Loaded result = { upload.texture, upload.ktx.width, upload.ktx.height, 0, upload.ktx.format, levels };
+			upload.ktx.close();
+			upload.state = DONE;
+			return result;
+		}
+		GLenum format = upload.channels == 4 ? GL_RGBA : GL_RGB;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		upload.mapped = NULL;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		size_t offset = 0;
+		int levels = upload.mipmaps ? MipmapGenerator::levels(upload.width, upload.height) : 1;
+		for (int i = 0, w = upload.width, h = upload.height; i < levels; ++i, w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+			glTexImage2D(GL_TEXTURE_2D, i, format, w, h, 0, format, GL_UNSIGNED_BYTE, (void*)offset);
+			offset += (size_t)w * h * upload.channels;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		upload.state = UPLOADED;
+		Loaded result = { upload.texture, upload.width, upload.height, upload.channels, 0, levels };
+		return result;
+	}
+
+	static double sinceRequest(const Upload& upload) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - upload.requested).count();
+	}
+
+	// specifies the levels up to streamTail texels on a side (those the texture does not hold already) and samples
+	// from them, returns the bytes specified
+	size_t beginStream(Upload& upload) {
+		int levels = (int)upload.ktx.levels.size();
+		int tail = 0;
+		while (tail + 1 < levels && std::max(upload.ktx.width, upload.ktx.height) >> tail > streamTail)
+			++tail;
+		int held = upload.resident >= 0 && upload.resident < levels ? upload.resident : levels;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, upload.texture);
+		size_t bytes = 0;
+		for (int i = tail; i < held; ++i) {
+			upload.ktx.uploadLevel(i);
+			bytes += upload.ktx.levelBytes[i];
+		}
+		upload.next = std::min(tail, held) - 1;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.next + 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		upload.firstMs = sinceRequest(upload);
+		upload.fullMs = upload.firstMs;
+		upload.state = upload.next < 0 ? DONE : STREAMING;
+		return bytes;
+	}
+
+	Loaded finishStream(Upload& upload) {
+		glBindTexture(GL_TEXTURE_2D, upload.texture);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, -1000.0f);
+		StreamTiming timing = { upload.path, upload.texture, upload.ktx.width, upload.ktx.height, upload.firstMs, upload.fullMs, upload.updates };
+		finishedTimings.push_back(timing);
+		Loaded result = { upload.texture, upload.ktx.width, upload.ktx.height, 0, upload.ktx.format, (int)upload.ktx.levels.size() };
+		upload.ktx.close();
+		upload.state = DONE;
+		return result;
+	}
+
+	void release(Upload& upload) {
+		if (upload.pbo) {
+			if (upload.mapped) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				upload.mapped = NULL;
+			}
+			glDeleteBuffers(1, &upload.pbo);
+			upload.pbo = 0;
+		}
+		if (upload.fence) {
+			glDeleteSync(upload.fence);
+			upload.fence = 0;
+		}
+	}
+};
+#endif
@@ -0,0 +1,231 @@
+#ifndef TEXTURE_PACKER_H
+#define TEXTURE_PACKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "commandlist.h"
+#include "mipmap.h"
+
+#include <cstring>
+#include <vector>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+
+// Packs RGBA8 images into one texture so draws of differently textured objects share a single binding. ARRAY
+// puts images of one size into the layers of a GL_TEXTURE_2D_ARRAY with full mip chains. ATLAS places images of
+// any size on shelves of a 2D atlas, each surrounded by `padding` texels wrapped from the opposite edge and
+// aligned to it, so the mips down to log2(padding) never bleed between neighbours; a GL_RGBA32F texture holds
+// the uv rect of every image. An object selects its image by index (the DrawItem's layer), texture.fs repeats
+// the coordinates inside the rect and samples with the gradients of the unwrapped ones. An atlas whose shelves
+// outgrow GL_MAX_TEXTURE_SIZE is widened; when the images still do not fit the limits, pack() fails with an error
+// and the caller keeps them as textures of their own.
+class TexturePacker {
+public:
+	enum Mode {
+		ARRAY,
+		ATLAS,
+	};
+
+	struct Image {
+		const unsigned char* rgba;
+		int width, height;
+	};
+
+	Mode mode;
+	unsigned int texture; // the array or the atlas
+	unsigned int rects; // uv rect (offset, size) per image, ATLAS only
+	int width, height; // of a layer or of the atlas
+	int images;
+
+	TexturePacker() : mode(ARRAY), texture(0), rects(0), width(0), height(0), images(0), levels(0) {}
+
+	~TexturePacker() {
+		glDeleteTextures(1, &texture);
+		glDeleteTextures(1, &rects);
+	}
+
+	static const char* name(Mode mode) {
+		return mode == ARRAY ? "array" : "atlas";
+	}
+
+	// replaces what was packed; an ATLAS is atlasWidth texels wide, or wider if it would be too high, and as high as
+	// the shelves need
+	bool pack(const std::vector<Image>& source, Mode packing, const MipmapGenerator& mipmaps = MipmapGenerator(), int atlasWidth = 2048, int padding = 32) {
+		glDeleteTextures(1, &texture);
+		glDeleteTextures(1, &rects);
+		texture = rects = 0;
+		images = 0;
+		mode = packing;
+		if (source.empty())
+			return false;
+		return mode == ARRAY ? packArray(source, mipmaps) : packAtlas(source, mipmaps, atlasWidth, padding);
+	}
+
+	// records the samplers of texture.fs, the array on `unit` and the rects on `unit` + 1
+	void bind(CommandList& list, int unit) const {
+		list.setInt("texturePacking", mode == ARRAY ? 1 : 2);
+		list.setInt("ourTextures", unit);
+		list.setInt("atlasRects", unit + 1);
+		if (mode == ARRAY)
+			list.bindTexture(unit, GL_TEXTURE_2D_ARRAY, texture);
+		else
+			list.bindTexture(unit + 1, GL_TEXTURE_2D, rects);
+	}
+
+	// what a draw binds on unit 0: nothing for an ARRAY, bind() has it on its own unit
+	unsigned int drawTexture() const {
+		return mode == ARRAY ? 0 : texture;
+	}
+
+	size_t bytes() const {
+		size_t total = 0;
+		for (int i = 0, w = width, h = height; i < levels; ++i, w = std::max(1, w / 2), h = std::max(1, h / 2))
+			total += (size_t)w * h * 4 * (mode == ARRAY ? images : 1);
+		return total;
+	}
+
+	void report(std::ostream& out) const {
+		out << "texture packing: " << images << " images in one " << name(mode) << " of " << width << "x" << height
+			<< (mode == ARRAY ? " layers" : " texels") << ", " << levels << " levels, " << bytes() / 1024 << " KB" << std::endl;
+	}
+
+private:
+	int levels;
+
+	TexturePacker(const TexturePacker&);
+	TexturePacker& operator=(const TexturePacker&);
+
+	bool packArray(const std::vector<Image>& source, const MipmapGenerator& mipmaps) {
+		width = source[0].width;
+		height = source[0].height;
+		for (size_t i = 1; i < source.size(); ++i) {
+			if (source[i].width != width || source[i].height != height) {
+				std::cout << "ERROR::TEXTURE_PACKER:: Array layers need images of one size, " << source[i].width << "x" << source[i].height
+					<< " is not " << width << "x" << height << std::endl;
+				return false;
+			}
+		}
+		GLint maxLayers = 0, maxSize = 0;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		if ((GLint)source.size() > maxLayers || width > maxSize || height > maxSize) {
+			std::cout << "ERROR::TEXTURE_PACKER:: " << source.size() << " layers of " << width << "x" << height << " exceed the limits of "
+				<< maxLayers << " layers of " << maxSize << "x" << maxSize << std::endl;
+			return false;
+		}
+		levels = MipmapGenerator::levels(width, height);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		for (int i = 0, w = width, h = height; i < levels; ++i, w = std::max(1, w / 2), h = std::max(1, h / 2))
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, w, h, (GLsizei)source.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		std::vector<unsigned char> chain(MipmapGenerator::chainBytes(width, height, 4));
+		for (size_t layer = 0; layer < source.size(); ++layer) {
+			mipmaps.generate(source[layer].rgba, width, height, 4, chain.data());
+			const unsigned char* level = source[layer].rgba;
+			for (int i = 0, w = width, h = height; i < levels; ++i) {
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, (GLint)layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, level);
+				level = (i == 0 ? chain.data() : level + (size_t)w * h * 4);
+				w = std::max(1, w / 2);
+				h = std::max(1, h / 2);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		images = (int)source.size();
+		return true;
+	}
+
+	bool packAtlas(const std::vector<Image>& source, const MipmapGenerator& mipmaps, int atlasWidth, int padding) {
+		// shelves of the tallest images first, every cell starts and ends on a multiple of the padding
+		std::vector<size_t> order(source.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return source[a].height > source[b].height; });
+		auto align = [padding](int size) { return (size + 2 * padding + padding - 1) / padding * padding; };
+		std::vector<glm::ivec2> cells(source.size());
+		// returns the height of the shelves in an atlas of atlasWidth, 0 if an image is wider
+		auto place = [&]() {
+			int x = 0, y = 0, shelf = 0;
+			for (size_t i = 0; i < order.size(); ++i) {
+				const Image& image = source[order[i]];
+				if (align(image.width) > atlasWidth)
+					return 0;
+				if (x + align(image.width) > atlasWidth) {
+					x = 0;
+					y += shelf;
+					shelf = 0;
+				}
+				cells[order[i]] = glm::ivec2(x, y);
+				x += align(image.width);
+				shelf = std::max(shelf, align(image.height));
+			}
+			return y + shelf;
+		};
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+		atlasWidth = std::min(atlasWidth, (int)maxSize);
+		height = place();
+		while ((height == 0 || height > maxSize) && atlasWidth < maxSize) {
+			atlasWidth = std::min(atlasWidth * 2, (int)maxSize);
+			height = place();
+		}
+		// the rects are one texel per image
+		if (height == 0 || height > maxSize || (GLint)source.size() > maxSize) {
+			std::cout << "ERROR::TEXTURE_PACKER:: " << source.size() << " images do not fit an atlas of at most " << maxSize << "x" << maxSize
+				<< " texels" << std::endl;
+			return false;
+		}
+		width = atlasWidth;
+		levels = 1;
+		while ((padding >> levels) > 0 && (width >> levels) > 0 && (height >> levels) > 0)
+			++levels;
+
+		std::vector<unsigned char> atlas((size_t)width * height * 4, 0);
+		std::vector<glm::vec4> uv(source.size());
+		for (size_t i = 0; i < source.size(); ++i) {
+			const Image& image = source[i];
+			for (int row = -padding; row < image.height + padding; ++row) {
+				int sy = (row % image.height + image.height) % image.height;
+				unsigned char* out = &atlas[((size_t)(cells[i].y + padding + row) * width + cells[i].x) * 4];
+				for (int column = -padding; column < image.width + padding; ++column, out += 4) {
+					int sx = (column % image.width + image.width) % image.width;
+					memcpy(out, image.rgba + ((size_t)sy * image.width + sx) * 4, 4);
+				}
+			}
+			uv[i] = glm::vec4((float)(cells[i].x + padding) / width, (float)(cells[i].y + padding) / height,
+				(float)image.width / width, (float)image.height / height);
+		}
+
+		std::vector<unsigned char> chain(MipmapGenerator::chainBytes(width, height, 4));
+		mipmaps.generate(atlas.data(), width, height, 4, chain.data());
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		const unsigned char* level = atlas.data();
+		for (int i = 0, w = width, h = height; i < levels; ++i) {
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+			level = (i == 0 ? chain.data() : level + (size_t)w * h * 4);
+			w = std::max(1, w / 2);
+			h = std::max(1, h / 2);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+		glGenTextures(1, &rects);
+		glBindTexture(GL_TEXTURE_2D, rects);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, (GLsizei)uv.size(), 1, 0, GL_RGBA, GL_FLOAT, uv.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		images = (int)source.size();
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,115 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_aligned.hpp>
+
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+// A scene graph of translate-rotate-scale nodes kept as flat arrays in parent-before-child order, so one
+// linear pass sees every parent's world matrix before its children. Setting a local transform only marks the
+// node dirty; update() recomputes the world matrices of dirty nodes and everything below them and leaves the
+// rest untouched. The products run on glm's aligned types, SSE with GLM_FORCE_INTRINSICS.
+class TransformHierarchy {
+public:
+	// world matrices recomputed by the last update()
+	int recomputed;
+
+	TransformHierarchy() : recomputed(0), anyDirty(false) {}
+
+	// the parent must already be in the hierarchy, -1 makes a root
+	int add(int parent, const glm::vec3& translation = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		const glm::vec3& scale = glm::vec3(1.0f)) {
+		int node = (int)parents.size();
+		// update() relies on parents coming before their children, a node breaking that becomes a root
+		if (parent < -1 || parent >= node) {
+			std::cout << "ERROR::TRANSFORM_HIERARCHY::PARENT_NOT_ADDED_YET " << parent << std::endl;
+			parent = -1;
+		}
+		parents.push_back(parent);
+		translations.push_back(translation);
+		rotations.push_back(rotation);
+		scales.push_back(scale);
+		worlds.push_back(glm::mat4(1.0f));
+		dirty.push_back(1);
+		anyDirty = true;
+		return node;
+	}
+
+	int size() const {
+		return (int)parents.size();
+	}
+
+	void setTranslation(int node, const glm::vec3& translation) {
+		translations[node] = translation;
+		markDirty(node);
+	}
+
+	void setRotation(int node, const glm::quat& rotation) {
+		rotations[node] = rotation;
+		markDirty(node);
+	}
+
+	void setScale(int node, const glm::vec3& scale) {
+		scales[node] = scale;
+		markDirty(node);
+	}
+
+	// as of the last update()
+	const glm::mat4& world(int node) const {
+		return worlds[node];
+	}
+
+	int update() {
+		recomputed = 0;
+		if (!anyDirty)
+			return 0;
+#if GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE
+		typedef glm::aligned_mat4 Matrix;
+#else
+		typedef glm::mat4 Matrix;
+#endif
+		for (size_t i = 0; i < parents.size(); ++i) {
+			int parent = parents[i];
+			// a parent precedes its children, so its flag already includes its own ancestors
+			if (parent >= 0 && dirty[parent])
+				dirty[i] = 1;
+			if (!dirty[i])
+				continue;
+			// T * R * S, built column by column
+			glm::mat3 rotation = glm::mat3_cast(rotations[i]);
+			Matrix local(
+				glm::vec4(rotation[0] * scales[i].x, 0.0f),
+				glm::vec4(rotation[1] * scales[i].y, 0.0f),
+				glm::vec4(rotation[2] * scales[i].z, 0.0f),
+				glm::vec4(translations[i], 1.0f));
+			worlds[i] = parent >= 0 ? glm::mat4(Matrix(worlds[parent]) * local) : glm::mat4(local);
+			++recomputed;
+		}
+		std::fill(dirty.begin(), dirty.end(), 0);
+		anyDirty = false;
+		return recomputed;
+	}
+
+	void report(std::ostream& out) const {
+		out << "transforms: " << recomputed << " of " << size() << " world matrices recomputed last frame" << std::endl;
+	}
+
+private:
+	std::vector<int> parents;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned char> dirty;
+	bool anyDirty;
+
+	void markDirty(int node) {
+		dirty[node] = 1;
+		anyDirty = true;
+	}
+};
+#endif
@@ -0,0 +1,36 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_aligned.hpp>
+
+#include <cstddef>
+
+// The per-object transform block the vertex shaders read instead of deriving it per vertex: the model matrix,
+// the normal matrix (inverse transpose of the model's upper 3x3) and the model-view-projection matrix.
+struct ObjectTransform {
+	glm::mat4 model;
+	glm::mat3 normal;
+	glm::mat4 mvp;
+
+	// one view projection for a batch of objects. With GLM_FORCE_INTRINSICS the aligned glm types run the
+	// products and glm::inverse on 4-wide SSE registers, without it this is the same code on plain floats.
+	static void compute(const glm::mat4& viewProjection, const glm::mat4* models, size_t count, ObjectTransform* out) {
+#if GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE
+		typedef glm::aligned_mat4 Matrix;
+#else
+		typedef glm::mat4 Matrix;
+#endif
+		Matrix vp(viewProjection);
+		for (size_t i = 0; i < count; ++i) {
+			Matrix model(models[i]);
+			Matrix inverse = glm::inverse(model);
+			out[i].model = models[i];
+			out[i].mvp = glm::mat4(vp * model);
+			// the upper 3x3 of the transposed inverse, read straight out of the inverse's rows
+			for (int c = 0; c < 3; ++c)
+				out[i].normal[c] = glm::vec3(inverse[0][c], inverse[1][c], inverse[2][c]);
+		}
+	}
+};
+#endif
@@ -0,0 +1,503 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "commandlist.h"
+#include "mipmap.h"
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <sys/stat.h>
+
+// A virtual texture: the image is resampled to a square of PAGE * 2^n texels, its mip chain down to a single page
+// is cut into pages with a BORDER of wrapped texels and stored in <image>.vt (.flip.vt) on the first run. At run
+// time only the pages the view needs live in a physical atlas of slots; an indirection texture, one texel per page
+// of every level packed side by side, points each page at its slot or at the slot of its nearest resident ancestor.
+// renderFeedback() draws the objects into a small target that writes the page each fragment samples and reads it
+// back through a pixel buffer; update() maps the previous frame's readback, so it never waits on the GPU, loads
+// up to pagesPerFrame missing pages (coarse ones first) into free or least recently used slots and refreshes the
+// indirection. The coarsest page is pinned, so every lookup lands somewhere. Everything is plain GL 3.3.
+class VirtualTexture {
+public:
+	static const int PAGE = 128; // texels on a side of a page
+	static const int BORDER = 4; // wrapped texels around each page for bilinear filtering
+	static const int SLOT = PAGE + 2 * BORDER;
+
+	struct Counters {
+		int size; // texels on a side of level 0
+		int levels;
+		int pages; // of all levels
+		int slots;
+		int resident;
+		int visible; // pages the last feedback asked for, with their ancestors
+		int missing; // of those, still not resident
+		unsigned long long uploads; // since open()
+		unsigned long long evictions;
+	};
+
+	unsigned int atlas;
+	unsigned int indirection;
+	int pagesPerFrame;
+
+	// atlasSlots slots on a side (at most 256), the feedback target is the view's size divided by feedbackScale
+	VirtualTexture(int atlasSlots = 16, int pagesPerFrame = 8, int feedbackScale = 8) : atlas(0), indirection(0), pagesPerFrame(pagesPerFrame),
+		atlasSlots(std::min(atlasSlots, 256)), feedbackScale(feedbackScale), file(NULL), size(0), levels(0), frame(0), visible(0), missing(0),
+		uploads(0), evictions(0), dirty(false), fbo(0), feedbackColor(0), feedbackDepth(0), feedbackWidth(0), feedbackHeight(0) {
+		pbos[0] = pbos[1] = 0;
+		filled[0] = filled[1] = false;
+	}
+
+	~VirtualTexture() {
+		close();
+	}
+
+	// maps the page cache of the image, building it first if it is missing or stale
+	bool open(const std::string& image, bool flip, const MipmapGenerator& mipmaps = MipmapGenerator()) {
+		close();
+		std::string cache = image + (flip ? ".flip.vt" : ".vt");
+		struct stat imageInfo, cacheInfo;
+		bool fresh = stat(cache.c_str(), &cacheInfo) == 0 && (stat(image.c_str(), &imageInfo) != 0 || cacheInfo.st_mtime >= imageInfo.st_mtime);
+		if (!(fresh && readHeader(cache)) && !(build(image, cache, flip, mipmaps) && readHeader(cache)))
+			return false;
+
+		int pages = 0;
+		for (int level = 0; level < levels; ++level) {
+			levelFirst.push_back(pages);
+			pages += pagesOf(level) * pagesOf(level);
+		}
+		pageSlots.assign(pages, -1);
+		pageWanted.assign(pages, 0);
+		slots.assign(atlasSlots * atlasSlots, Slot());
+		for (int i = (int)slots.size() - 1; i >= 0; --i)
+			freeSlots.push_back(i);
+
+		glGenTextures(1, &atlas);
+		glBindTexture(GL_TEXTURE_2D, atlas);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSlots * SLOT, atlasSlots * SLOT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		int n = pagesOf(0);
+		table.assign((size_t)(2 * n - 1) * n * 4, 0);
+		glGenTextures(1, &indirection);
+		glBindTexture(GL_TEXTURE_2D, indirection);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2 * n - 1, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		// the single page of the last level is the fallback of every lookup
+		int coarsest = levelFirst[levels - 1];
+		if (!load(coarsest, allocate())) {
+			close();
+			return false;
+		}
+		slots[pageSlots[coarsest]].used = PINNED;
+		writeTable();
+		return true;
+	}
+
+	void close() {
+		if (file)
+			fclose(file);
+		file = NULL;
+		glDeleteTextures(1, &atlas);
+		glDeleteTextures(1, &indirection);
+		glDeleteTextures(1, &feedbackColor);
+		glDeleteRenderbuffers(1, &feedbackDepth);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteBuffers(2, pbos);
+		atlas = indirection = feedbackColor = feedbackDepth = fbo = 0;
+		pbos[0] = pbos[1] = 0;
+		filled[0] = filled[1] = false;
+		feedbackWidth = feedbackHeight = 0;
+		levels = 0;
+		levelFirst.clear();
+		pageSlots.clear();
+		pageWanted.clear();
+		slots.clear();
+		freeSlots.clear();
+	}
+
+	bool valid() const {
+		return file != NULL;
+	}
+
+	// the feedback color texture, for declaring the pass to a frame graph
+	unsigned int feedback() const {
+		return feedbackColor;
+	}
+
+	// records the uniforms of texture.fs, the atlas itself is the object's texture on unit 0
+	void bind(CommandList& list, int unit) const {
+		list.bindTexture(unit, GL_TEXTURE_2D, indirection);
+		list.setInt("vtIndirection", unit);
+		list.setInt("useVirtualTexture", 1);
+		setUniforms(list);
+	}
+
+	// draws the objects into the feedback target of the view's size divided by feedbackScale and starts reading it
+	// back, update() picks the result up a frame later
+	void renderFeedback(Shader& shader, const glm::mat4& view, const glm::mat4& projection, int width, int height,
+		const std::vector<glm::mat4>& models, unsigned int vao, unsigned int count) {
+		resizeFeedback(std::max(1, width / feedbackScale), std::max(1, height / feedbackScale));
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, feedbackWidth, feedbackHeight);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		shader.use();
+		shader.setMat4("view", view);
+		shader.setMat4("projection", projection);
+		setUniforms(shader);
+		// the derivatives are feedbackScale times those of the view, the level has to match the view's
+		shader.setFloat("vtLodBias", -std::log2((float)feedbackScale));
+		glBindVertexArray(vao);
+		for (size_t i = 0; i < models.size(); ++i) {
+			shader.setMat4("model", models[i]);
+			glDrawArrays(GL_TRIANGLES, 0, count);
+		}
+
+		int current = (int)(frame & 1);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[current]);
+		glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		filled[current] = true;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	// once per frame after drawing: reads the previous feedback, loads missing pages within the budget and
+	// refreshes the indirection, then begins the next frame
+	void update() {
+		int previous = (int)((frame + 1) & 1);
+		if (valid() && filled[previous]) {
+			std::vector<int> wanted;
+			visible = 0;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[previous]);
+			const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+				(size_t)feedbackWidth * feedbackHeight * 4, GL_MAP_READ_BIT);
+			if (pixels) {
+				for (size_t i = 0; i < (size_t)feedbackWidth * feedbackHeight; ++i, pixels += 4)
+					if (pixels[3] && pixels[2] < levels && pixels[0] < pagesOf(pixels[2]) && pixels[1] < pagesOf(pixels[2]))
+						request(pixels[2], pixels[0], pixels[1], wanted);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			filled[previous] = false;
+
+			// coarser levels have the larger ids, they go first so a region sharpens one level at a time
+			std::sort(wanted.begin(), wanted.end(), std::greater<int>());
+			int loaded = 0;
+			for (size_t i = 0; i < wanted.size() && loaded < pagesPerFrame; ++i) {
+				int slot = allocate();
+				if (slot < 0)
+					break;
+				if (load(wanted[i], slot))
+					++loaded;
+			}
+			missing = (int)wanted.size() - loaded;
+		}
+		if (dirty)
+			writeTable();
+		++frame;
+	}
+
+	Counters counters() const {
+		Counters c = { size, levels, (int)pageSlots.size(), (int)slots.size(), (int)(slots.size() - freeSlots.size()), visible, missing, uploads, evictions };
+		return c;
+	}
+
+	void report(std::ostream& out) const {
+		Counters c = counters();
+		out << "virtual texture: " << c.size << "x" << c.size << " in " << c.levels << " levels of " << PAGE << "x" << PAGE << " pages, "
+			<< c.resident << " / " << c.slots << " slots resident, " << c.visible << " pages visible (" << c.missing << " missing), "
+			<< c.uploads << " uploads, " << c.evictions << " evictions" << std::endl;
+	}
+
+	// resamples the image to the virtual size and writes every page of its chain to `cache`
+	static bool build(const std::string& image, const std::string& cache, bool flip, const MipmapGenerator& mipmaps = MipmapGenerator()) {
+		int width, height, channels;
+		stbi_set_flip_vertically_on_load_thread(flip);
+		unsigned char* rgba = stbi_load(image.c_str(), &width, &height, &channels, 4);
+		if (!rgba) {
+			std::cout << "Failed to load texture " << image << std::endl;
+			return false;
+		}
+		int size = PAGE;
+		while (size < width || size < height)
+			size *= 2;
+		std::vector<unsigned char> levelZero = resample(rgba, width, height, size);
+		stbi_image_free(rgba);
+		std::vector<unsigned char> chain(MipmapGenerator::chainBytes(size, size, 4));
+		mipmaps.generate(levelZero.data(), size, size, 4, chain.data());
+
+		FILE* out = fopen(cache.c_str(), "wb");
+		if (!out) {
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << cache << std::endl;
+			return false;
+		}
+		int levels = 0;
+		while (PAGE << levels <= size)
+			++levels;
+		const unsigned int header[5] = { MAGIC, (unsigned int)size, PAGE, BORDER, (unsigned int)levels };
+		fwrite(header, sizeof(unsigned int), 5, out);
+		std::vector<unsigned char> page((size_t)SLOT * SLOT * 4);
+		const unsigned char* level = levelZero.data();
+		for (int i = 0, levelSize = size; i < levels; ++i) {
+			int pages = levelSize / PAGE;
+			for (int y = 0; y < pages; ++y) {
+				for (int x = 0; x < pages; ++x) {
+					for (int row = 0; row < SLOT; ++row) {
+						int sy = (y * PAGE + row - BORDER + levelSize) % levelSize;
+						for (int column = 0; column < SLOT; ++column) {
+							int sx = (x * PAGE + column - BORDER + levelSize) % levelSize;
+							memcpy(&page[((size_t)row * SLOT + column) * 4], level + ((size_t)sy * levelSize + sx) * 4, 4);
+						}
+					}
+					fwrite(page.data(), 1, page.size(), out);
+				}
+			}
+			level = (i == 0 ? chain.data() : level + (size_t)levelSize * levelSize * 4);
+			levelSize /= 2;
+		}
+		bool ok = ferror(out) == 0;
+		fclose(out);
+		if (!ok)
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << cache << std::endl;
+		return ok;
+	}
+
+private:
+	struct Slot {
+		int page; // -1 while free
+		unsigned long long used; // frame of the last feedback that asked for the page
+		Slot() : page(-1), used(0) {}
+	};
+
+	static const unsigned int MAGIC = 0x31585456; // "VTX1"
+	static const unsigned long long PINNED = ~0ull;
+
+	int atlasSlots;
+	int feedbackScale;
+	FILE* file;
+	int size;
+	int levels;
+	std::vector<int> levelFirst; // id of the first page of each level
+	std::vector<int> pageSlots; // per page id, -1 when not resident
+	std::vector<unsigned long long> pageWanted; // frame + 1 of the last feedback that asked for it
+	std::vector<Slot> slots;
+	std::vector<int> freeSlots;
+	std::vector<unsigned char> table; // CPU copy of the indirection texture
+	std::vector<unsigned char> page;
+	unsigned long long frame;
+	int visible;
+	int missing;
+	unsigned long long uploads;
+	unsigned long long evictions;
+	bool dirty;
+	unsigned int fbo;
+	unsigned int feedbackColor;
+	unsigned int feedbackDepth;
+	unsigned int pbos[2];
+	bool filled[2];
+	int feedbackWidth, feedbackHeight;
+
+	VirtualTexture(const VirtualTexture&);
+	VirtualTexture& operator=(const VirtualTexture&);
+
+	int pagesOf(int level) const {
+		return (size / PAGE) >> level;
+	}
+
+	// of the level's first page in the indirection texture, the levels sit side by side
+	int columnOf(int level) const {
+		return 2 * (pagesOf(0) - pagesOf(level));
+	}
+
+	template <typename Target>
+	void setUniforms(Target& target) const {
+		target.setInt("vtPages", pagesOf(0));
+		target.setInt("vtMaxLevel", levels - 1);
+		target.setInt("vtSlots", atlasSlots);
+		target.setInt("vtPage", PAGE);
+		target.setInt("vtBorder", BORDER);
+	}
+
+	bool readHeader(const std::string& cache) {
+		file = fopen(cache.c_str(), "rb");
+		unsigned int header[5];
+		if (file && fread(header, sizeof(unsigned int), 5, file) == 5 && header[0] == MAGIC && header[2] == PAGE && header[3] == BORDER
+			&& header[4] > 0 && (int)header[1] == PAGE << (header[4] - 1)) {
+			size = (int)header[1];
+			levels = (int)header[4];
+			return true;
+		}
+		if (file) {
+			std::cout << "ERROR::VIRTUAL_TEXTURE::FILE_NOT_SUCCESFULLY_READ " << cache << std::endl;
+			fclose(file);
+		}
+		file = NULL;
+		return false;
+	}
+
+	// asks for the page and its ancestors up to the first one already asked for this frame
+	void request(int level, int x, int y, std::vector<int>& wanted) {
+		for (; level < levels; ++level, x /= 2, y /= 2) {
+			int id = levelFirst[level] + y * pagesOf(level) + x;
+			if (pageWanted[id] == frame + 1)
+				break;
+			pageWanted[id] = frame + 1;
+			++visible;
+			if (pageSlots[id] >= 0) {
+				if (slots[pageSlots[id]].used != PINNED)
+					slots[pageSlots[id]].used = frame;
+			} else {
+				wanted.push_back(id);
+			}
+		}
+	}
+
+	// a free slot or the least recently used one not asked for this frame, -1 when every slot is in use
+	int allocate() {
+		if (!freeSlots.empty()) {
+			int slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+		int oldest = -1;
+		for (int i = 0; i < (int)slots.size(); ++i)
+			if (slots[i].used < frame && (oldest < 0 || slots[i].used < slots[oldest].used))
+				oldest = i;
+		if (oldest >= 0) {
+			pageSlots[slots[oldest].page] = -1;
+			slots[oldest].page = -1;
+			++evictions;
+			dirty = true;
+		}
+		return oldest;
+	}
+
+	bool load(int id, int slot) {
+		if (slot < 0)
+			return false;
+		page.resize((size_t)SLOT * SLOT * 4);
+		long long offset = 5 * sizeof(unsigned int) + (long long)id * page.size();
+#ifdef _WIN32
+		bool read = _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+		bool read = fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+		if (!read || fread(page.data(), 1, page.size(), file) != page.size()) {
+			std::cout << "ERROR::VIRTUAL_TEXTURE:: Failed to read page " << id << std::endl;
+			freeSlots.push_back(slot);
+			return false;
+		}
+		glBindTexture(GL_TEXTURE_2D, atlas);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, slot % atlasSlots * SLOT, slot / atlasSlots * SLOT, SLOT, SLOT, GL_RGBA, GL_UNSIGNED_BYTE, page.data());
+		slots[slot].page = id;
+		slots[slot].used = frame;
+		pageSlots[id] = slot;
+		++uploads;
+		dirty = true;
+		return true;
+	}
+
+	// every page points at its own slot or at its parent's entry, from the coarsest level down
+	void writeTable() {
+		int width = 2 * pagesOf(0) - 1;
+		for (int level = levels - 1; level >= 0; --level) {
+			int n = pagesOf(level);
+			for (int y = 0; y < n; ++y) {
+				for (int x = 0; x < n; ++x) {
+					unsigned char* entry = &table[((size_t)y * width + columnOf(level) + x) * 4];
+					int slot = pageSlots[levelFirst[level] + y * n + x];
+					if (slot >= 0) {
+						entry[0] = (unsigned char)(slot % atlasSlots);
+						entry[1] = (unsigned char)(slot / atlasSlots);
+						entry[2] = (unsigned char)level;
+						entry[3] = 255;
+					} else {
+						memcpy(entry, &table[((size_t)(y / 2) * width + columnOf(level + 1) + x / 2) * 4], 4);
+					}
+				}
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, indirection);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, pagesOf(0), GL_RGBA, GL_UNSIGNED_BYTE, table.data());
+		dirty = false;
+	}
+
+	void resizeFeedback(int width, int height) {
+		if (width == feedbackWidth && height == feedbackHeight)
+			return;
+		feedbackWidth = width;
+		feedbackHeight = height;
+		if (!fbo) {
+			glGenFramebuffers(1, &fbo);
+			glGenTextures(1, &feedbackColor);
+			glGenRenderbuffers(1, &feedbackDepth);
+			glGenBuffers(2, pbos);
+		}
+		glBindTexture(GL_TEXTURE_2D, feedbackColor);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "ERROR::FRAMEBUFFER:: Virtual texture feedback framebuffer is not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		for (int i = 0; i < 2; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+			filled[i] = false;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// bilinear, only when the image is not the virtual size already
+	static std::vector<unsigned char> resample(const unsigned char* src, int width, int height, int size) {
+		std::vector<unsigned char> dst((size_t)size * size * 4);
+		if (width == size && height == size) {
+			memcpy(dst.data(), src, dst.size());
+			return dst;
+		}
+		for (int y = 0; y < size; ++y) {
+			float fy = std::max(0.0f, (y + 0.5f) * height / size - 0.5f);
+			int y0 = std::min((int)fy, height - 1), y1 = std::min(y0 + 1, height - 1);
+			float wy = fy - y0;
+			for (int x = 0; x < size; ++x) {
+				float fx = std::max(0.0f, (x + 0.5f) * width / size - 0.5f);
+				int x0 = std::min((int)fx, width - 1), x1 = std::min(x0 + 1, width - 1);
+				float wx = fx - x0;
+				for (int c = 0; c < 4; ++c) {
+					float top = src[((size_t)y0 * width + x0) * 4 + c] * (1.0f - wx) + src[((size_t)y0 * width + x1) * 4 + c] * wx;
+					float bottom = src[((size_t)y1 * width + x0) * 4 + c] * (1.0f - wx) + src[((size_t)y1 * width + x1) * 4 + c] * wx;
+					dst[((size_t)y * size + x) * 4 + c] = (unsigned char)(top * (1.0f - wy) + bottom * wy + 0.5f);
+				}
+			}
+		}
+		return dst;
+	}
+};
+#endif